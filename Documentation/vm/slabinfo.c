@@ -39,6 +39,7 @@ struct slabinfo {
 	unsigned long cpuslab_flush, deactivate_full, deactivate_empty;
 	unsigned long deactivate_to_head, deactivate_to_tail;
 	unsigned long deactivate_remote_frees, order_fallback;
+	unsigned long alloc_bulk, free_bulk, free_bulk_slab;
 	int numa[MAX_NODES];
 	int numa_partial[MAX_NODES];
 } slabinfo[MAX_SLABS];
@@ -465,6 +466,10 @@ static void slab_stats(struct slabinfo *s)
 	if (s->alloc_refill)
 		printf("Refill %8lu\n", s->alloc_refill);
 
+	if (s->alloc_bulk || s->free_bulk)
+		printf("Bulk alloc %8lu free %8lu (%lu slab batches)\n",
+			s->alloc_bulk, s->free_bulk, s->free_bulk_slab);
+
 	total = s->deactivate_full + s->deactivate_empty +
 			s->deactivate_to_head + s->deactivate_to_tail;
 
@@ -1190,6 +1195,9 @@ static void read_slab_dir(void)
 			slab->deactivate_to_tail = get_obj("deactivate_to_tail");
 			slab->deactivate_remote_frees = get_obj("deactivate_remote_frees");
 			slab->order_fallback = get_obj("order_fallback");
+			slab->alloc_bulk = get_obj("alloc_bulk");
+			slab->free_bulk = get_obj("free_bulk");
+			slab->free_bulk_slab = get_obj("free_bulk_slab");
 			chdir("..");
 			if (slab->name[0] == ':')
 				alias_targets++;
@@ -36,6 +36,7 @@
 #include <linux/blkdev.h>
 #include <linux/mempool.h>
 #include <linux/hash.h>
+#include <linux/log2.h>
 
 #include <asm/kmap_types.h>
 #include <asm/uaccess.h>
@@ -183,6 +184,40 @@ static int aio_setup_ring(struct kioctx *ctx)
 	return 0;
 }
 
+/* aio_setup_sq_ring
+ *	Attach the submission ring userspace allocated at @ring to the
+ *	context.  The caller sets ring->nr to a power of two; the rest of
+ *	the header is filled in here.  The ring is only ever touched
+ *	through user accesses from the submitting process, so unlike the
+ *	completion ring its pages are not pinned.
+ */
+static int aio_setup_sq_ring(struct kioctx *ctx,
+			     struct aio_sq_ring __user *ring)
+{
+	struct aio_sq_info *sq = &ctx->sq_info;
+	unsigned nr_entries;
+
+	if (get_user(nr_entries, &ring->nr))
+		return -EFAULT;
+	if (!nr_entries || !is_power_of_2(nr_entries) ||
+	    nr_entries > AIO_SQ_RING_MAX)
+		return -EINVAL;
+	if (!access_ok(VERIFY_WRITE, ring, sizeof(struct aio_sq_ring) +
+		       sizeof(struct iocb) * nr_entries))
+		return -EFAULT;
+
+	if (put_user(0, &ring->head) ||
+	    put_user(0, &ring->tail) ||
+	    put_user(AIO_SQ_RING_MAGIC, &ring->magic) ||
+	    put_user(sizeof(struct aio_sq_ring), &ring->header_length))
+		return -EFAULT;
+
+	sq->ring = ring;
+	sq->head = 0;
+	sq->nr = nr_entries;		/* trusted copy */
+	return 0;
+}
+
 
 /* aio_ring_event: returns a pointer to the event at the given index from
  * kmap_atomic(, km).  Release the pointer with put_aio_ring_event();
@@ -249,13 +284,17 @@ static void __put_ioctx(struct kioctx *ctx)
 } while (0)
 
 /* ioctx_alloc
- *	Allocates and initializes an ioctx.  Returns an ERR_PTR if it failed.
+ *	Allocates and initializes an ioctx, using the submission ring at
+ *	sq_ring if flags has IOCTX_FLAG_SQ_RING.  Returns an ERR_PTR if it
+ *	failed.
  */
-static struct kioctx *ioctx_alloc(unsigned nr_events)
+static struct kioctx *ioctx_alloc(unsigned nr_events, unsigned flags,
+				  struct aio_sq_ring __user *sq_ring)
 {
 	struct mm_struct *mm;
 	struct kioctx *ctx;
 	int did_sync = 0;
+	int err = -ENOMEM;
 
 	/* Prevent overflows */
 	if ((nr_events > (0x10000000U / sizeof(struct io_event))) ||
@@ -272,12 +311,14 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 		return ERR_PTR(-ENOMEM);
 
 	ctx->max_reqs = nr_events;
+	ctx->flags = flags;
 	mm = ctx->mm = current->mm;
 	atomic_inc(&mm->mm_count);
 
 	atomic_set(&ctx->users, 1);
 	spin_lock_init(&ctx->ctx_lock);
-	spin_lock_init(&ctx->ring_info.ring_lock);
+	mutex_init(&ctx->ring_info.ring_lock);
+	mutex_init(&ctx->sq_info.lock);
 	init_waitqueue_head(&ctx->wait);
 
 	INIT_LIST_HEAD(&ctx->active_reqs);
@@ -287,6 +328,14 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 	if (aio_setup_ring(ctx) < 0)
 		goto out_freectx;
 
+	if (flags & IOCTX_FLAG_SQ_RING) {
+		err = aio_setup_sq_ring(ctx, sq_ring);
+		if (err) {
+			aio_free_ring(ctx);
+			goto out_freectx;
+		}
+	}
+
 	/* limit the number of system wide aios */
 	do {
 		spin_lock_bh(&aio_nr_lock);
@@ -324,7 +373,7 @@ out_cleanup:
 out_freectx:
 	mmdrop(mm);
 	kmem_cache_free(kioctx_cachep, ctx);
-	ctx = ERR_PTR(-ENOMEM);
+	ctx = ERR_PTR(err);
 
 	dprintk("aio: error allocating ioctx %p\n", ctx);
 	return ctx;
@@ -442,8 +491,6 @@ void exit_aio(struct mm_struct *mm)
 static struct kiocb *__aio_get_req(struct kioctx *ctx)
 {
 	struct kiocb *req = NULL;
-	struct aio_ring *ring;
-	int okay = 0;
 
 	req = kmem_cache_alloc(kiocb_cachep, GFP_KERNEL);
 	if (unlikely(!req))
@@ -461,39 +508,125 @@ static struct kiocb *__aio_get_req(struct kioctx *ctx)
 	INIT_LIST_HEAD(&req->ki_run_list);
 	req->ki_eventfd = NULL;
 
-	/* Check if the completion queue has enough free space to
-	 * accept an event from this io.
-	 */
+	return req;
+}
+
+/*
+ * struct kiocb's are allocated in batches to reduce the number of
+ * times the ctx lock is acquired and released.
+ */
+#define KIOCB_BATCH_SIZE	32L
+struct kiocb_batch {
+	struct list_head head;
+	long count; /* number of requests left to allocate */
+};
+
+static void kiocb_batch_init(struct kiocb_batch *batch, long total)
+{
+	INIT_LIST_HEAD(&batch->head);
+	batch->count = total;
+}
+
+static void kiocb_batch_free(struct kioctx *ctx, struct kiocb_batch *batch)
+{
+	struct kiocb *req, *n;
+
+	if (list_empty(&batch->head))
+		return;
+
+	spin_lock_irq(&ctx->ctx_lock);
+	list_for_each_entry_safe(req, n, &batch->head, ki_batch) {
+		list_del(&req->ki_batch);
+		list_del(&req->ki_list);
+		kmem_cache_free(kiocb_cachep, req);
+		ctx->reqs_active--;
+	}
+	if (unlikely(!ctx->reqs_active && ctx->dead))
+		wake_up(&ctx->wait);
+	spin_unlock_irq(&ctx->ctx_lock);
+}
+
+/*
+ * Allocate a batch of kiocbs.  This avoids taking and dropping the
+ * context lock, and checking the completion ring for room, for every
+ * single request submitted.
+ */
+static int kiocb_batch_refill(struct kioctx *ctx, struct kiocb_batch *batch)
+{
+	unsigned short allocated, to_alloc;
+	long avail;
+	int called_fput = 0;
+	struct kiocb *req, *n;
+	struct aio_ring *ring;
+
+	to_alloc = min(batch->count, KIOCB_BATCH_SIZE);
+	for (allocated = 0; allocated < to_alloc; allocated++) {
+		req = __aio_get_req(ctx);
+		if (!req)
+			/* allocation failed, go with what we've got */
+			break;
+		list_add(&req->ki_batch, &batch->head);
+	}
+
+	if (allocated == 0)
+		goto out;
+
+retry:
 	spin_lock_irq(&ctx->ctx_lock);
 	ring = kmap_atomic(ctx->ring_info.ring_pages[0], KM_USER0);
-	if (ctx->reqs_active < aio_ring_avail(&ctx->ring_info, ring)) {
+
+	/* Check if the completion queue has enough free space to
+	 * accept an event from each of these ios.
+	 */
+	avail = aio_ring_avail(&ctx->ring_info, ring) - ctx->reqs_active;
+	if (avail <= 0 && !called_fput) {
+		/*
+		 * Handle a potential starvation case -- should be exceedingly
+		 * rare as requests will be stuck on fput_head only if the
+		 * aio_fput_routine is delayed and the requests were the last
+		 * user of the struct file.
+		 */
+		kunmap_atomic(ring, KM_USER0);
+		spin_unlock_irq(&ctx->ctx_lock);
+		aio_fput_routine(NULL);
+		called_fput = 1;
+		goto retry;
+	}
+
+	if (avail < allocated) {
+		/* Trim back the number of requests. */
+		list_for_each_entry_safe(req, n, &batch->head, ki_batch) {
+			if (allocated <= avail)
+				break;
+			list_del(&req->ki_batch);
+			kmem_cache_free(kiocb_cachep, req);
+			allocated--;
+		}
+	}
+
+	batch->count -= allocated;
+	list_for_each_entry(req, &batch->head, ki_batch) {
 		list_add(&req->ki_list, &ctx->active_reqs);
 		ctx->reqs_active++;
-		okay = 1;
 	}
+
 	kunmap_atomic(ring, KM_USER0);
 	spin_unlock_irq(&ctx->ctx_lock);
 
-	if (!okay) {
-		kmem_cache_free(kiocb_cachep, req);
-		req = NULL;
-	}
-
-	return req;
+out:
+	return allocated;
 }
 
-static inline struct kiocb *aio_get_req(struct kioctx *ctx)
+static inline struct kiocb *aio_get_req(struct kioctx *ctx,
+					struct kiocb_batch *batch)
 {
 	struct kiocb *req;
-	/* Handle a potential starvation case -- should be exceedingly rare as 
-	 * requests will be stuck on fput_head only if the aio_fput_routine is 
-	 * delayed and the requests were the last user of the struct file.
-	 */
-	req = __aio_get_req(ctx);
-	if (unlikely(NULL == req)) {
-		aio_fput_routine(NULL);
-		req = __aio_get_req(ctx);
-	}
+
+	if (list_empty(&batch->head))
+		if (kiocb_batch_refill(ctx, batch) == 0)
+			return NULL;
+	req = list_first_entry(&batch->head, struct kiocb, ki_batch);
+	list_del(&req->ki_batch);
 	return req;
 }
 
@@ -904,6 +1037,43 @@ void kick_iocb(struct kiocb *iocb)
 }
 EXPORT_SYMBOL(kick_iocb);
 
+/* aio_ring_add_event
+ *	Append a completion event to the ring and publish it to userspace.
+ *	Must be called with ctx->ctx_lock held and interrupts off; the
+ *	caller owns a reserved slot (an active request).
+ */
+static void aio_ring_add_event(struct kioctx *ctx, struct iocb __user *obj,
+			       u64 data, long res, long res2)
+{
+	struct aio_ring_info	*info = &ctx->ring_info;
+	struct aio_ring	*ring;
+	struct io_event	*event;
+	unsigned long	tail;
+
+	ring = kmap_atomic(info->ring_pages[0], KM_IRQ1);
+
+	tail = info->tail;
+	event = aio_ring_event(info, tail, KM_IRQ0);
+	if (++tail >= info->nr)
+		tail = 0;
+
+	event->obj = (u64)(unsigned long)obj;
+	event->data = data;
+	event->res = res;
+	event->res2 = res2;
+
+	dprintk("aio_ring_add_event: %p[%lu]: %p %Lx %lx %lx\n",
+		ctx, tail, obj, data, res, res2);
+
+	smp_wmb();	/* make event visible before updating tail */
+
+	info->tail = tail;
+	ring->tail = tail;
+
+	put_aio_ring_event(event, KM_IRQ0);
+	kunmap_atomic(ring, KM_IRQ1);
+}
+
 /* aio_complete
  *	Called when the io request on the given iocb is complete.
  *	Returns true if this is the last user of the request.  The 
@@ -912,11 +1082,7 @@ EXPORT_SYMBOL(kick_iocb);
 int aio_complete(struct kiocb *iocb, long res, long res2)
 {
 	struct kioctx	*ctx = iocb->ki_ctx;
-	struct aio_ring_info	*info;
-	struct aio_ring	*ring;
-	struct io_event	*event;
 	unsigned long	flags;
-	unsigned long	tail;
 	int		ret;
 
 	/*
@@ -934,8 +1100,6 @@ int aio_complete(struct kiocb *iocb, long res, long res2)
 		return 1;
 	}
 
-	info = &ctx->ring_info;
-
 	/* add a completion event to the ring buffer.
 	 * must be done holding ctx->ctx_lock to prevent
 	 * other code from messing with the tail
@@ -954,34 +1118,10 @@ int aio_complete(struct kiocb *iocb, long res, long res2)
 	if (kiocbIsCancelled(iocb))
 		goto put_rq;
 
-	ring = kmap_atomic(info->ring_pages[0], KM_IRQ1);
-
-	tail = info->tail;
-	event = aio_ring_event(info, tail, KM_IRQ0);
-	if (++tail >= info->nr)
-		tail = 0;
-
-	event->obj = (u64)(unsigned long)iocb->ki_obj.user;
-	event->data = iocb->ki_user_data;
-	event->res = res;
-	event->res2 = res2;
+	aio_ring_add_event(ctx, iocb->ki_obj.user, iocb->ki_user_data,
+			   res, res2);
 
-	dprintk("aio_complete: %p[%lu]: %p: %p %Lx %lx %lx\n",
-		ctx, tail, iocb, iocb->ki_obj.user, iocb->ki_user_data,
-		res, res2);
-
-	/* after flagging the request as done, we
-	 * must never even look at it again
-	 */
-	smp_wmb();	/* make event visible before updating tail */
-
-	info->tail = tail;
-	ring->tail = tail;
-
-	put_aio_ring_event(event, KM_IRQ0);
-	kunmap_atomic(ring, KM_IRQ1);
-
-	pr_debug("added to ring %p at [%lu]\n", iocb, tail);
+	pr_debug("added to ring %p\n", iocb);
 
 	/*
 	 * Check if the user asked us to deliver the result through an
@@ -1011,45 +1151,96 @@ put_rq:
 }
 EXPORT_SYMBOL(aio_complete);
 
-/* aio_read_evt
- *	Pull an event off of the ioctx's event ring.  Returns the number of 
- *	events fetched (0 or 1 ;-)
- *	FIXME: make this use cmpxchg.
- *	TODO: make the ringbuffer user mmap()able (requires FIXME).
+/* aio_events_available
+ *	Cheap unlocked check for completed events waiting in the ring.
  */
-static int aio_read_evt(struct kioctx *ioctx, struct io_event *ent)
+static int aio_events_available(struct kioctx *ioctx)
 {
 	struct aio_ring_info *info = &ioctx->ring_info;
 	struct aio_ring *ring;
-	unsigned long head;
-	int ret = 0;
+	int ret;
 
 	ring = kmap_atomic(info->ring_pages[0], KM_USER0);
-	dprintk("in aio_read_evt h%lu t%lu m%lu\n",
-		 (unsigned long)ring->head, (unsigned long)ring->tail,
-		 (unsigned long)ring->nr);
+	ret = ring->head % info->nr != info->tail;
+	kunmap_atomic(ring, KM_USER0);
+	return ret;
+}
 
-	if (ring->head == ring->tail)
-		goto out;
+/* aio_read_events_ring
+ *	Pull up to nr events off of the ioctx's event ring and copy them
+ *	straight to the user's buffer, taking ring_lock once for the whole
+ *	batch.  Returns the number of events fetched, or -EFAULT if none
+ *	could be copied; events that were not copied stay in the ring.
+ *
+ *	The ring is mapped into the process as well, and userspace may
+ *	consume events itself by reading ring->tail, reading the events
+ *	and then advancing ring->head, without entering the kernel.  The
+ *	head is therefore never trusted beyond the ring size here, and the
+ *	tail is taken from the kernel's private copy.
+ */
+static long aio_read_events_ring(struct kioctx *ioctx,
+				 struct io_event __user *event, long nr)
+{
+	struct aio_ring_info *info = &ioctx->ring_info;
+	struct aio_ring *ring;
+	unsigned head, tail;
+	long ret = 0;
 
-	spin_lock(&info->ring_lock);
+	mutex_lock(&info->ring_lock);
 
+	ring = kmap_atomic(info->ring_pages[0], KM_USER0);
 	head = ring->head % info->nr;
-	if (head != ring->tail) {
-		struct io_event *evp = aio_ring_event(info, head, KM_USER1);
-		*ent = *evp;
-		head = (head + 1) % info->nr;
-		smp_mb(); /* finish reading the event before updatng the head */
+	kunmap_atomic(ring, KM_USER0);
+
+	tail = info->tail;
+	smp_rmb(); /* read the tail before the events it covers */
+
+	dprintk("in aio_read_events_ring h%u t%u m%u\n",
+		head, tail, info->nr);
+
+	while (ret < nr && head != tail) {
+		struct io_event *ev;
+		struct page *page;
+		unsigned pos;
+		long avail, copy_ret;
+
+		avail = (head <= tail ? tail : info->nr) - head;
+		avail = min(avail, nr - ret);
+
+		/* Copy at most up to the end of the ring page */
+		pos = head + AIO_EVENTS_OFFSET;
+		avail = min_t(long, avail,
+			      AIO_EVENTS_PER_PAGE - pos % AIO_EVENTS_PER_PAGE);
+
+		page = info->ring_pages[pos / AIO_EVENTS_PER_PAGE];
+		ev = kmap(page);
+		copy_ret = copy_to_user(event + ret,
+					ev + pos % AIO_EVENTS_PER_PAGE,
+					sizeof(*ev) * avail);
+		kunmap(page);
+
+		if (unlikely(copy_ret)) {
+			dprintk("aio: EFAULT copying events out\n");
+			if (!ret)
+				ret = -EFAULT;
+			break;
+		}
+
+		ret += avail;
+		head = (head + avail) % info->nr;
+	}
+
+	if (ret > 0) {
+		smp_mb(); /* finish reading the events before updating the head */
+		ring = kmap_atomic(info->ring_pages[0], KM_USER0);
 		ring->head = head;
-		ret = 1;
-		put_aio_ring_event(evp, KM_USER1);
+		kunmap_atomic(ring, KM_USER0);
 	}
-	spin_unlock(&info->ring_lock);
 
-out:
-	kunmap_atomic(ring, KM_USER0);
-	dprintk("leaving aio_read_evt: %d  h%lu t%lu\n", ret,
-		 (unsigned long)ring->head, (unsigned long)ring->tail);
+	mutex_unlock(&info->ring_lock);
+
+	dprintk("leaving aio_read_events_ring: %ld h%u t%u\n",
+		ret, head, tail);
 	return ret;
 }
 
@@ -1097,37 +1288,19 @@ static int read_events(struct kioctx *ctx,
 	long			start_jiffies = jiffies;
 	struct task_struct	*tsk = current;
 	DECLARE_WAITQUEUE(wait, tsk);
-	int			ret;
+	long			ret;
 	int			i = 0;
-	struct io_event		ent;
 	struct aio_timeout	to;
 	int			retry = 0;
 
-	/* needed to zero any padding within an entry (there shouldn't be 
-	 * any, but C is fun!
-	 */
-	memset(&ent, 0, sizeof(ent));
 retry:
 	ret = 0;
-	while (likely(i < nr)) {
-		ret = aio_read_evt(ctx, &ent);
-		if (unlikely(ret <= 0))
-			break;
-
-		dprintk("read event: %Lx %Lx %Lx %Lx\n",
-			ent.data, ent.obj, ent.res, ent.res2);
-
-		/* Could we split the check in two? */
-		ret = -EFAULT;
-		if (unlikely(copy_to_user(event, &ent, sizeof(ent)))) {
-			dprintk("aio: lost an event due to EFAULT.\n");
-			break;
+	if (likely(i < nr)) {
+		ret = aio_read_events_ring(ctx, event + i, nr - i);
+		if (likely(ret > 0)) {
+			i += ret;
+			ret = 0;
 		}
-		ret = 0;
-
-		/* Good, event copied to userland, update counts. */
-		event ++;
-		i ++;
 	}
 
 	if (min_nr <= i)
@@ -1158,7 +1331,7 @@ retry:
 		add_wait_queue_exclusive(&ctx->wait, &wait);
 		do {
 			set_task_state(tsk, TASK_INTERRUPTIBLE);
-			ret = aio_read_evt(ctx, &ent);
+			ret = aio_events_available(ctx);
 			if (ret)
 				break;
 			if (min_nr <= i)
@@ -1179,7 +1352,6 @@ retry:
 				ret = -EINTR;
 				break;
 			}
-			/*ret = aio_read_evt(ctx, &ent);*/
 		} while (1) ;
 
 		set_task_state(tsk, TASK_RUNNING);
@@ -1188,15 +1360,14 @@ retry:
 		if (unlikely(ret <= 0))
 			break;
 
-		ret = -EFAULT;
-		if (unlikely(copy_to_user(event, &ent, sizeof(ent)))) {
-			dprintk("aio: lost an event due to EFAULT.\n");
+		/*
+		 * Another reader may beat us to the events, in which case
+		 * we simply go back to sleep.
+		 */
+		ret = aio_read_events_ring(ctx, event + i, nr - i);
+		if (unlikely(ret < 0))
 			break;
-		}
-
-		/* Good, event copied to userland, update counts. */
-		event ++;
-		i ++;
+		i += ret;
 	}
 
 	if (timeout)
@@ -1249,25 +1420,38 @@ static void io_destroy(struct kioctx *ioctx)
  *	resources are available.  May fail with -EFAULT if an invalid
  *	pointer is passed for ctxp.  Will fail with -ENOSYS if not
  *	implemented.
+ *
+ *	nr_events may have IOCTX_FLAG_* bits or'ed in.  With
+ *	IOCTX_FLAG_SQ_RING, *ctxp instead holds the address of a struct
+ *	aio_sq_ring the caller has allocated, and iocbs queued on it are
+ *	submitted by io_submit(ctx, nr, NULL).  Kernels without submission
+ *	rings fail such a call with -EINVAL.
  */
 SYSCALL_DEFINE2(io_setup, unsigned, nr_events, aio_context_t __user *, ctxp)
 {
 	struct kioctx *ioctx = NULL;
 	unsigned long ctx;
+	unsigned flags;
 	long ret;
 
 	ret = get_user(ctx, ctxp);
 	if (unlikely(ret))
 		goto out;
 
+	flags = nr_events & IOCTX_FLAG_MASK;
+	nr_events &= ~IOCTX_FLAG_MASK;
+
 	ret = -EINVAL;
-	if (unlikely(ctx || nr_events == 0)) {
-		pr_debug("EINVAL: io_setup: ctx %lu nr_events %u\n",
-		         ctx, nr_events);
+	if (unlikely(nr_events == 0 ||
+		     !ctx != !(flags & IOCTX_FLAG_SQ_RING) ||
+		     ((flags & IOCTX_FLAG_POLLED) && !ctx))) {
+		pr_debug("EINVAL: io_setup: ctx %lu nr_events %u flags %x\n",
+		         ctx, nr_events, flags);
 		goto out;
 	}
 
-	ioctx = ioctx_alloc(nr_events);
+	ioctx = ioctx_alloc(nr_events, flags,
+			    (struct aio_sq_ring __user *)ctx);
 	ret = PTR_ERR(ioctx);
 	if (!IS_ERR(ioctx)) {
 		ret = put_user(ioctx->user_id, ctxp);
@@ -1582,7 +1766,8 @@ static void aio_batch_free(struct hlist_head *batch_hash)
 }
 
 static int io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
-			 struct iocb *iocb, struct hlist_head *batch_hash)
+			 struct iocb *iocb, struct hlist_head *batch_hash,
+			 struct kiocb_batch *batch)
 {
 	struct kiocb *req;
 	struct file *file;
@@ -1608,7 +1793,7 @@ static int io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
 	if (unlikely(!file))
 		return -EBADF;
 
-	req = aio_get_req(ctx);		/* returns with 2 references to req */
+	req = aio_get_req(ctx, batch);	/* returns with 2 references to req */
 	if (unlikely(!req)) {
 		fput(file);
 		return -EAGAIN;
@@ -1673,6 +1858,102 @@ out_put_req:
 	return ret;
 }
 
+/* aio_fail_sq_iocb
+ *	Report an iocb from the submission ring that could not be submitted
+ *	by posting res as its completion event, the way an io_submit
+ *	caller would have seen the error.  Takes a request from @batch only
+ *	to reserve room for the event in the completion ring.  Returns
+ *	-EAGAIN if there is no room.
+ */
+static int aio_fail_sq_iocb(struct kioctx *ctx, struct kiocb_batch *batch,
+			    struct iocb __user *user_iocb, u64 data, long res)
+{
+	struct kiocb *req;
+
+	batch->count++;		/* one more request than was planned for */
+	req = aio_get_req(ctx, batch);
+	if (unlikely(!req))
+		return -EAGAIN;
+
+	spin_lock_irq(&ctx->ctx_lock);
+	aio_ring_add_event(ctx, user_iocb, data, res, 0);
+	list_del(&req->ki_list);
+	really_put_req(ctx, req);
+
+	/* see aio_complete() */
+	smp_mb();
+	if (waitqueue_active(&ctx->wait))
+		wake_up(&ctx->wait);
+	spin_unlock_irq(&ctx->ctx_lock);
+	return 0;
+}
+
+/* aio_submit_sq_ring
+ *	Submit up to nr iocbs that userspace has queued on the context's
+ *	submission ring.  Only the kernel moves head, so an iocb that
+ *	fails to submit cannot be left on the ring: it is consumed and its
+ *	error is posted as its completion event instead.  Stops early only
+ *	when the completion ring has no room (-EAGAIN), leaving the rest
+ *	for a later call.  Returns the number of iocbs consumed.
+ */
+static long aio_submit_sq_ring(struct kioctx *ctx, unsigned nr)
+{
+	struct aio_sq_info *sq = &ctx->sq_info;
+	struct aio_sq_ring __user *ring;
+	struct kiocb_batch batch;
+	struct hlist_head batch_hash[AIO_BATCH_HASH_SIZE] = { { 0, }, };
+	unsigned head, tail, i = 0;
+	long ret = 0;
+
+	ring = sq->ring;
+
+	mutex_lock(&sq->lock);
+	if (unlikely(get_user(tail, &ring->tail))) {
+		ret = -EFAULT;
+		goto out;
+	}
+	/* Read the iocbs only after the tail that published them. */
+	smp_rmb();
+
+	head = sq->head;
+	if (unlikely(tail - head > sq->nr)) {
+		ret = -EINVAL;
+		goto out;
+	}
+	nr = min(nr, tail - head);
+
+	kiocb_batch_init(&batch, nr);
+	for (i = 0; i < nr; i++) {
+		struct iocb __user *user_iocb;
+		struct iocb tmp;
+
+		user_iocb = &ring->iocbs[(head + i) & (sq->nr - 1)];
+		if (unlikely(copy_from_user(&tmp, user_iocb, sizeof(tmp)))) {
+			tmp.aio_data = 0;
+			ret = -EFAULT;
+		} else
+			ret = io_submit_one(ctx, user_iocb, &tmp, batch_hash,
+					    &batch);
+		if (unlikely(ret && ret != -EAGAIN))
+			ret = aio_fail_sq_iocb(ctx, &batch, user_iocb,
+					       tmp.aio_data, ret);
+		if (ret)
+			break;
+	}
+	aio_batch_free(batch_hash);
+	kiocb_batch_free(ctx, &batch);
+
+	if (i) {
+		sq->head = head + i;
+		/* Userspace may reuse the slots as soon as it sees head. */
+		smp_mb();
+		put_user(sq->head, &ring->head);
+	}
+out:
+	mutex_unlock(&sq->lock);
+	return i ? i : ret;
+}
+
 /* sys_io_submit:
  *	Queue the nr iocbs pointed to by iocbpp for processing.  Returns
  *	the number of iocbs queued.  May return -EINVAL if the aio_context
@@ -1684,6 +1965,9 @@ out_put_req:
  *	iocb is invalid.  May fail with -EAGAIN if insufficient resources
  *	are available to queue any iocbs.  Will return 0 if nr is 0.  Will
  *	fail with -ENOSYS if not implemented.
+ *
+ *	For a context with a submission ring, a NULL iocbpp submits up to
+ *	nr iocbs from the ring instead; see aio_submit_sq_ring().
  */
 SYSCALL_DEFINE3(io_submit, aio_context_t, ctx_id, long, nr,
 		struct iocb __user * __user *, iocbpp)
@@ -1691,6 +1975,7 @@ SYSCALL_DEFINE3(io_submit, aio_context_t, ctx_id, long, nr,
 	struct kioctx *ctx;
 	long ret = 0;
 	int i;
+	struct kiocb_batch batch;
 
 	struct hlist_head batch_hash[AIO_BATCH_HASH_SIZE] = { { 0, }, };
 
@@ -1706,6 +1991,14 @@ SYSCALL_DEFINE3(io_submit, aio_context_t, ctx_id, long, nr,
 		return -EINVAL;
 	}
 
+	if (!iocbpp && nr && ctx->sq_info.nr) {
+		ret = aio_submit_sq_ring(ctx, min_t(long, nr, UINT_MAX));
+		put_ioctx(ctx);
+		return ret;
+	}
+
+	kiocb_batch_init(&batch, nr);
+
 	/*
 	 * AKPM: should this return a partial result if some of the IOs were
 	 * successfully submitted?
@@ -1724,16 +2017,97 @@ SYSCALL_DEFINE3(io_submit, aio_context_t, ctx_id, long, nr,
 			break;
 		}
 
-		ret = io_submit_one(ctx, user_iocb, &tmp, batch_hash);
+		ret = io_submit_one(ctx, user_iocb, &tmp, batch_hash, &batch);
 		if (ret)
 			break;
 	}
 	aio_batch_free(batch_hash);
+	kiocb_batch_free(ctx, &batch);
 
 	put_ioctx(ctx);
 	return i ? i : ret;
 }
 
+/* aio_ring_events
+ *	Number of completed events in the ring that userspace has not
+ *	reaped yet.  Unlocked, like aio_events_available.
+ */
+static unsigned aio_ring_events(struct kioctx *ctx)
+{
+	struct aio_ring_info *info = &ctx->ring_info;
+	struct aio_ring *ring;
+	unsigned head;
+
+	ring = kmap_atomic(info->ring_pages[0], KM_USER0);
+	head = ring->head % info->nr;
+	kunmap_atomic(ring, KM_USER0);
+
+	return (info->tail + info->nr - head) % info->nr;
+}
+
+/* aio_wait_ring_events
+ *	Wait until at least min_nr events are in the completion ring of a
+ *	context with a submission ring, leaving them there for userspace
+ *	to reap.  Polled contexts spin on the ring instead of sleeping,
+ *	trading CPU for the wakeup latency; retries are run inline while
+ *	spinning.  Returns the number of events in the ring, which is
+ *	less than min_nr if the timeout expired.
+ */
+static long aio_wait_ring_events(struct kioctx *ctx, long min_nr,
+				 struct timespec __user *timeout)
+{
+	long			start_jiffies = jiffies;
+	int			polled = ctx->flags & IOCTX_FLAG_POLLED;
+	struct aio_timeout	to;
+	DEFINE_WAIT(wait);
+	long			ret = 0;
+
+	if (unlikely(min_nr >= ctx->ring_info.nr))
+		return -EINVAL;
+
+	init_timeout(&to);
+	if (timeout) {
+		struct timespec	ts;
+		ret = -EFAULT;
+		if (unlikely(copy_from_user(&ts, timeout, sizeof(ts))))
+			goto out;
+		ret = 0;
+
+		set_timeout(start_jiffies, &to, &ts);
+	}
+
+	for (;;) {
+		if (!polled)
+			prepare_to_wait(&ctx->wait, &wait, TASK_INTERRUPTIBLE);
+		if (aio_ring_events(ctx) >= min_nr)
+			break;
+		if (unlikely(ctx->dead)) {
+			ret = -EINVAL;
+			break;
+		}
+		if (to.timed_out)
+			break;
+		if (signal_pending(current)) {
+			ret = -EINTR;
+			break;
+		}
+		if (polled) {
+			if (!list_empty(&ctx->run_list))
+				aio_run_all_iocbs(ctx);
+			cond_resched();
+			cpu_relax();
+		} else
+			io_schedule();
+	}
+	finish_wait(&ctx->wait, &wait);
+
+	if (timeout)
+		clear_timeout(&to);
+out:
+	destroy_timer_on_stack(&to.timer);
+	return ret ? ret : aio_ring_events(ctx);
+}
+
 /* lookup_kiocb
  *	Finds a given iocb for cancellation.
  */
@@ -1824,6 +2198,10 @@ SYSCALL_DEFINE3(io_cancel, aio_context_t, ctx_id, struct iocb __user *, iocb,
  *	timeout.  Note that the timeout pointed to by when is relative and
  *	will be updated if not NULL and the operation blocks.  Will fail
  *	with -ENOSYS if not implemented.
+ *
+ *	For a context with a submission ring, a NULL events only waits for
+ *	min_nr events to be in the completion ring, for userspace to reap
+ *	from there, and returns how many are; see aio_wait_ring_events().
  */
 SYSCALL_DEFINE5(io_getevents, aio_context_t, ctx_id,
 		long, min_nr,
@@ -1835,8 +2213,14 @@ SYSCALL_DEFINE5(io_getevents, aio_context_t, ctx_id,
 	long ret = -EINVAL;
 
 	if (likely(ioctx)) {
-		if (likely(min_nr <= nr && min_nr >= 0 && nr >= 0))
-			ret = read_events(ioctx, min_nr, nr, events, timeout);
+		if (likely(min_nr <= nr && min_nr >= 0 && nr >= 0)) {
+			if (!events && ioctx->sq_info.nr)
+				ret = aio_wait_ring_events(ioctx, min_nr,
+							   timeout);
+			else
+				ret = read_events(ioctx, min_nr, nr, events,
+						  timeout);
+		}
 		put_ioctx(ioctx);
 	}
 
@@ -532,6 +532,17 @@ compat_sys_io_setup(unsigned nr_reqs, u32 __user *ctx32p)
 	if (unlikely(get_user(ctx64, ctx32p)))
 		return -EFAULT;
 
+	/*
+	 * With IOCTX_FLAG_SQ_RING, ctx64 is the submission ring, which
+	 * sys_io_setup() writes to.  Check it here, as it will not be
+	 * checked under KERNEL_DS.
+	 */
+	if (ctx64 && (nr_reqs & IOCTX_FLAG_SQ_RING) &&
+	    unlikely(!access_ok(VERIFY_WRITE, compat_ptr(ctx64),
+				sizeof(struct aio_sq_ring) +
+				sizeof(struct iocb) * AIO_SQ_RING_MAX)))
+		return -EFAULT;
+
 	set_fs(KERNEL_DS);
 	/* The __user pointer cast is valid because of the set_fs() */
 	ret = sys_io_setup(nr_reqs, (aio_context_t __user *) &ctx64);
@@ -596,6 +607,10 @@ compat_sys_io_submit(aio_context_t ctx_id, int nr, u32 __user *iocb)
 	if (unlikely(nr < 0))
 		return -EINVAL;
 
+	/* submit from the context's submission ring */
+	if (!iocb)
+		return sys_io_submit(ctx_id, nr, NULL);
+
 	if (nr > MAX_AIO_SUBMITS)
 		nr = MAX_AIO_SUBMITS;
 	
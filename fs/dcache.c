@@ -106,7 +106,9 @@ static void dentry_iput(struct dentry * dentry)
 {
 	struct inode *inode = dentry->d_inode;
 	if (inode) {
+		write_seqcount_begin(&dentry->d_seq);
 		dentry->d_inode = NULL;
+		write_seqcount_end(&dentry->d_seq);
 		list_del_init(&dentry->d_alias);
 		spin_unlock(&dentry->d_lock);
 		spin_unlock(&dcache_lock);
@@ -942,6 +944,7 @@ struct dentry *d_alloc(struct dentry * parent, const struct qstr *name)
 	atomic_set(&dentry->d_count, 1);
 	dentry->d_flags = DCACHE_UNHASHED;
 	spin_lock_init(&dentry->d_lock);
+	seqcount_init(&dentry->d_seq);
 	dentry->d_inode = NULL;
 	dentry->d_parent = NULL;
 	dentry->d_sb = NULL;
@@ -1444,6 +1447,61 @@ out:
 	return dentry;
 }
 
+/**
+ * __d_lookup_rcu - search for a dentry without taking references
+ * @parent: parent dentry
+ * @name: qstr of name we wish to find
+ * @seqp: returns the d_seq of the dentry found
+ *
+ * This is the lookup used by the lockless path walk.  It takes neither
+ * d_lock nor a reference on the dentry it returns, so the caller must hold
+ * rcu_read_lock() and use read_seqcount_retry() on *@seqp to make sure the
+ * dentry was not renamed or unhashed under it before trusting the result.
+ * Parents with a ->d_compare operation are not supported, the name is
+ * compared byte by byte.
+ */
+struct dentry *__d_lookup_rcu(struct dentry *parent, struct qstr *name,
+			      unsigned *seqp)
+{
+	unsigned int len = name->len;
+	unsigned int hash = name->hash;
+	const unsigned char *str = name->name;
+	struct hlist_head *head = d_hash(parent, hash);
+	struct hlist_node *node;
+	struct dentry *dentry;
+
+	hlist_for_each_entry_rcu(dentry, node, head, d_hash) {
+		const unsigned char *tname;
+		unsigned int tlen;
+		unsigned seq;
+
+		if (dentry->d_name.hash != hash)
+			continue;
+seqretry:
+		seq = read_seqcount_begin(&dentry->d_seq);
+		if (dentry->d_parent != parent)
+			continue;
+		if (d_unhashed(dentry))
+			continue;
+		tlen = dentry->d_name.len;
+		tname = dentry->d_name.name;
+		if (read_seqcount_retry(&dentry->d_seq, seq)) {
+			cpu_relax();
+			goto seqretry;
+		}
+		/*
+		 * The name cannot be freed before the end of the RCU read
+		 * side, but it may change under us.  The caller will notice
+		 * that through d_seq.
+		 */
+		if (tlen != len || memcmp(tname, str, len))
+			continue;
+		*seqp = seq;
+		return dentry;
+	}
+	return NULL;
+}
+
 /**
  * d_validate - verify dentry provided from insecure source
  * @dentry: The dentry alleged to be valid child of @dparent
@@ -1647,6 +1705,8 @@ static void d_move_locked(struct dentry * dentry, struct dentry * target)
 		spin_lock_nested(&target->d_lock, DENTRY_D_LOCK_NESTED);
 	}
 
+	write_seqcount_begin(&dentry->d_seq);
+
 	/* Move the dentry to the target hash queue, if on different bucket */
 	if (d_unhashed(dentry))
 		goto already_unhashed;
@@ -1660,6 +1720,8 @@ already_unhashed:
 	/* Unhash the target: dput() will then get rid of it */
 	__d_drop(target);
 
+	write_seqcount_begin(&target->d_seq);
+
 	list_del(&dentry->d_u.d_child);
 	list_del(&target->d_u.d_child);
 
@@ -1680,6 +1742,8 @@ already_unhashed:
 	}
 
 	list_add(&dentry->d_u.d_child, &dentry->d_parent->d_subdirs);
+	write_seqcount_end(&target->d_seq);
+	write_seqcount_end(&dentry->d_seq);
 	spin_unlock(&target->d_lock);
 	fsnotify_d_move(dentry);
 	spin_unlock(&dentry->d_lock);
@@ -1773,6 +1837,9 @@ static void __d_materialise_dentry(struct dentry *dentry, struct dentry *anon)
 {
 	struct dentry *dparent, *aparent;
 
+	write_seqcount_begin(&dentry->d_seq);
+	write_seqcount_begin(&anon->d_seq);
+
 	switch_names(dentry, anon);
 	swap(dentry->d_name.hash, anon->d_name.hash);
 
@@ -1793,6 +1860,9 @@ static void __d_materialise_dentry(struct dentry *dentry, struct dentry *anon)
 	else
 		INIT_LIST_HEAD(&anon->d_u.d_child);
 
+	write_seqcount_end(&anon->d_seq);
+	write_seqcount_end(&dentry->d_seq);
+
 	anon->d_flags &= ~DCACHE_DISCONNECTED;
 }
 
@@ -72,7 +72,11 @@
  */
 
 /* Epoll private bits inside the event mask */
-#define EP_PRIVATE_BITS (EPOLLONESHOT | EPOLLET)
+#define EP_PRIVATE_BITS (EPOLLONESHOT | EPOLLET | EPOLLEXCLUSIVE)
+
+/* The only events EPOLLEXCLUSIVE can be combined with */
+#define EPOLLEXCLUSIVE_OK_BITS (EPOLLEXCLUSIVE | POLLIN | POLLOUT | \
+				POLLERR | POLLHUP | EPOLLET)
 
 /* Maximum number of nesting allowed inside epoll sets */
 #define EP_MAX_NESTS 4
@@ -86,6 +90,12 @@
 
 #define EP_ITEM_COST (sizeof(struct epitem) + sizeof(struct eppoll_entry))
 
+/*
+ * Number of events ep_send_events() copies to userspace at once.  The
+ * batch lives on the ep_poll() stack, so keep it small.
+ */
+#define EP_SEND_BATCH 8
+
 struct epoll_filefd {
 	struct file *file;
 	int fd;
@@ -214,6 +224,13 @@ struct ep_pqueue {
 struct ep_send_events_data {
 	int maxevents;
 	struct epoll_event __user *events;
+
+	/* Events gathered for the next copy to userspace */
+	int nbatch;
+	struct epitem *batch_epi[EP_SEND_BATCH];
+	/* Event masks of the items before they were reported */
+	__u32 batch_mask[EP_SEND_BATCH];
+	struct epoll_event batch[EP_SEND_BATCH];
 };
 
 /*
@@ -788,7 +805,7 @@ static struct epitem *ep_find(struct eventpoll *ep, struct file *file, int fd)
  */
 static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *key)
 {
-	int pwake = 0;
+	int pwake = 0, ewake = 0;
 	unsigned long flags;
 	struct epitem *epi = ep_item_from_wait(wait);
 	struct eventpoll *ep = epi->ep;
@@ -824,6 +841,8 @@ static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *k
 			epi->next = ep->ovflist;
 			ep->ovflist = epi;
 		}
+		/* Someone is transferring events right now and will see it */
+		ewake = 1;
 		goto out_unlock;
 	}
 
@@ -835,8 +854,10 @@ static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *k
 	 * Wake up ( if active ) both the eventpoll wait list and the ->poll()
 	 * wait list.
 	 */
-	if (waitqueue_active(&ep->wq))
+	if (waitqueue_active(&ep->wq)) {
+		ewake = 1;
 		wake_up_locked(&ep->wq);
+	}
 	if (waitqueue_active(&ep->poll_wait))
 		pwake++;
 
@@ -847,6 +868,15 @@ out_unlock:
 	if (pwake)
 		ep_poll_safewake(&ep->poll_wait);
 
+	/*
+	 * Our wait queue entry is exclusive for EPOLLEXCLUSIVE items, and
+	 * a non-zero return stops the wakeup there.  Only claim the event
+	 * if it actually woke up (or will be picked up by) a waiter, so
+	 * that it is passed on to the next epoll instance otherwise.
+	 */
+	if (epi->event.events & EPOLLEXCLUSIVE)
+		return ewake;
+
 	return 1;
 }
 
@@ -864,7 +894,10 @@ static void ep_ptable_queue_proc(struct file *file, wait_queue_head_t *whead,
 		init_waitqueue_func_entry(&pwq->wait, ep_poll_callback);
 		pwq->whead = whead;
 		pwq->base = epi;
-		add_wait_queue(whead, &pwq->wait);
+		if (epi->event.events & EPOLLEXCLUSIVE)
+			add_wait_queue_exclusive(whead, &pwq->wait);
+		else
+			add_wait_queue(whead, &pwq->wait);
 		list_add_tail(&pwq->llink, &epi->pwqlist);
 		epi->nwait++;
 	} else {
@@ -1043,22 +1076,49 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi, struct epoll_even
 	return 0;
 }
 
+/*
+ * Copy the events gathered by ep_send_events_proc() to userspace in one
+ * go.  Should that fault, the items are put back at the head of @head
+ * with their event masks restored, as if they had never been looked at.
+ */
+static int ep_send_events_flush(struct list_head *head,
+				struct ep_send_events_data *esed)
+{
+	int i, n = esed->nbatch;
+
+	esed->nbatch = 0;
+	if (!__copy_to_user(esed->events, esed->batch,
+			    n * sizeof(struct epoll_event))) {
+		esed->events += n;
+		return n;
+	}
+
+	for (i = n - 1; i >= 0; i--) {
+		struct epitem *epi = esed->batch_epi[i];
+
+		epi->event.events = esed->batch_mask[i];
+		list_del_init(&epi->rdllink);
+		list_add(&epi->rdllink, head);
+	}
+	return -EFAULT;
+}
+
 static int ep_send_events_proc(struct eventpoll *ep, struct list_head *head,
 			       void *priv)
 {
 	struct ep_send_events_data *esed = priv;
-	int eventcnt;
+	int eventcnt, res;
 	unsigned int revents;
 	struct epitem *epi;
-	struct epoll_event __user *uevent;
 
 	/*
 	 * We can loop without lock because we are passed a task private list.
 	 * Items cannot vanish during the loop because ep_scan_ready_list() is
-	 * holding "mtx" during this call.
+	 * holding "mtx" during this call.  Ready events are gathered in
+	 * esed->batch and copied to userspace EP_SEND_BATCH at a time.
 	 */
-	for (eventcnt = 0, uevent = esed->events;
-	     !list_empty(head) && eventcnt < esed->maxevents;) {
+	for (eventcnt = 0; !list_empty(head) &&
+	     eventcnt + esed->nbatch < esed->maxevents;) {
 		epi = list_first_entry(head, struct epitem, rdllink);
 
 		list_del_init(&epi->rdllink);
@@ -1073,13 +1133,17 @@ static int ep_send_events_proc(struct eventpoll *ep, struct list_head *head,
 		 * can change the item.
 		 */
 		if (revents) {
-			if (__put_user(revents, &uevent->events) ||
-			    __put_user(epi->event.data, &uevent->data)) {
-				list_add(&epi->rdllink, head);
-				return eventcnt ? eventcnt : -EFAULT;
-			}
-			eventcnt++;
-			uevent++;
+			int i = esed->nbatch++;
+
+			esed->batch_epi[i] = epi;
+			esed->batch_mask[i] = epi->event.events;
+			/*
+			 * struct epoll_event has a hole after .events where
+			 * it is not packed (ARM EABI): don't leak the stack.
+			 */
+			memset(&esed->batch[i], 0, sizeof(esed->batch[i]));
+			esed->batch[i].events = revents;
+			esed->batch[i].data = epi->event.data;
 			if (epi->event.events & EPOLLONESHOT)
 				epi->event.events &= EP_PRIVATE_BITS;
 			else if (!(epi->event.events & EPOLLET)) {
@@ -1096,9 +1160,23 @@ static int ep_send_events_proc(struct eventpoll *ep, struct list_head *head,
 				 */
 				list_add_tail(&epi->rdllink, &ep->rdllist);
 			}
+
+			if (esed->nbatch == EP_SEND_BATCH) {
+				res = ep_send_events_flush(head, esed);
+				if (res < 0)
+					return eventcnt ? eventcnt : res;
+				eventcnt += res;
+			}
 		}
 	}
 
+	if (esed->nbatch) {
+		res = ep_send_events_flush(head, esed);
+		if (res < 0)
+			return eventcnt ? eventcnt : res;
+		eventcnt += res;
+	}
+
 	return eventcnt;
 }
 
@@ -1109,6 +1187,7 @@ static int ep_send_events(struct eventpoll *ep,
 
 	esed.maxevents = maxevents;
 	esed.events = events;
+	esed.nbatch = 0;
 
 	return ep_scan_ready_list(ep, ep_send_events_proc, &esed);
 }
@@ -1265,6 +1344,18 @@ SYSCALL_DEFINE4(epoll_ctl, int, epfd, int, op, int, fd,
 	if (file == tfile || !is_file_epoll(file))
 		goto error_tgt_fput;
 
+	/*
+	 * EPOLLEXCLUSIVE is only meaningful on EPOLL_CTL_ADD, together with
+	 * plain wakeup events, and not for nested epoll files.
+	 */
+	if (ep_op_has_event(op) && (epds.events & EPOLLEXCLUSIVE)) {
+		if (op == EPOLL_CTL_MOD)
+			goto error_tgt_fput;
+		if (is_file_epoll(tfile) ||
+		    (epds.events & ~EPOLLEXCLUSIVE_OK_BITS))
+			goto error_tgt_fput;
+	}
+
 	/*
 	 * At this point it is safe to assume that the "private_data" contains
 	 * our own data structure.
@@ -1297,8 +1388,11 @@ SYSCALL_DEFINE4(epoll_ctl, int, epfd, int, op, int, fd,
 		break;
 	case EPOLL_CTL_MOD:
 		if (epi) {
-			epds.events |= POLLERR | POLLHUP;
-			error = ep_modify(ep, epi, &epds);
+			/* Exclusive items cannot be modified, only removed */
+			if (!(epi->event.events & EPOLLEXCLUSIVE)) {
+				epds.events |= POLLERR | POLLHUP;
+				error = ep_modify(ep, epi, &epds);
+			}
 		} else
 			error = -ENOENT;
 		break;
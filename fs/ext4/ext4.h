@@ -863,10 +863,12 @@ struct ext4_inode_info {
 #define EXT4_MOUNT_JOURNAL_CHECKSUM	0x800000 /* Journal checksums */
 #define EXT4_MOUNT_JOURNAL_ASYNC_COMMIT	0x1000000 /* Journal Async Commit */
 #define EXT4_MOUNT_I_VERSION            0x2000000 /* i_version support */
+#define EXT4_MOUNT_FAST_COMMIT		0x4000000 /* Fast commits for fsync */
 #define EXT4_MOUNT_DELALLOC		0x8000000 /* Delalloc support */
 #define EXT4_MOUNT_DATA_ERR_ABORT	0x10000000 /* Abort on file data write */
 #define EXT4_MOUNT_BLOCK_VALIDITY	0x20000000 /* Block validity checking */
 #define EXT4_MOUNT_DISCARD		0x40000000 /* Issue DISCARD requests */
+#define EXT4_MOUNT_INIT_INODE_TABLE	0x80000000 /* Zero inode tables lazily */
 
 #define clear_opt(o, opt)		o &= ~EXT4_MOUNT_##opt
 #define set_opt(o, opt)			o |= EXT4_MOUNT_##opt
@@ -1051,6 +1053,7 @@ struct ext4_sb_info {
 	unsigned long s_commit_interval;
 	u32 s_max_batch_time;
 	u32 s_min_batch_time;
+	tid_t s_fc_ineligible_tid;	/* last tid with non-inode changes */
 	struct block_device *journal_bdev;
 #ifdef CONFIG_JBD2_DEBUG
 	struct timer_list turn_ro_timer;	/* For turning read-only (crash simulation) */
@@ -1091,11 +1094,16 @@ struct ext4_sb_info {
 	unsigned int s_mb_stats;
 	unsigned int s_mb_order2_reqs;
 	unsigned int s_mb_group_prealloc;
+	unsigned int s_mb_optimize_scan;
 	unsigned int s_max_writeback_mb_bump;
 	/* where last allocation was done - for stream allocation */
 	unsigned long s_mb_last_group;
 	unsigned long s_mb_last_start;
 
+	/* groups indexed by the order of their largest free extent */
+	struct list_head *s_mb_largest_free_orders;
+	rwlock_t *s_mb_largest_free_orders_locks;
+
 	/* stats for buddy allocator */
 	spinlock_t s_mb_pa_lock;
 	atomic_t s_bal_reqs;	/* number of reqs with len > 1 */
@@ -1105,6 +1113,10 @@ struct ext4_sb_info {
 	atomic_t s_bal_goals;	/* goal hits */
 	atomic_t s_bal_breaks;	/* too long searches */
 	atomic_t s_bal_2orders;	/* 2^order hits */
+	atomic_t s_bal_allocs;	/* allocations through the group scan */
+	atomic_t s_bal_groups_considered;	/* groups checked */
+	atomic_t s_bal_groups_scanned;	/* groups whose buddy was scanned */
+	atomic_t s_bal_order_list_hits;	/* cr 0 served from order lists */
 	spinlock_t s_bal_lock;
 	unsigned long s_mb_buddies_generated;
 	unsigned long long s_mb_generation_time;
@@ -1128,6 +1140,13 @@ struct ext4_sb_info {
 
 	/* record the last minlen when FITRIM is called. */
 	atomic_t s_last_trim_minblks;
+
+	/* lazy inode table initialisation */
+	struct task_struct *s_li_task;
+	unsigned int s_li_wait_mult;	/* sleep this many times the zeroing time */
+	unsigned int s_li_remaining;	/* groups still to be zeroed */
+	unsigned int s_li_msecs;	/* time the thread has spent so far */
+	unsigned int s_mount_msecs;	/* time ext4_fill_super() took */
 };
 
 static inline struct ext4_sb_info *EXT4_SB(struct super_block *sb)
@@ -1286,6 +1305,12 @@ EXT4_INODE_BIT_FNS(state, state_flags)
 
 #define EXT4_DEF_INODE_READAHEAD_BLKS	32
 
+/*
+ * Default multiplier of the time spent zeroing a group's inode table that
+ * the lazy init thread sleeps before moving on to the next group
+ */
+#define EXT4_DEF_LI_WAIT_MULT	10
+
 /*
  * Default mount options
  */
@@ -1523,6 +1548,7 @@ extern unsigned ext4_init_inode_bitmap(struct super_block *sb,
 				       ext4_group_t group,
 				       struct ext4_group_desc *desc);
 extern void mark_bitmap_end(int start_bit, int end_bit, char *bitmap);
+extern int ext4_init_inode_table(struct super_block *sb, ext4_group_t group);
 
 /* mballoc.c */
 extern long ext4_mb_stats;
@@ -1787,7 +1813,10 @@ struct ext4_group_info {
 	ext4_grpblk_t	bb_free;	/* total free blocks */
 	ext4_grpblk_t	bb_fragments;	/* nr of freespace fragments */
 	ext4_grpblk_t	bb_largest_free_order;/* order of largest frag in BG */
+	ext4_group_t	bb_group;	/* group number */
 	struct          list_head bb_prealloc_list;
+	struct          list_head bb_largest_free_order_node; /* on
+					 * s_mb_largest_free_orders[order] */
 #ifdef DOUBLE_CHECK
 	void            *bb_bitmap;
 #endif
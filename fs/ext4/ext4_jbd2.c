@@ -6,12 +6,25 @@
 
 #include <trace/events/ext4.h>
 
+/*
+ * Any journalled change other than to an inode's own on-disk copy makes
+ * the transaction ineligible for a fast commit.
+ */
+static void ext4_fc_mark_ineligible(handle_t *handle)
+{
+	transaction_t *transaction = handle->h_transaction;
+	struct super_block *sb = transaction->t_journal->j_private;
+
+	EXT4_SB(sb)->s_fc_ineligible_tid = transaction->t_tid;
+}
+
 int __ext4_journal_get_undo_access(const char *where, handle_t *handle,
 				struct buffer_head *bh)
 {
 	int err = 0;
 
 	if (ext4_handle_valid(handle)) {
+		ext4_fc_mark_ineligible(handle);
 		err = jbd2_journal_get_undo_access(handle, bh);
 		if (err)
 			ext4_journal_abort_handle(where, __func__, bh,
@@ -20,7 +33,12 @@ int __ext4_journal_get_undo_access(const char *where, handle_t *handle,
 	return err;
 }
 
-int __ext4_journal_get_write_access(const char *where, handle_t *handle,
+/*
+ * Get write access to an inode table block on behalf of a single inode;
+ * unlike other metadata this leaves the transaction eligible for a fast
+ * commit.
+ */
+int __ext4_journal_get_inode_access(const char *where, handle_t *handle,
 				struct buffer_head *bh)
 {
 	int err = 0;
@@ -34,6 +52,14 @@ int __ext4_journal_get_write_access(const char *where, handle_t *handle,
 	return err;
 }
 
+int __ext4_journal_get_write_access(const char *where, handle_t *handle,
+				struct buffer_head *bh)
+{
+	if (ext4_handle_valid(handle))
+		ext4_fc_mark_ineligible(handle);
+	return __ext4_journal_get_inode_access(where, handle, bh);
+}
+
 /*
  * The ext4 forget function must perform a revoke if we are freeing data
  * which has been journaled.  Metadata (eg. indirect blocks) must be
@@ -66,6 +92,7 @@ int __ext4_forget(const char *where, handle_t *handle, int is_metadata,
 		bforget(bh);
 		return 0;
 	}
+	ext4_fc_mark_ineligible(handle);
 
 	/* Never use the revoke function if we are doing full data
 	 * journaling: there is no need to, and a V1 superblock won't
@@ -105,6 +132,7 @@ int __ext4_journal_get_create_access(const char *where,
 	int err = 0;
 
 	if (ext4_handle_valid(handle)) {
+		ext4_fc_mark_ineligible(handle);
 		err = jbd2_journal_get_create_access(handle, bh);
 		if (err)
 			ext4_journal_abort_handle(where, __func__, bh,
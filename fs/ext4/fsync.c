@@ -57,6 +57,40 @@ static void ext4_sync_parent(struct inode *inode)
 	}
 }
 
+/*
+ * If the transaction holding the inode's last change has changed nothing
+ * but inodes, make the inode durable by logging its on-disk copy in a
+ * fast commit instead of committing the whole transaction.  Returns
+ * non-zero if the caller has to commit normally.
+ */
+static int ext4_fc_sync_inode(struct inode *inode, tid_t commit_tid)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+	journal_t *journal = sbi->s_journal;
+	struct ext4_iloc iloc;
+	int err;
+
+	if (sbi->s_fc_ineligible_tid == commit_tid)
+		return -EAGAIN;
+
+	err = jbd2_fc_begin_commit(journal, commit_tid);
+	if (err)
+		return err;
+
+	/* Updates are locked out now, so the check above can be trusted */
+	if (sbi->s_fc_ineligible_tid == commit_tid)
+		err = -EAGAIN;
+	else
+		err = ext4_get_inode_loc(inode, &iloc);
+	if (!err) {
+		err = jbd2_fc_add_patch(journal, iloc.bh->b_blocknr,
+					iloc.offset, ext4_raw_inode(&iloc),
+					EXT4_INODE_SIZE(inode->i_sb));
+		brelse(iloc.bh);
+	}
+	return jbd2_fc_end_commit(journal, err);
+}
+
 /*
  * akpm: A new design for ext4_sync_file().
  *
@@ -115,6 +149,9 @@ int ext4_sync_file(struct file *file, struct dentry *dentry, int datasync)
 		return ext4_force_commit(inode->i_sb);
 
 	commit_tid = datasync ? ei->i_datasync_tid : ei->i_sync_tid;
+	if (test_opt(inode->i_sb, FAST_COMMIT) &&
+	    !ext4_fc_sync_inode(inode, commit_tid))
+		return ret;
 	if (jbd2_log_start_commit(journal, commit_tid))
 		jbd2_log_wait_commit(journal, commit_tid);
 	else if (journal->j_flags & JBD2_BARRIER)
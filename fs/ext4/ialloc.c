@@ -775,6 +775,29 @@ err_ret:
 	return retval;
 }
 
+/*
+ * While the lazy init thread is zeroing a group's inode table it holds
+ * the group's alloc_sem, so an inode can't be claimed in a range it is
+ * about to zero.  Returns non-zero if the inode was claimed.
+ */
+static int ext4_claim_inode_zeroed(struct super_block *sb,
+			struct buffer_head *inode_bitmap_bh,
+			unsigned long ino, ext4_group_t group, int mode)
+{
+	struct ext4_group_desc *gdp = ext4_get_group_desc(sb, group, NULL);
+	struct ext4_group_info *grp;
+	int ret;
+
+	if (gdp->bg_flags & cpu_to_le16(EXT4_BG_INODE_ZEROED))
+		return !ext4_claim_inode(sb, inode_bitmap_bh, ino, group, mode);
+
+	grp = ext4_get_group_info(sb, group);
+	down_read(&grp->alloc_sem);
+	ret = !ext4_claim_inode(sb, inode_bitmap_bh, ino, group, mode);
+	up_read(&grp->alloc_sem);
+	return ret;
+}
+
 /*
  * There are two policies for allocating an inode.  If the new inode is
  * a directory, then a forward search is made for a block group with both
@@ -885,8 +908,8 @@ repeat_in_this_group:
 								group_desc_bh);
 			if (err)
 				goto fail;
-			if (!ext4_claim_inode(sb, inode_bitmap_bh,
-						ino, group, mode)) {
+			if (ext4_claim_inode_zeroed(sb, inode_bitmap_bh,
+						    ino, group, mode)) {
 				/* we won it */
 				BUFFER_TRACE(inode_bitmap_bh,
 					"call ext4_handle_dirty_metadata");
@@ -1209,3 +1232,99 @@ unsigned long ext4_count_dirs(struct super_block * sb)
 	}
 	return count;
 }
+
+/* Number of inode table blocks zeroed and written out at a time */
+#define EXT4_LI_BATCH	32
+
+/*
+ * Number of leading inode table blocks which may hold inodes: the rest
+ * has never been handed out and bg_itable_unused tells where it starts.
+ */
+static unsigned long ext4_itable_used_blocks(struct super_block *sb,
+					     struct ext4_group_desc *gdp)
+{
+	if (gdp->bg_flags & cpu_to_le16(EXT4_BG_INODE_UNINIT))
+		return 0;
+	return DIV_ROUND_UP(EXT4_INODES_PER_GROUP(sb) -
+			    ext4_itable_unused_count(sb, gdp),
+			    EXT4_SB(sb)->s_inodes_per_block);
+}
+
+/**
+ * ext4_init_inode_table() - zero the unused part of a group's inode table
+ * @sb:		super block
+ * @group:	group to initialise
+ *
+ * mke2fs can leave inode tables uninitialised on uninit_bg filesystems.
+ * Zero the blocks past the ones which may hold inodes, a batch at a time
+ * so that inode allocation in the group is never held off for long, then
+ * flag the group EXT4_BG_INODE_ZEROED.  Called from the lazy init thread.
+ */
+int ext4_init_inode_table(struct super_block *sb, ext4_group_t group)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_group_info *grp = ext4_get_group_info(sb, group);
+	struct buffer_head *bhs[EXT4_LI_BATCH];
+	struct buffer_head *group_desc_bh;
+	struct ext4_group_desc *gdp;
+	ext4_fsblk_t itable;
+	unsigned long blk, used;
+	handle_t *handle;
+	int i, n, err = 0;
+
+	gdp = ext4_get_group_desc(sb, group, &group_desc_bh);
+	if (!gdp)
+		return -EIO;
+	if (gdp->bg_flags & cpu_to_le16(EXT4_BG_INODE_ZEROED))
+		return 0;
+
+	itable = ext4_inode_table(sb, gdp);
+	for (blk = 0; blk < sbi->s_itb_per_group; blk += n) {
+		down_write(&grp->alloc_sem);
+		used = ext4_itable_used_blocks(sb, gdp);
+		if (blk < used)
+			blk = used;
+		n = min_t(unsigned long, EXT4_LI_BATCH,
+			  sbi->s_itb_per_group - min(blk, sbi->s_itb_per_group));
+		for (i = 0; i < n; i++) {
+			bhs[i] = sb_getblk(sb, itable + blk + i);
+			if (!bhs[i]) {
+				err = -ENOMEM;
+				n = i;
+				break;
+			}
+			lock_buffer(bhs[i]);
+			memset(bhs[i]->b_data, 0, sb->s_blocksize);
+			set_buffer_uptodate(bhs[i]);
+			unlock_buffer(bhs[i]);
+			mark_buffer_dirty(bhs[i]);
+		}
+		ll_rw_block(WRITE, n, bhs);
+		for (i = 0; i < n; i++) {
+			wait_on_buffer(bhs[i]);
+			if (buffer_write_io_error(bhs[i]))
+				err = -EIO;
+			brelse(bhs[i]);
+		}
+		up_write(&grp->alloc_sem);
+		if (err || !n)
+			break;
+	}
+	if (err)
+		return err;
+
+	handle = ext4_journal_start_sb(sb, 1);
+	if (IS_ERR(handle))
+		return PTR_ERR(handle);
+	BUFFER_TRACE(group_desc_bh, "get_write_access");
+	err = ext4_journal_get_write_access(handle, group_desc_bh);
+	if (!err) {
+		ext4_lock_group(sb, group);
+		gdp->bg_flags |= cpu_to_le16(EXT4_BG_INODE_ZEROED);
+		gdp->bg_checksum = ext4_group_desc_csum(sbi, group, gdp);
+		ext4_unlock_group(sb, group);
+		err = ext4_handle_dirty_metadata(handle, NULL, group_desc_bh);
+	}
+	i = ext4_journal_stop(handle);
+	return err ? err : i;
+}
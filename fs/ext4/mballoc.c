@@ -662,23 +662,43 @@ static void ext4_mb_mark_free_simple(struct super_block *sb,
 
 /*
  * Cache the order of the largest free extent we have available in this block
- * group.
+ * group, and keep the group on the s_mb_largest_free_orders list for that
+ * order.  A group is on a list iff bb_largest_free_order >= 0.
+ *
+ * Called with the group locked.
  */
 static void
 mb_set_largest_free_order(struct super_block *sb, struct ext4_group_info *grp)
 {
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
 	int i;
 	int bits;
-
-	grp->bb_largest_free_order = -1; /* uninit */
+	int old = grp->bb_largest_free_order;
+	int new = -1; /* uninit */
 
 	bits = sb->s_blocksize_bits + 1;
 	for (i = bits; i >= 0; i--) {
 		if (grp->bb_counters[i] > 0) {
-			grp->bb_largest_free_order = i;
+			new = i;
 			break;
 		}
 	}
+
+	if (new == old)
+		return;
+
+	if (old >= 0) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[old]);
+		list_del_init(&grp->bb_largest_free_order_node);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[old]);
+	}
+	grp->bb_largest_free_order = new;
+	if (new >= 0) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[new]);
+		list_add_tail(&grp->bb_largest_free_order_node,
+			      &sbi->s_mb_largest_free_orders[new]);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[new]);
+	}
 }
 
 static noinline_for_stack
@@ -1861,12 +1881,22 @@ void ext4_mb_scan_aligned(struct ext4_allocation_context *ac,
 	}
 }
 
+/* Avoid using the first bg of a flexgroup for data files */
+static inline int ext4_mb_skip_flex_group(struct ext4_allocation_context *ac,
+					  ext4_group_t group)
+{
+	int flex_size = ext4_flex_bg_size(EXT4_SB(ac->ac_sb));
+
+	return (ac->ac_flags & EXT4_MB_HINT_DATA) &&
+		(flex_size >= EXT4_FLEX_SIZE_DIR_ALLOC_SCHEME) &&
+		((group % flex_size) == 0);
+}
+
 /* This is now called BEFORE we load the buddy bitmap. */
 static int ext4_mb_good_group(struct ext4_allocation_context *ac,
 				ext4_group_t group, int cr)
 {
 	unsigned free, fragments;
-	int flex_size = ext4_flex_bg_size(EXT4_SB(ac->ac_sb));
 	struct ext4_group_info *grp = ext4_get_group_info(ac->ac_sb, group);
 
 	BUG_ON(cr < 0 || cr >= 4);
@@ -1892,10 +1922,7 @@ static int ext4_mb_good_group(struct ext4_allocation_context *ac,
 		if (grp->bb_largest_free_order < ac->ac_2order)
 			return 0;
 
-		/* Avoid using the first bg of a flexgroup for data files */
-		if ((ac->ac_flags & EXT4_MB_HINT_DATA) &&
-		    (flex_size >= EXT4_FLEX_SIZE_DIR_ALLOC_SCHEME) &&
-		    ((group % flex_size) == 0))
+		if (ext4_mb_skip_flex_group(ac, group))
 			return 0;
 
 		return 1;
@@ -1994,6 +2021,142 @@ void ext4_mb_put_buddy_cache_lock(struct super_block *sb,
 
 }
 
+/*
+ * Check a group without its buddy, and if it looks good, load the buddy and
+ * scan it under the group lock.
+ */
+static int ext4_mb_scan_group(struct ext4_allocation_context *ac,
+			      ext4_group_t group, int cr,
+			      struct ext4_buddy *e4b)
+{
+	struct super_block *sb = ac->ac_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int err;
+
+	ac->ac_groups_considered++;
+
+	/* This now checks without needing the buddy page */
+	if (!ext4_mb_good_group(ac, group, cr))
+		return 0;
+
+	err = ext4_mb_load_buddy(sb, group, e4b);
+	if (err)
+		return err;
+
+	ext4_lock_group(sb, group);
+
+	/*
+	 * We need to check again after locking the
+	 * block group
+	 */
+	if (!ext4_mb_good_group(ac, group, cr)) {
+		ext4_unlock_group(sb, group);
+		ext4_mb_unload_buddy(e4b);
+		return 0;
+	}
+
+	ac->ac_groups_scanned++;
+	if (cr == 0)
+		ext4_mb_simple_scan_group(ac, e4b);
+	else if (cr == 1 && ac->ac_g_ex.fe_len == sbi->s_stripe)
+		ext4_mb_scan_aligned(ac, e4b);
+	else
+		ext4_mb_complex_scan_group(ac, e4b);
+
+	ext4_unlock_group(sb, group);
+	ext4_mb_unload_buddy(e4b);
+	return 0;
+}
+
+/*
+ * Take up to MB_ORDER_LIST_BATCH candidate groups off the head of an order
+ * list, rotating each group visited to the tail so that the next batch, and
+ * the next allocation, start from groups not tried yet.  *first is the first
+ * group this scan visited; meeting it again means the list has wrapped, and
+ * *budget bounds the scan in case that group has since left the list, and
+ * is cleared once the list has wrapped or is empty, so the caller stops
+ * when it reaches zero.  Returns the number of groups copied to @groups.
+ */
+static int ext4_mb_order_list_batch(struct ext4_allocation_context *ac,
+				    int order, ext4_group_t ngroups,
+				    ext4_group_t *groups,
+				    struct ext4_group_info **first,
+				    ext4_group_t *budget)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(ac->ac_sb);
+	struct list_head *head = &sbi->s_mb_largest_free_orders[order];
+	struct ext4_group_info *grp;
+	int n = 0;
+
+	write_lock(&sbi->s_mb_largest_free_orders_locks[order]);
+	while (n < MB_ORDER_LIST_BATCH && *budget && !list_empty(head)) {
+		grp = list_first_entry(head, struct ext4_group_info,
+				       bb_largest_free_order_node);
+		if (grp == *first) {
+			*budget = 0;
+			break;
+		}
+		if (!*first)
+			*first = grp;
+		list_move_tail(&grp->bb_largest_free_order_node, head);
+		(*budget)--;
+
+		if (grp->bb_group >= ngroups ||
+		    ext4_mb_skip_flex_group(ac, grp->bb_group))
+			continue;
+		groups[n++] = grp->bb_group;
+	}
+	/* nothing (left) to rotate through: the caller is done with @order */
+	if (list_empty(head))
+		*budget = 0;
+	write_unlock(&sbi->s_mb_largest_free_orders_locks[order]);
+	return n;
+}
+
+/*
+ * cr 0 without walking every group: take groups from the lists of groups
+ * whose largest free extent is at least 2^ac_2order, smallest order first
+ * so that big extents are kept for requests that need them.  Each list is
+ * walked in batches until it has been gone through once; the lists are
+ * only locked while a batch of group numbers is copied out, and the
+ * candidates are then checked with ext4_mb_good_group() like in the linear
+ * scan.  Groups which were never initialized are not on any list; they are
+ * picked up by the linear scan at cr 1.
+ */
+static noinline_for_stack int
+ext4_mb_scan_order_lists(struct ext4_allocation_context *ac,
+			 ext4_group_t ngroups, struct ext4_buddy *e4b)
+{
+	struct super_block *sb = ac->ac_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	ext4_group_t groups[MB_ORDER_LIST_BATCH];
+	struct ext4_group_info *first;
+	ext4_group_t budget;
+	int order, n, i, err;
+
+	for (order = ac->ac_2order; order <= sb->s_blocksize_bits + 1;
+	     order++) {
+		first = NULL;
+		budget = ngroups;
+		do {
+			n = ext4_mb_order_list_batch(ac, order, ngroups,
+						     groups, &first, &budget);
+			for (i = 0; i < n; i++) {
+				err = ext4_mb_scan_group(ac, groups[i], 0, e4b);
+				if (err)
+					return err;
+				if (ac->ac_status != AC_STATUS_CONTINUE) {
+					if (sbi->s_mb_stats)
+						atomic_inc(&sbi->s_bal_order_list_hits);
+					return 0;
+				}
+			}
+			cond_resched();
+		} while (budget);
+	}
+	return 0;
+}
+
 static noinline_for_stack int
 ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 {
@@ -2068,42 +2231,26 @@ repeat:
 		 */
 		group = ac->ac_g_ex.fe_group;
 
+		if (cr == 0 && sbi->s_mb_optimize_scan) {
+			/* The goal group first, to keep locality */
+			err = ext4_mb_scan_group(ac, group < ngroups ?
+						 group : 0, cr, &e4b);
+			if (!err && ac->ac_status == AC_STATUS_CONTINUE)
+				err = ext4_mb_scan_order_lists(ac, ngroups,
+							       &e4b);
+			if (err)
+				goto out;
+			continue;
+		}
+
 		for (i = 0; i < ngroups; group++, i++) {
 			if (group == ngroups)
 				group = 0;
 
-			/* This now checks without needing the buddy page */
-			if (!ext4_mb_good_group(ac, group, cr))
-				continue;
-
-			err = ext4_mb_load_buddy(sb, group, &e4b);
+			err = ext4_mb_scan_group(ac, group, cr, &e4b);
 			if (err)
 				goto out;
 
-			ext4_lock_group(sb, group);
-
-			/*
-			 * We need to check again after locking the
-			 * block group
-			 */
-			if (!ext4_mb_good_group(ac, group, cr)) {
-				ext4_unlock_group(sb, group);
-				ext4_mb_unload_buddy(&e4b);
-				continue;
-			}
-
-			ac->ac_groups_scanned++;
-			if (cr == 0)
-				ext4_mb_simple_scan_group(ac, &e4b);
-			else if (cr == 1 &&
-					ac->ac_g_ex.fe_len == sbi->s_stripe)
-				ext4_mb_scan_aligned(ac, &e4b);
-			else
-				ext4_mb_complex_scan_group(ac, &e4b);
-
-			ext4_unlock_group(sb, group);
-			ext4_mb_unload_buddy(&e4b);
-
 			if (ac->ac_status != AC_STATUS_CONTINUE)
 				break;
 		}
@@ -2174,6 +2321,20 @@ static int ext4_mb_seq_groups_show(struct seq_file *seq, void *v)
 	} sg;
 
 	group--;
+	if (group == 0 && EXT4_SB(sb)->s_mb_stats) {
+		struct ext4_sb_info *sbi = EXT4_SB(sb);
+		unsigned allocs = atomic_read(&sbi->s_bal_allocs);
+		unsigned scanned = atomic_read(&sbi->s_bal_groups_scanned);
+		unsigned considered =
+			atomic_read(&sbi->s_bal_groups_considered);
+		unsigned avg = allocs ? scanned * 100ULL / allocs : 0;
+
+		seq_printf(seq, "# %u allocations, %u groups considered, "
+			   "%u groups scanned (%u.%02u per allocation), "
+			   "%u from order lists\n", allocs, considered,
+			   scanned, avg / 100, avg % 100,
+			   atomic_read(&sbi->s_bal_order_list_hits));
+	}
 	if (group == 0)
 		seq_printf(seq, "#%-5s: %-5s %-5s %-5s "
 				"[ %-5s %-5s %-5s %-5s %-5s %-5s %-5s "
@@ -2297,7 +2458,9 @@ int ext4_mb_add_groupinfo(struct super_block *sb, ext4_group_t group,
 	}
 
 	INIT_LIST_HEAD(&meta_group_info[i]->bb_prealloc_list);
+	INIT_LIST_HEAD(&meta_group_info[i]->bb_largest_free_order_node);
 	init_rwsem(&meta_group_info[i]->alloc_sem);
+	meta_group_info[i]->bb_group = group;
 
 	meta_group_info[i]->bb_free_root = RB_ROOT;
 	meta_group_info[i]->bb_largest_free_order = -1;  /* uninit */
@@ -2441,13 +2604,25 @@ int ext4_mb_init(struct super_block *sb, int needs_recovery)
 		i++;
 	} while (i <= sb->s_blocksize_bits + 1);
 
+	i = sb->s_blocksize_bits + 2;
+	sbi->s_mb_largest_free_orders =
+		kmalloc(i * sizeof(struct list_head), GFP_KERNEL);
+	sbi->s_mb_largest_free_orders_locks =
+		kmalloc(i * sizeof(rwlock_t), GFP_KERNEL);
+	if (sbi->s_mb_largest_free_orders == NULL ||
+	    sbi->s_mb_largest_free_orders_locks == NULL) {
+		ret = -ENOMEM;
+		goto out_free_orders;
+	}
+	while (i-- > 0) {
+		INIT_LIST_HEAD(&sbi->s_mb_largest_free_orders[i]);
+		rwlock_init(&sbi->s_mb_largest_free_orders_locks[i]);
+	}
+
 	/* init file for buddy data */
 	ret = ext4_mb_init_backend(sb);
-	if (ret != 0) {
-		kfree(sbi->s_mb_offsets);
-		kfree(sbi->s_mb_maxs);
-		return ret;
-	}
+	if (ret != 0)
+		goto out_free_orders;
 
 	spin_lock_init(&sbi->s_md_lock);
 	spin_lock_init(&sbi->s_bal_lock);
@@ -2458,12 +2633,12 @@ int ext4_mb_init(struct super_block *sb, int needs_recovery)
 	sbi->s_mb_stream_request = MB_DEFAULT_STREAM_THRESHOLD;
 	sbi->s_mb_order2_reqs = MB_DEFAULT_ORDER2_REQS;
 	sbi->s_mb_group_prealloc = MB_DEFAULT_GROUP_PREALLOC;
+	sbi->s_mb_optimize_scan = MB_DEFAULT_OPTIMIZE_SCAN;
 
 	sbi->s_locality_groups = alloc_percpu(struct ext4_locality_group);
 	if (sbi->s_locality_groups == NULL) {
-		kfree(sbi->s_mb_offsets);
-		kfree(sbi->s_mb_maxs);
-		return -ENOMEM;
+		ret = -ENOMEM;
+		goto out_free_orders;
 	}
 	for_each_possible_cpu(i) {
 		struct ext4_locality_group *lg;
@@ -2481,6 +2656,13 @@ int ext4_mb_init(struct super_block *sb, int needs_recovery)
 	if (sbi->s_journal)
 		sbi->s_journal->j_commit_callback = release_blocks_on_commit;
 	return 0;
+
+out_free_orders:
+	kfree(sbi->s_mb_largest_free_orders);
+	kfree(sbi->s_mb_largest_free_orders_locks);
+	kfree(sbi->s_mb_offsets);
+	kfree(sbi->s_mb_maxs);
+	return ret;
 }
 
 /* need to called with the ext4 group lock held */
@@ -2529,6 +2711,8 @@ int ext4_mb_release(struct super_block *sb)
 	}
 	kfree(sbi->s_mb_offsets);
 	kfree(sbi->s_mb_maxs);
+	kfree(sbi->s_mb_largest_free_orders);
+	kfree(sbi->s_mb_largest_free_orders_locks);
 	if (sbi->s_buddy_cache)
 		iput(sbi->s_buddy_cache);
 	if (sbi->s_mb_stats) {
@@ -2545,6 +2729,13 @@ int ext4_mb_release(struct super_block *sb)
 				atomic_read(&sbi->s_bal_2orders),
 				atomic_read(&sbi->s_bal_breaks),
 				atomic_read(&sbi->s_mb_lost_chunks));
+		printk(KERN_INFO
+		       "EXT4-fs: mballoc: %u allocations scanned %u groups "
+				"(%u considered), %u from order lists\n",
+				atomic_read(&sbi->s_bal_allocs),
+				atomic_read(&sbi->s_bal_groups_scanned),
+				atomic_read(&sbi->s_bal_groups_considered),
+				atomic_read(&sbi->s_bal_order_list_hits));
 		printk(KERN_INFO
 		       "EXT4-fs: mballoc: %lu generated and it took %Lu\n",
 				sbi->s_mb_buddies_generated++,
@@ -3047,6 +3238,12 @@ static void ext4_mb_collect_stats(struct ext4_allocation_context *ac)
 {
 	struct ext4_sb_info *sbi = EXT4_SB(ac->ac_sb);
 
+	if (sbi->s_mb_stats && ac->ac_groups_considered) {
+		atomic_inc(&sbi->s_bal_allocs);
+		atomic_add(ac->ac_groups_considered,
+			   &sbi->s_bal_groups_considered);
+		atomic_add(ac->ac_groups_scanned, &sbi->s_bal_groups_scanned);
+	}
 	if (sbi->s_mb_stats && ac->ac_g_ex.fe_len > 1) {
 		atomic_inc(&sbi->s_bal_reqs);
 		atomic_add(ac->ac_b_ex.fe_len, &sbi->s_bal_allocated);
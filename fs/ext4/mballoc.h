@@ -89,6 +89,18 @@ extern u8 mb_enable_debug;
  */
 #define MB_DEFAULT_ORDER2_REQS		2
 
+/*
+ * pick cr 0 groups from the per-order lists of groups rather than by
+ * scanning all groups from the goal
+ */
+#define MB_DEFAULT_OPTIMIZE_SCAN	1
+
+/*
+ * how many groups to take off an order list at a time; the list is rotated
+ * past them so the next batch starts where this one stopped
+ */
+#define MB_ORDER_LIST_BATCH		8
+
 /*
  * default group prealloc size 512 blocks
  */
@@ -181,6 +193,7 @@ struct ext4_allocation_context {
 	/* number of iterations done. we have to track to limit searching */
 	unsigned long ac_ex_scanned;
 	__u16 ac_groups_scanned;
+	__u16 ac_groups_considered;
 	__u16 ac_found;
 	__u16 ac_tail;
 	__u16 ac_buddy;
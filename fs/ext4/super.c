@@ -40,6 +40,8 @@
 #include <linux/log2.h>
 #include <linux/crc16.h>
 #include <linux/cleancache.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
 #include <asm/uaccess.h>
 
 #include "ext4.h"
@@ -78,7 +80,7 @@ static struct file_system_type ext3_fs_type = {
 	.name		= "ext3",
 	.get_sb		= ext4_get_sb,
 	.kill_sb	= kill_block_super,
-	.fs_flags	= FS_REQUIRES_DEV,
+	.fs_flags	= FS_REQUIRES_DEV | FS_RCU_INODES,
 };
 #define IS_EXT3_SB(sb) ((sb)->s_bdev->bd_holder == &ext3_fs_type)
 #else
@@ -641,12 +643,113 @@ static void dump_orphan_list(struct super_block *sb, struct ext4_sb_info *sbi)
 	}
 }
 
+/*
+ * The lazy init thread zeroes the inode tables mke2fs left uninitialised,
+ * one group at a time, so that a freshly made filesystem can be used right
+ * away.  After each group it sleeps s_li_wait_mult times as long as the
+ * zeroing took, leaving most of the disk time to everything else.
+ */
+static int ext4_lazyinit_thread(void *data)
+{
+	struct super_block *sb = data;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	ext4_group_t group, ngroups = ext4_get_groups_count(sb);
+	unsigned long start = jiffies;
+	int err = 0;
+
+	set_freezable();
+	for (group = 0; group < ngroups; group++) {
+		struct ext4_group_desc *gdp;
+		unsigned long t;
+
+		if (kthread_should_stop())
+			return 0;
+		gdp = ext4_get_group_desc(sb, group, NULL);
+		if (!gdp || gdp->bg_flags & cpu_to_le16(EXT4_BG_INODE_ZEROED))
+			continue;
+
+		vfs_check_frozen(sb, SB_FREEZE_WRITE);
+		t = jiffies;
+		err = ext4_init_inode_table(sb, group);
+		if (err)
+			break;
+		sbi->s_li_remaining--;
+		t = (jiffies - t) * sbi->s_li_wait_mult;
+		if (t && !kthread_should_stop())
+			schedule_timeout_interruptible(t);
+		try_to_freeze();
+		sbi->s_li_msecs = jiffies_to_msecs(jiffies - start);
+	}
+
+	if (err)
+		ext4_msg(sb, KERN_ERR, "lazy inode table init stopped at "
+			 "group %u (%d)", group, err);
+	else
+		ext4_msg(sb, KERN_INFO, "inode tables initialised in %u ms",
+			 sbi->s_li_msecs);
+	return 0;
+}
+
+/*
+ * Start zeroing inode tables in the background if there is anything left
+ * to zero.  The thread exits by itself once done, so we hold a reference
+ * to be able to kthread_stop() it at any time.
+ */
+static void ext4_start_lazyinit_thread(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	ext4_group_t group, ngroups = ext4_get_groups_count(sb);
+	struct task_struct *task;
+	unsigned int remaining = 0;
+
+	if (sbi->s_li_task || !test_opt(sb, INIT_INODE_TABLE) ||
+	    (sb->s_flags & MS_RDONLY) ||
+	    !EXT4_HAS_RO_COMPAT_FEATURE(sb, EXT4_FEATURE_RO_COMPAT_GDT_CSUM))
+		return;
+
+	for (group = 0; group < ngroups; group++) {
+		struct ext4_group_desc *gdp = ext4_get_group_desc(sb, group,
+								  NULL);
+
+		if (gdp && !(gdp->bg_flags &
+			     cpu_to_le16(EXT4_BG_INODE_ZEROED)))
+			remaining++;
+	}
+	sbi->s_li_remaining = remaining;
+	sbi->s_li_msecs = 0;
+	if (!remaining)
+		return;
+
+	task = kthread_create(ext4_lazyinit_thread, sb, "ext4lazyinit/%s",
+			      sb->s_id);
+	if (IS_ERR(task)) {
+		ext4_msg(sb, KERN_WARNING, "unable to start lazy inode table "
+			 "init thread (%ld)", PTR_ERR(task));
+		return;
+	}
+	get_task_struct(task);
+	sbi->s_li_task = task;
+	wake_up_process(task);
+}
+
+static void ext4_stop_lazyinit_thread(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+
+	if (!sbi->s_li_task)
+		return;
+	kthread_stop(sbi->s_li_task);
+	put_task_struct(sbi->s_li_task);
+	sbi->s_li_task = NULL;
+}
+
 static void ext4_put_super(struct super_block *sb)
 {
 	struct ext4_sb_info *sbi = EXT4_SB(sb);
 	struct ext4_super_block *es = sbi->s_es;
 	int i, err;
 
+	ext4_stop_lazyinit_thread(sb);
 	flush_workqueue(sbi->dio_unwritten_wq);
 	destroy_workqueue(sbi->dio_unwritten_wq);
 
@@ -769,6 +872,12 @@ static struct inode *ext4_alloc_inode(struct super_block *sb)
 	return &ei->vfs_inode;
 }
 
+static void ext4_i_callback(struct rcu_head *head)
+{
+	struct inode *inode = container_of(head, struct inode, i_rcu);
+	kmem_cache_free(ext4_inode_cachep, EXT4_I(inode));
+}
+
 static void ext4_destroy_inode(struct inode *inode)
 {
 	if (!list_empty(&(EXT4_I(inode)->i_orphan))) {
@@ -780,7 +889,7 @@ static void ext4_destroy_inode(struct inode *inode)
 				true);
 		dump_stack();
 	}
-	kmem_cache_free(ext4_inode_cachep, EXT4_I(inode));
+	call_rcu(&inode->i_rcu, ext4_i_callback);
 }
 
 static void init_once(void *foo)
@@ -809,6 +918,8 @@ static int init_inodecache(void)
 
 static void destroy_inodecache(void)
 {
+	/* Wait for inodes still waiting to be freed by ext4_i_callback */
+	rcu_barrier();
 	kmem_cache_destroy(ext4_inode_cachep);
 }
 
@@ -978,6 +1089,14 @@ static int ext4_show_options(struct seq_file *seq, struct vfsmount *vfs)
 	if (test_opt(sb, DISCARD))
 		seq_puts(seq, ",discard");
 
+	if (test_opt(sb, FAST_COMMIT))
+		seq_puts(seq, ",fast_commit");
+
+	if (!test_opt(sb, INIT_INODE_TABLE))
+		seq_puts(seq, ",noinit_itable");
+	else if (sbi->s_li_wait_mult != EXT4_DEF_LI_WAIT_MULT)
+		seq_printf(seq, ",init_itable=%u", sbi->s_li_wait_mult);
+
 	if (test_opt(sb, NOLOAD))
 		seq_puts(seq, ",norecovery");
 
@@ -1168,7 +1287,8 @@ enum {
 	Opt_block_validity, Opt_noblock_validity,
 	Opt_inode_readahead_blks, Opt_journal_ioprio,
 	Opt_dioread_nolock, Opt_dioread_lock,
-	Opt_discard, Opt_nodiscard,
+	Opt_discard, Opt_nodiscard, Opt_fast_commit,
+	Opt_init_itable, Opt_noinit_itable,
 };
 
 static const match_table_t tokens = {
@@ -1239,6 +1359,10 @@ static const match_table_t tokens = {
 	{Opt_dioread_lock, "dioread_lock"},
 	{Opt_discard, "discard"},
 	{Opt_nodiscard, "nodiscard"},
+	{Opt_fast_commit, "fast_commit"},
+	{Opt_init_itable, "init_itable=%u"},
+	{Opt_init_itable, "init_itable"},
+	{Opt_noinit_itable, "noinit_itable"},
 	{Opt_err, NULL},
 };
 
@@ -1701,6 +1825,23 @@ set_qf_format:
 		case Opt_nodiscard:
 			clear_opt(sbi->s_mount_opt, DISCARD);
 			break;
+		case Opt_fast_commit:
+			set_opt(sbi->s_mount_opt, FAST_COMMIT);
+			break;
+		case Opt_init_itable:
+			set_opt(sbi->s_mount_opt, INIT_INODE_TABLE);
+			if (args[0].from) {
+				if (match_int(&args[0], &option))
+					return 0;
+			} else
+				option = EXT4_DEF_LI_WAIT_MULT;
+			if (option < 0)
+				return 0;
+			sbi->s_li_wait_mult = option;
+			break;
+		case Opt_noinit_itable:
+			clear_opt(sbi->s_mount_opt, INIT_INODE_TABLE);
+			break;
 		case Opt_dioread_nolock:
 			set_opt(sbi->s_mount_opt, DIOREAD_NOLOCK);
 			break;
@@ -2339,7 +2480,12 @@ EXT4_RW_ATTR_SBI_UI(mb_min_to_scan, s_mb_min_to_scan);
 EXT4_RW_ATTR_SBI_UI(mb_order2_req, s_mb_order2_reqs);
 EXT4_RW_ATTR_SBI_UI(mb_stream_req, s_mb_stream_request);
 EXT4_RW_ATTR_SBI_UI(mb_group_prealloc, s_mb_group_prealloc);
+EXT4_RW_ATTR_SBI_UI(mb_optimize_scan, s_mb_optimize_scan);
 EXT4_RW_ATTR_SBI_UI(max_writeback_mb_bump, s_max_writeback_mb_bump);
+EXT4_RW_ATTR_SBI_UI(lazyinit_wait_mult, s_li_wait_mult);
+EXT4_ATTR_OFFSET(lazyinit_remaining, 0444, sbi_ui_show, NULL, s_li_remaining);
+EXT4_ATTR_OFFSET(lazyinit_msecs, 0444, sbi_ui_show, NULL, s_li_msecs);
+EXT4_ATTR_OFFSET(mount_msecs, 0444, sbi_ui_show, NULL, s_mount_msecs);
 
 static struct attribute *ext4_attrs[] = {
 	ATTR_LIST(delayed_allocation_blocks),
@@ -2353,7 +2499,12 @@ static struct attribute *ext4_attrs[] = {
 	ATTR_LIST(mb_order2_req),
 	ATTR_LIST(mb_stream_req),
 	ATTR_LIST(mb_group_prealloc),
+	ATTR_LIST(mb_optimize_scan),
 	ATTR_LIST(max_writeback_mb_bump),
+	ATTR_LIST(lazyinit_wait_mult),
+	ATTR_LIST(lazyinit_remaining),
+	ATTR_LIST(lazyinit_msecs),
+	ATTR_LIST(mount_msecs),
 	NULL,
 };
 
@@ -2464,6 +2615,7 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 	__u64 blocks_count;
 	int err;
 	unsigned int journal_ioprio = DEFAULT_JOURNAL_IOPRIO;
+	unsigned long start_time = jiffies;
 
 	sbi = kzalloc(sizeof(*sbi), GFP_KERNEL);
 	if (!sbi)
@@ -2562,6 +2714,8 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 	sbi->s_max_batch_time = EXT4_DEF_MAX_BATCH_TIME;
 
 	set_opt(sbi->s_mount_opt, BARRIER);
+	set_opt(sbi->s_mount_opt, INIT_INODE_TABLE);
+	sbi->s_li_wait_mult = EXT4_DEF_LI_WAIT_MULT;
 
 	/*
 	 * enable delayed allocation by default
@@ -2877,6 +3031,13 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 				JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT);
 	}
 
+	if (test_opt(sb, FAST_COMMIT) && !(sb->s_flags & MS_RDONLY) &&
+	    jbd2_fc_init(sbi->s_journal, JBD2_DEFAULT_FC_BLOCKS)) {
+		ext4_msg(sb, KERN_WARNING, "unable to set up a fast commit "
+			 "area, fast_commit disabled");
+		clear_opt(sbi->s_mount_opt, FAST_COMMIT);
+	}
+
 	/* We have now updated the journal if required, so we can
 	 * validate the data journaling mode. */
 	switch (test_opt(sb, DATA_FLAGS)) {
@@ -3052,6 +3213,9 @@ no_journal:
 
 	ext4_msg(sb, KERN_INFO, "mounted filesystem with%s", descr);
 
+	sbi->s_mount_msecs = jiffies_to_msecs(jiffies - start_time);
+	ext4_start_lazyinit_thread(sb);
+
 	lock_kernel();
 	return 0;
 
@@ -3639,6 +3803,8 @@ static int ext4_remount(struct super_block *sb, int *flags, char *data)
 		}
 
 		if (*flags & MS_RDONLY) {
+			ext4_stop_lazyinit_thread(sb);
+
 			/*
 			 * First of all, the unconditional stuff we have to do
 			 * to disable replay of the journal when we next remount
@@ -3713,6 +3879,11 @@ static int ext4_remount(struct super_block *sb, int *flags, char *data)
 	if (sbi->s_journal == NULL)
 		ext4_commit_super(sb, 1);
 
+	if (!test_opt(sb, INIT_INODE_TABLE))
+		ext4_stop_lazyinit_thread(sb);
+	else
+		ext4_start_lazyinit_thread(sb);
+
 #ifdef CONFIG_QUOTA
 	/* Release old quota file names */
 	for (i = 0; i < MAXQUOTAS; i++)
@@ -4098,7 +4269,7 @@ static struct file_system_type ext2_fs_type = {
 	.name		= "ext2",
 	.get_sb		= ext4_get_sb,
 	.kill_sb	= kill_block_super,
-	.fs_flags	= FS_REQUIRES_DEV,
+	.fs_flags	= FS_REQUIRES_DEV | FS_RCU_INODES,
 };
 
 static inline void register_as_ext2(void)
@@ -4143,7 +4314,7 @@ static struct file_system_type ext4_fs_type = {
 	.name		= "ext4",
 	.get_sb		= ext4_get_sb,
 	.kill_sb	= kill_block_super,
-	.fs_flags	= FS_REQUIRES_DEV,
+	.fs_flags	= FS_REQUIRES_DEV | FS_RCU_INODES,
 };
 
 static int __init init_ext4_fs(void)
@@ -10,13 +10,26 @@
 
 #include <linux/fs.h>
 #include <linux/buffer_head.h>
+#include <linux/rbtree.h>
 #include "fat.h"
 
+/*
+ * Each inode caches fragments of its cluster chain. The fragments are kept
+ * in an rbtree sorted by the file cluster they start at, so finding the
+ * nearest fragment before a cluster is O(log n), and on an LRU list for
+ * replacement. The number of fragments grows with the size of the file:
+ * one per FAT_CACHE_CLUSTERS clusters, between FAT_MIN_CACHE and
+ * FAT_MAX_CACHE.
+ */
+
 /* this must be > 0. */
-#define FAT_MAX_CACHE	8
+#define FAT_MIN_CACHE		8
+#define FAT_MAX_CACHE		512
+#define FAT_CACHE_CLUSTERS_BITS	6	/* 64 clusters per cache entry */
 
 struct fat_cache {
 	struct list_head cache_list;
+	struct rb_node cache_node;
 	int nr_contig;	/* number of contiguous clusters */
 	int fcluster;	/* cluster number in the file. */
 	int dcluster;	/* cluster number on disk. */
@@ -31,7 +44,14 @@ struct fat_cache_id {
 
 static inline int fat_max_cache(struct inode *inode)
 {
-	return FAT_MAX_CACHE;
+	int bits = MSDOS_SB(inode->i_sb)->cluster_bits + FAT_CACHE_CLUSTERS_BITS;
+	loff_t nr = i_size_read(inode) >> bits;
+
+	if (nr < FAT_MIN_CACHE)
+		return FAT_MIN_CACHE;
+	if (nr > FAT_MAX_CACHE)
+		return FAT_MAX_CACHE;
+	return nr;
 }
 
 static struct kmem_cache *fat_cache_cachep;
@@ -41,6 +61,7 @@ static void init_once(void *foo)
 	struct fat_cache *cache = (struct fat_cache *)foo;
 
 	INIT_LIST_HEAD(&cache->cache_list);
+	RB_CLEAR_NODE(&cache->cache_node);
 }
 
 int __init fat_cache_init(void)
@@ -67,6 +88,7 @@ static inline struct fat_cache *fat_cache_alloc(struct inode *inode)
 static inline void fat_cache_free(struct fat_cache *cache)
 {
 	BUG_ON(!list_empty(&cache->cache_list));
+	BUG_ON(!RB_EMPTY_NODE(&cache->cache_node));
 	kmem_cache_free(fat_cache_cachep, cache);
 }
 
@@ -77,29 +99,71 @@ static inline void fat_cache_update_lru(struct inode *inode,
 		list_move(&cache->cache_list, &MSDOS_I(inode)->cache_lru);
 }
 
+/*
+ * Find the cache starting at "fclus", or failing that the one starting
+ * closest before it. Returns NULL if every cache starts after "fclus".
+ */
+static struct fat_cache *fat_cache_find(struct inode *inode, int fclus)
+{
+	struct rb_node *n = MSDOS_I(inode)->cache_tree.rb_node;
+	struct fat_cache *p, *hit = NULL;
+
+	while (n) {
+		p = rb_entry(n, struct fat_cache, cache_node);
+		if (fclus < p->fcluster)
+			n = n->rb_left;
+		else {
+			hit = p;
+			if (fclus == p->fcluster)
+				break;
+			n = n->rb_right;
+		}
+	}
+	return hit;
+}
+
+static void fat_cache_insert(struct inode *inode, struct fat_cache *cache)
+{
+	struct rb_node **p = &MSDOS_I(inode)->cache_tree.rb_node;
+	struct rb_node *parent = NULL;
+	struct fat_cache *c;
+
+	while (*p) {
+		parent = *p;
+		c = rb_entry(parent, struct fat_cache, cache_node);
+		if (cache->fcluster < c->fcluster)
+			p = &(*p)->rb_left;
+		else {
+			BUG_ON(cache->fcluster == c->fcluster);
+			p = &(*p)->rb_right;
+		}
+	}
+	rb_link_node(&cache->cache_node, parent, p);
+	rb_insert_color(&cache->cache_node, &MSDOS_I(inode)->cache_tree);
+}
+
+static void fat_cache_erase(struct inode *inode, struct fat_cache *cache)
+{
+	rb_erase(&cache->cache_node, &MSDOS_I(inode)->cache_tree);
+	RB_CLEAR_NODE(&cache->cache_node);
+}
+
 static int fat_cache_lookup(struct inode *inode, int fclus,
 			    struct fat_cache_id *cid,
 			    int *cached_fclus, int *cached_dclus)
 {
-	static struct fat_cache nohit = { .fcluster = 0, };
-
-	struct fat_cache *hit = &nohit, *p;
+	struct fat_cache *hit;
 	int offset = -1;
 
 	spin_lock(&MSDOS_I(inode)->cache_lru_lock);
-	list_for_each_entry(p, &MSDOS_I(inode)->cache_lru, cache_list) {
-		/* Find the cache of "fclus" or nearest cache. */
-		if (p->fcluster <= fclus && hit->fcluster < p->fcluster) {
-			hit = p;
-			if ((hit->fcluster + hit->nr_contig) < fclus) {
-				offset = hit->nr_contig;
-			} else {
-				offset = fclus - hit->fcluster;
-				break;
-			}
-		}
-	}
-	if (hit != &nohit) {
+	/* Find the cache of "fclus" or nearest cache. */
+	hit = fat_cache_find(inode, fclus);
+	if (hit && hit->fcluster > 0) {
+		if ((hit->fcluster + hit->nr_contig) < fclus)
+			offset = hit->nr_contig;
+		else
+			offset = fclus - hit->fcluster;
+
 		fat_cache_update_lru(inode, hit);
 
 		cid->id = MSDOS_I(inode)->cache_valid_id;
@@ -119,14 +183,13 @@ static struct fat_cache *fat_cache_merge(struct inode *inode,
 {
 	struct fat_cache *p;
 
-	list_for_each_entry(p, &MSDOS_I(inode)->cache_lru, cache_list) {
-		/* Find the same part as "new" in cluster-chain. */
-		if (p->fcluster == new->fcluster) {
-			BUG_ON(p->dcluster != new->dcluster);
-			if (new->nr_contig > p->nr_contig)
-				p->nr_contig = new->nr_contig;
-			return p;
-		}
+	/* Find the same part as "new" in cluster-chain. */
+	p = fat_cache_find(inode, new->fcluster);
+	if (p && p->fcluster == new->fcluster) {
+		BUG_ON(p->dcluster != new->dcluster);
+		if (new->nr_contig > p->nr_contig)
+			p->nr_contig = new->nr_contig;
+		return p;
 	}
 	return NULL;
 }
@@ -151,6 +214,10 @@ static void fat_cache_add(struct inode *inode, struct fat_cache_id *new)
 
 			tmp = fat_cache_alloc(inode);
 			spin_lock(&MSDOS_I(inode)->cache_lru_lock);
+			if (!tmp) {
+				MSDOS_I(inode)->nr_caches--;
+				goto out;
+			}
 			cache = fat_cache_merge(inode, new);
 			if (cache != NULL) {
 				MSDOS_I(inode)->nr_caches--;
@@ -161,10 +228,12 @@ static void fat_cache_add(struct inode *inode, struct fat_cache_id *new)
 		} else {
 			struct list_head *p = MSDOS_I(inode)->cache_lru.prev;
 			cache = list_entry(p, struct fat_cache, cache_list);
+			fat_cache_erase(inode, cache);
 		}
 		cache->fcluster = new->fcluster;
 		cache->dcluster = new->dcluster;
 		cache->nr_contig = new->nr_contig;
+		fat_cache_insert(inode, cache);
 	}
 out_update_lru:
 	fat_cache_update_lru(inode, cache);
@@ -184,9 +253,11 @@ static void __fat_cache_inval_inode(struct inode *inode)
 	while (!list_empty(&i->cache_lru)) {
 		cache = list_entry(i->cache_lru.next, struct fat_cache, cache_list);
 		list_del_init(&cache->cache_list);
+		RB_CLEAR_NODE(&cache->cache_node);
 		i->nr_caches--;
 		fat_cache_free(cache);
 	}
+	i->cache_tree = RB_ROOT;
 	/* Update. The copy of caches before this id is discarded. */
 	i->cache_valid_id++;
 	if (i->cache_valid_id == FAT_CACHE_VALID)
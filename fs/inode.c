@@ -27,6 +27,8 @@
 #include <linux/mount.h>
 #include <linux/async.h>
 #include <linux/posix_acl.h>
+#include <linux/percpu_counter.h>
+#include "internal.h"
 
 /*
  * This is needed for the following functions:
@@ -64,26 +66,52 @@ static unsigned int i_hash_mask __read_mostly;
 static unsigned int i_hash_shift __read_mostly;
 
 /*
- * Each inode can be on two separate lists. One is
- * the hash list of the inode, used for lookups. The
- * other linked list is the "type" list:
- *  "in_use" - valid inode, i_count > 0, i_nlink > 0
- *  "dirty"  - as "in_use" but also dirty
- *  "unused" - valid inode, i_count = 0
+ * Besides the hash list used for lookups and the per-sb s_inodes list,
+ * an inode can be on:
+ *  - a writeback list of its bdi (i_list): dirty, or under writeback
+ *  - the unused LRU of its superblock (i_lru): clean, i_count = 0
  *
- * A "dirty" list is maintained for each super block,
- * allowing for low-overhead inode sync() operations.
+ * The LRU is maintained lazily: taking a reference does not remove the
+ * inode from it, prune_icache() drops the busy and dirty ones it finds
+ * there instead.  This keeps the LRU out of the iget/iput fast path.
  */
 
-LIST_HEAD(inode_in_use);
-LIST_HEAD(inode_unused);
 static struct hlist_head *inode_hashtable __read_mostly;
 
 /*
- * A simple spinlock to protect the list manipulations.
+ * Hash chains share a small fixed set of locks, picked by bucket number.
+ * On UP there is nothing to spread, so all chains use the one lock.
+ */
+#ifdef CONFIG_SMP
+#define INODE_HASH_LOCK_BITS	8
+#else
+#define INODE_HASH_LOCK_BITS	0
+#endif
+#define INODE_HASH_LOCK_MASK	((1 << INODE_HASH_LOCK_BITS) - 1)
+
+static spinlock_t inode_hash_locks[1 << INODE_HASH_LOCK_BITS];
+
+/*
+ * Locking:
  *
- * NOTE! You also have to own the lock if you change
+ * inode_lock protects i_state, the writeback lists, the unused LRUs and
+ * inodes_stat.nr_unused.  NOTE! You also have to own it if you change
  * the i_state of an inode while it is in use..
+ *
+ * Each inode hash chain is covered by one of inode_hash_locks, its chain
+ * lock.  The I_FREEING and I_WILL_FREE bits of a hashed inode are only
+ * set with its chain locked as well, so a lookup holding just the chain
+ * lock can skip inodes that are going away.  Such a lookup may only take
+ * a reference on an inode that is in use already: raising i_count from
+ * zero still needs inode_lock, which the final iput() holds until the
+ * inode is back on the LRU or marked I_FREEING.
+ *
+ * sb->s_inodes_lock protects sb->s_inodes.
+ *
+ * Ordering:
+ * inode_lock
+ *   sb->s_inodes_lock
+ *   inode hash chain lock
  */
 DEFINE_SPINLOCK(inode_lock);
 
@@ -106,6 +134,41 @@ static DECLARE_RWSEM(iprune_sem);
  */
 struct inodes_stat_t inodes_stat;
 
+static struct percpu_counter nr_inodes __cacheline_aligned_in_smp;
+
+static int get_nr_inodes(void)
+{
+	return percpu_counter_read_positive(&nr_inodes);
+}
+
+/*
+ * Number of inodes in use or dirty, a guess at how many need writing.
+ */
+int get_nr_dirty_inodes(void)
+{
+	int nr_dirty = get_nr_inodes() - inodes_stat.nr_unused;
+
+	return nr_dirty > 0 ? nr_dirty : 0;
+}
+
+/*
+ * Handle nr_inodes sysctl
+ */
+#if defined(CONFIG_SYSCTL) && defined(CONFIG_PROC_FS)
+int proc_nr_inodes(ctl_table *table, int write,
+		   void __user *buffer, size_t *lenp, loff_t *ppos)
+{
+	inodes_stat.nr_inodes = get_nr_inodes();
+	return proc_dointvec(table, write, buffer, lenp, ppos);
+}
+#else
+int proc_nr_inodes(ctl_table *table, int write,
+		   void __user *buffer, size_t *lenp, loff_t *ppos)
+{
+	return -ENOSYS;
+}
+#endif
+
 static struct kmem_cache *inode_cachep __read_mostly;
 
 static void wake_up_inode(struct inode *inode)
@@ -134,6 +197,7 @@ int inode_init_always(struct super_block *sb, struct inode *inode)
 
 	inode->i_sb = sb;
 	inode->i_blkbits = sb->s_blocksize_bits;
+	INIT_LIST_HEAD(&inode->i_dentry);
 	inode->i_flags = 0;
 	atomic_set(&inode->i_count, 1);
 	inode->i_op = &empty_iops;
@@ -178,6 +242,8 @@ int inode_init_always(struct super_block *sb, struct inode *inode)
 	mapping->assoc_mapping = NULL;
 	mapping->backing_dev_info = &default_backing_dev_info;
 	mapping->writeback_index = 0;
+	mapping->ra_hint_size = 0;
+	mapping->ra_hint_stride = 0;
 
 	/*
 	 * If the block_device provides a backing_dev_info for client
@@ -247,13 +313,24 @@ void __destroy_inode(struct inode *inode)
 }
 EXPORT_SYMBOL(__destroy_inode);
 
+static void i_callback(struct rcu_head *head)
+{
+	struct inode *inode = container_of(head, struct inode, i_rcu);
+	kmem_cache_free(inode_cachep, inode);
+}
+
+/*
+ * Inodes without a ->destroy_inode, and those of filesystems flagged
+ * FS_RCU_INODES, are freed after an RCU grace period so that the lockless
+ * path walk can look at them without holding a reference.
+ */
 void destroy_inode(struct inode *inode)
 {
 	__destroy_inode(inode);
 	if (inode->i_sb->s_op->destroy_inode)
 		inode->i_sb->s_op->destroy_inode(inode);
 	else
-		kmem_cache_free(inode_cachep, (inode));
+		call_rcu(&inode->i_rcu, i_callback);
 }
 
 /*
@@ -265,12 +342,14 @@ void inode_init_once(struct inode *inode)
 {
 	memset(inode, 0, sizeof(*inode));
 	INIT_HLIST_NODE(&inode->i_hash);
-	INIT_LIST_HEAD(&inode->i_dentry);
+	INIT_LIST_HEAD(&inode->i_list);
+	INIT_LIST_HEAD(&inode->i_lru);
 	INIT_LIST_HEAD(&inode->i_devices);
 	INIT_RADIX_TREE(&inode->i_data.page_tree, GFP_ATOMIC);
 	spin_lock_init(&inode->i_data.tree_lock);
 	spin_lock_init(&inode->i_data.i_mmap_lock);
 	INIT_LIST_HEAD(&inode->i_data.private_list);
+	INIT_LIST_HEAD(&inode->i_data.shadow_list);
 	spin_lock_init(&inode->i_data.private_lock);
 	INIT_RAW_PRIO_TREE_ROOT(&inode->i_data.i_mmap);
 	INIT_LIST_HEAD(&inode->i_data.i_mmap_nonlinear);
@@ -297,13 +376,129 @@ static void init_once(void *foo)
  */
 void __iget(struct inode *inode)
 {
-	if (atomic_read(&inode->i_count)) {
-		atomic_inc(&inode->i_count);
+	atomic_inc(&inode->i_count);
+}
+
+static inline spinlock_t *inode_hash_lock(struct hlist_head *head)
+{
+	return &inode_hash_locks[(head - inode_hashtable) &
+				 INODE_HASH_LOCK_MASK];
+}
+
+static inline spinlock_t *inode_hash_lock_of(struct inode *inode)
+{
+	return &inode_hash_locks[inode->i_hash_bucket & INODE_HASH_LOCK_MASK];
+}
+
+/*
+ * A lookup that finds an unused inode under just the chain lock has to
+ * retake that lock inside inode_lock to get the first reference.
+ */
+static void inode_hash_relock(spinlock_t *lock)
+{
+	spin_unlock(lock);
+	spin_lock(&inode_lock);
+	spin_lock(lock);
+}
+
+static void inode_hash_unlock(spinlock_t *lock, int locked)
+{
+	spin_unlock(lock);
+	if (locked)
+		spin_unlock(&inode_lock);
+}
+
+/*
+ * Take a reference on an inode found on a hash chain.  Without inode_lock
+ * that only works if the inode is in use already.
+ */
+static inline int __iget_hashed(struct inode *inode, int locked)
+{
+	if (locked) {
+		__iget(inode);
+		return 1;
+	}
+	return atomic_inc_not_zero(&inode->i_count);
+}
+
+/*
+ * The chain lock must be held
+ */
+static void __inode_hash_add(struct inode *inode, struct hlist_head *head)
+{
+	inode->i_hash_bucket = head - inode_hashtable;
+	hlist_add_head(&inode->i_hash, head);
+}
+
+static void inode_hash_del(struct inode *inode)
+{
+	spinlock_t *lock = inode_hash_lock_of(inode);
+
+	spin_lock(lock);
+	hlist_del_init(&inode->i_hash);
+	spin_unlock(lock);
+}
+
+/*
+ * Set I_FREEING or I_WILL_FREE, which lookups under just the chain lock
+ * rely on.  inode_lock must be held.
+ */
+static void inode_mark_freeing(struct inode *inode, unsigned long flag)
+{
+	spinlock_t *lock = inode_hash_lock_of(inode);
+
+	WARN_ON(inode->i_state & I_NEW);
+	spin_lock(lock);
+	inode->i_state |= flag;
+	spin_unlock(lock);
+}
+
+static void inode_sb_list_add(struct inode *inode)
+{
+	struct super_block *sb = inode->i_sb;
+
+	percpu_counter_inc(&nr_inodes);
+	spin_lock(&sb->s_inodes_lock);
+	list_add(&inode->i_sb_list, &sb->s_inodes);
+	spin_unlock(&sb->s_inodes_lock);
+}
+
+static void inode_sb_list_del(struct inode *inode)
+{
+	struct super_block *sb = inode->i_sb;
+
+	spin_lock(&sb->s_inodes_lock);
+	list_del_init(&inode->i_sb_list);
+	spin_unlock(&sb->s_inodes_lock);
+	percpu_counter_dec(&nr_inodes);
+}
+
+/*
+ * Put an unused inode at the head of its superblock's LRU, moving it
+ * there if it is already on the list.  inode_lock must be held.
+ */
+void inode_lru_list_add(struct inode *inode)
+{
+	struct super_block *sb = inode->i_sb;
+
+	if (!list_empty(&inode->i_lru)) {
+		list_move(&inode->i_lru, &sb->s_inode_lru);
 		return;
 	}
-	atomic_inc(&inode->i_count);
-	if (!(inode->i_state & (I_DIRTY|I_SYNC)))
-		list_move(&inode->i_list, &inode_in_use);
+	list_add(&inode->i_lru, &sb->s_inode_lru);
+	sb->s_nr_inodes_unused++;
+	inodes_stat.nr_unused++;
+}
+
+/*
+ * inode_lock must be held
+ */
+static void inode_lru_list_del(struct inode *inode)
+{
+	if (list_empty(&inode->i_lru))
+		return;
+	list_del_init(&inode->i_lru);
+	inode->i_sb->s_nr_inodes_unused--;
 	inodes_stat.nr_unused--;
 }
 
@@ -320,6 +515,12 @@ void clear_inode(struct inode *inode)
 	might_sleep();
 	invalidate_inode_buffers(inode);
 
+	/* Reclaim may have left shadow entries behind the last pages */
+	if (inode->i_data.nrshadows)
+		truncate_inode_pages(&inode->i_data, 0);
+	else
+		/* the shadow shrinker may still be dropping the last ones */
+		spin_unlock_wait(&inode->i_data.tree_lock);
 	BUG_ON(inode->i_data.nrpages);
 	BUG_ON(!(inode->i_state & I_FREEING));
 	BUG_ON(inode->i_state & I_CLEAR);
@@ -344,39 +545,32 @@ EXPORT_SYMBOL(clear_inode);
  */
 static void dispose_list(struct list_head *head)
 {
-	int nr_disposed = 0;
-
 	while (!list_empty(head)) {
 		struct inode *inode;
 
-		inode = list_first_entry(head, struct inode, i_list);
-		list_del(&inode->i_list);
+		inode = list_first_entry(head, struct inode, i_lru);
+		list_del_init(&inode->i_lru);
 
 		if (inode->i_data.nrpages)
 			truncate_inode_pages(&inode->i_data, 0);
 		clear_inode(inode);
 
-		spin_lock(&inode_lock);
-		hlist_del_init(&inode->i_hash);
-		list_del_init(&inode->i_sb_list);
-		spin_unlock(&inode_lock);
+		inode_hash_del(inode);
+		inode_sb_list_del(inode);
 
 		wake_up_inode(inode);
 		destroy_inode(inode);
-		nr_disposed++;
 	}
-	spin_lock(&inode_lock);
-	inodes_stat.nr_inodes -= nr_disposed;
-	spin_unlock(&inode_lock);
 }
 
 /*
  * Invalidate all inodes for a device.
  */
-static int invalidate_list(struct list_head *head, struct list_head *dispose)
+static int invalidate_list(struct super_block *sb, struct list_head *head,
+			   struct list_head *dispose)
 {
 	struct list_head *next;
-	int busy = 0, count = 0;
+	int busy = 0;
 
 	next = head->next;
 	for (;;) {
@@ -389,7 +583,13 @@ static int invalidate_list(struct list_head *head, struct list_head *dispose)
 		 * change during umount anymore, and because iprune_sem keeps
 		 * shrink_icache_memory() away.
 		 */
-		cond_resched_lock(&inode_lock);
+		if (need_resched()) {
+			spin_unlock(&sb->s_inodes_lock);
+			spin_unlock(&inode_lock);
+			cond_resched();
+			spin_lock(&inode_lock);
+			spin_lock(&sb->s_inodes_lock);
+		}
 
 		next = next->next;
 		if (tmp == head)
@@ -399,16 +599,14 @@ static int invalidate_list(struct list_head *head, struct list_head *dispose)
 			continue;
 		invalidate_inode_buffers(inode);
 		if (!atomic_read(&inode->i_count)) {
-			list_move(&inode->i_list, dispose);
-			WARN_ON(inode->i_state & I_NEW);
-			inode->i_state |= I_FREEING;
-			count++;
+			list_del_init(&inode->i_list);
+			inode_lru_list_del(inode);
+			list_add(&inode->i_lru, dispose);
+			inode_mark_freeing(inode, I_FREEING);
 			continue;
 		}
 		busy = 1;
 	}
-	/* only unused inodes may be cached with i_count zero */
-	inodes_stat.nr_unused -= count;
 	return busy;
 }
 
@@ -427,9 +625,11 @@ int invalidate_inodes(struct super_block *sb)
 
 	down_write(&iprune_sem);
 	spin_lock(&inode_lock);
+	spin_lock(&sb->s_inodes_lock);
 	inotify_unmount_inodes(&sb->s_inodes);
 	fsnotify_unmount_inodes(&sb->s_inodes);
-	busy = invalidate_list(&sb->s_inodes, &throw_away);
+	busy = invalidate_list(sb, &sb->s_inodes, &throw_away);
+	spin_unlock(&sb->s_inodes_lock);
 	spin_unlock(&inode_lock);
 
 	dispose_list(&throw_away);
@@ -453,60 +653,106 @@ static int can_unuse(struct inode *inode)
 }
 
 /*
- * Scan `goal' inodes on the unused list for freeable ones. They are moved to
- * a temporary list and then are freed outside inode_lock by dispose_list().
+ * Scan `nr_to_scan' inodes on the unused list of @sb for freeable ones.
+ * They are moved to @freeable and then are freed outside inode_lock by
+ * dispose_list().  Called, and returns, with inode_lock held.
+ *
+ * Inodes which have been referenced or dirtied since they were put on the
+ * LRU are taken off it here; the final iput() or the end of writeback will
+ * put them back once they are unused and clean again.
  *
  * Any inodes which are pinned purely because of attached pagecache have their
- * pagecache removed.  We expect the final iput() on that inode to add it to
- * the front of the inode_unused list.  So look for it there and if the
- * inode is still freeable, proceed.  The right inode is found 99.9% of the
- * time in testing on a 4-way.
+ * pagecache removed.  We expect the final iput() on that inode to move it to
+ * the front of the LRU.  So look for it there and if the inode is still
+ * freeable, proceed.  The right inode is found 99.9% of the time in testing
+ * on a 4-way.
  *
  * If the inode has metadata buffers attached to mapping->private_list then
  * try to remove them.
  */
-static void prune_icache(int nr_to_scan)
+static void __prune_icache_sb(struct super_block *sb, int nr_to_scan,
+			      struct list_head *freeable, unsigned long *reap)
 {
-	LIST_HEAD(freeable);
-	int nr_pruned = 0;
 	int nr_scanned;
-	unsigned long reap = 0;
 
-	down_read(&iprune_sem);
-	spin_lock(&inode_lock);
 	for (nr_scanned = 0; nr_scanned < nr_to_scan; nr_scanned++) {
 		struct inode *inode;
 
-		if (list_empty(&inode_unused))
+		if (list_empty(&sb->s_inode_lru))
 			break;
 
-		inode = list_entry(inode_unused.prev, struct inode, i_list);
+		inode = list_entry(sb->s_inode_lru.prev, struct inode, i_lru);
 
 		if (inode->i_state || atomic_read(&inode->i_count)) {
-			list_move(&inode->i_list, &inode_unused);
+			inode_lru_list_del(inode);
 			continue;
 		}
 		if (inode_has_buffers(inode) || inode->i_data.nrpages) {
 			__iget(inode);
 			spin_unlock(&inode_lock);
 			if (remove_inode_buffers(inode))
-				reap += invalidate_mapping_pages(&inode->i_data,
-								0, -1);
+				*reap += invalidate_mapping_pages(&inode->i_data,
+								  0, -1);
 			iput(inode);
 			spin_lock(&inode_lock);
 
-			if (inode != list_entry(inode_unused.next,
-						struct inode, i_list))
+			if (inode != list_entry(sb->s_inode_lru.next,
+						struct inode, i_lru))
 				continue;	/* wrong inode or list_empty */
 			if (!can_unuse(inode))
 				continue;
 		}
-		list_move(&inode->i_list, &freeable);
-		WARN_ON(inode->i_state & I_NEW);
-		inode->i_state |= I_FREEING;
-		nr_pruned++;
+		inode_lru_list_del(inode);
+		list_add(&inode->i_lru, freeable);
+		inode_mark_freeing(inode, I_FREEING);
+	}
+}
+
+/*
+ * Shrink the unused inode LRUs of all superblocks, scanning each one in
+ * proportion to the number of unused inodes it holds.  This works like
+ * prune_dcache() does for the per-sb dentry LRUs.
+ */
+static void prune_icache(int nr_to_scan)
+{
+	LIST_HEAD(freeable);
+	struct super_block *sb;
+	int unused, prune_ratio, w_count;
+	unsigned long reap = 0;
+
+	down_read(&iprune_sem);
+	spin_lock(&inode_lock);
+	unused = inodes_stat.nr_unused;
+	if (unused == 0 || nr_to_scan == 0)
+		goto out;
+restart:
+	if (nr_to_scan >= unused)
+		prune_ratio = 1;
+	else
+		prune_ratio = unused / nr_to_scan;
+	spin_lock(&sb_lock);
+	list_for_each_entry(sb, &super_blocks, s_list) {
+		if (sb->s_nr_inodes_unused == 0)
+			continue;
+		sb->s_count++;
+		spin_unlock(&sb_lock);
+		if (prune_ratio != 1)
+			w_count = (sb->s_nr_inodes_unused / prune_ratio) + 1;
+		else
+			w_count = sb->s_nr_inodes_unused;
+		__prune_icache_sb(sb, w_count, &freeable, &reap);
+		nr_to_scan -= w_count;
+		spin_lock(&sb_lock);
+		/* lock was dropped, must reset next */
+		if (__put_super_and_need_restart(sb) && nr_to_scan > 0) {
+			spin_unlock(&sb_lock);
+			goto restart;
+		}
+		if (nr_to_scan <= 0)
+			break;
 	}
-	inodes_stat.nr_unused -= nr_pruned;
+	spin_unlock(&sb_lock);
+out:
 	if (current_is_kswapd())
 		__count_vm_events(KSWAPD_INODESTEAL, reap);
 	else
@@ -546,17 +792,19 @@ static struct shrinker icache_shrinker = {
 	.seeks = DEFAULT_SEEKS,
 };
 
-static void __wait_on_freeing_inode(struct inode *inode);
+static void __wait_on_freeing_inode(struct inode *inode, spinlock_t *lock,
+				    int locked);
 /*
- * Called with the inode lock held.
- * NOTE: we are not increasing the inode-refcount, you must call __iget()
- * by hand after calling find_inode now! This simplifies iunique and won't
- * add any additional branch in the common code.
+ * Called with the chain lock of @head held, and with inode_lock held too
+ * if @locked.
+ * NOTE: we are not increasing the inode-refcount, you must call
+ * __iget_hashed() by hand after calling find_inode now! This won't add
+ * any additional branch in the common code.
  */
 static struct inode *find_inode(struct super_block *sb,
 				struct hlist_head *head,
 				int (*test)(struct inode *, void *),
-				void *data)
+				void *data, int locked)
 {
 	struct hlist_node *node;
 	struct inode *inode = NULL;
@@ -568,7 +816,8 @@ repeat:
 		if (!test(inode, data))
 			continue;
 		if (inode->i_state & (I_FREEING|I_CLEAR|I_WILL_FREE)) {
-			__wait_on_freeing_inode(inode);
+			__wait_on_freeing_inode(inode, inode_hash_lock(head),
+						locked);
 			goto repeat;
 		}
 		break;
@@ -581,7 +830,8 @@ repeat:
  * iget_locked for details.
  */
 static struct inode *find_inode_fast(struct super_block *sb,
-				struct hlist_head *head, unsigned long ino)
+				struct hlist_head *head, unsigned long ino,
+				int locked)
 {
 	struct hlist_node *node;
 	struct inode *inode = NULL;
@@ -593,7 +843,8 @@ repeat:
 		if (inode->i_sb != sb)
 			continue;
 		if (inode->i_state & (I_FREEING|I_CLEAR|I_WILL_FREE)) {
-			__wait_on_freeing_inode(inode);
+			__wait_on_freeing_inode(inode, inode_hash_lock(head),
+						locked);
 			goto repeat;
 		}
 		break;
@@ -611,39 +862,57 @@ static unsigned long hash(struct super_block *sb, unsigned long hashval)
 	return tmp & I_HASHMASK;
 }
 
-static inline void
-__inode_add_to_lists(struct super_block *sb, struct hlist_head *head,
-			struct inode *inode)
-{
-	inodes_stat.nr_inodes++;
-	list_add(&inode->i_list, &inode_in_use);
-	list_add(&inode->i_sb_list, &sb->s_inodes);
-	if (head)
-		hlist_add_head(&inode->i_hash, head);
-}
-
 /**
  * inode_add_to_lists - add a new inode to relevant lists
  * @sb: superblock inode belongs to
  * @inode: inode to mark in use
  *
- * When an inode is allocated it needs to be accounted for, added to the in use
- * list, the owning superblock and the inode hash. This needs to be done under
- * the inode_lock, so export a function to do this rather than the inode lock
- * itself. We calculate the hash list to add to here so it is all internal
- * which requires the caller to have already set up the inode number in the
- * inode to add.
+ * When an inode is allocated it needs to be accounted for, added to the
+ * owning superblock and the inode hash. This needs to be done under
+ * the locks private to this file, so export a function to do this rather
+ * than the locks themselves. We calculate the hash list to add to here so
+ * it is all internal which requires the caller to have already set up the
+ * inode number in the inode to add.
  */
 void inode_add_to_lists(struct super_block *sb, struct inode *inode)
 {
 	struct hlist_head *head = inode_hashtable + hash(sb, inode->i_ino);
+	spinlock_t *lock = inode_hash_lock(head);
 
-	spin_lock(&inode_lock);
-	__inode_add_to_lists(sb, head, inode);
-	spin_unlock(&inode_lock);
+	inode_sb_list_add(inode);
+	spin_lock(lock);
+	__inode_hash_add(inode, head);
+	spin_unlock(lock);
 }
 EXPORT_SYMBOL_GPL(inode_add_to_lists);
 
+/*
+ * Inode numbers for inodes without one of their own are handed out to
+ * each CPU in batches, so that new_inode() does not bounce one counter
+ * between them.
+ */
+#define LAST_INO_BATCH 1024
+static DEFINE_PER_CPU(unsigned int, last_ino);
+
+static unsigned int get_next_ino(void)
+{
+	unsigned int *p = &get_cpu_var(last_ino);
+	unsigned int res = *p;
+
+#ifdef CONFIG_SMP
+	if (unlikely((res & (LAST_INO_BATCH-1)) == 0)) {
+		static atomic_t shared_last_ino;
+		int next = atomic_add_return(LAST_INO_BATCH, &shared_last_ino);
+
+		res = next - LAST_INO_BATCH;
+	}
+#endif
+
+	*p = ++res;
+	put_cpu_var(last_ino);
+	return res;
+}
+
 /**
  *	new_inode 	- obtain an inode
  *	@sb: superblock
@@ -658,23 +927,18 @@ EXPORT_SYMBOL_GPL(inode_add_to_lists);
  */
 struct inode *new_inode(struct super_block *sb)
 {
-	/*
-	 * On a 32bit, non LFS stat() call, glibc will generate an EOVERFLOW
-	 * error if st_ino won't fit in target struct field. Use 32bit counter
-	 * here to attempt to avoid that.
-	 */
-	static unsigned int last_ino;
 	struct inode *inode;
 
-	spin_lock_prefetch(&inode_lock);
-
 	inode = alloc_inode(sb);
 	if (inode) {
-		spin_lock(&inode_lock);
-		__inode_add_to_lists(sb, NULL, inode);
-		inode->i_ino = ++last_ino;
+		/*
+		 * On a 32bit, non LFS stat() call, glibc will generate an
+		 * EOVERFLOW error if st_ino won't fit in target struct field.
+		 * get_next_ino() uses a 32bit counter to attempt to avoid that.
+		 */
+		inode->i_ino = get_next_ino();
 		inode->i_state = 0;
-		spin_unlock(&inode_lock);
+		inode_sb_list_add(inode);
 	}
 	return inode;
 }
@@ -727,22 +991,26 @@ static struct inode *get_new_inode(struct super_block *sb,
 				int (*set)(struct inode *, void *),
 				void *data)
 {
+	spinlock_t *lock = inode_hash_lock(head);
 	struct inode *inode;
+	int locked = 0;
 
 	inode = alloc_inode(sb);
 	if (inode) {
 		struct inode *old;
 
-		spin_lock(&inode_lock);
+		spin_lock(lock);
+repeat:
 		/* We released the lock, so.. */
-		old = find_inode(sb, head, test, data);
+		old = find_inode(sb, head, test, data, locked);
 		if (!old) {
 			if (set(inode, data))
 				goto set_failed;
 
-			__inode_add_to_lists(sb, head, inode);
 			inode->i_state = I_LOCK|I_NEW;
-			spin_unlock(&inode_lock);
+			__inode_hash_add(inode, head);
+			inode_hash_unlock(lock, locked);
+			inode_sb_list_add(inode);
 
 			/* Return the locked inode with I_NEW set, the
 			 * caller is responsible for filling in the contents
@@ -755,8 +1023,12 @@ static struct inode *get_new_inode(struct super_block *sb,
 		 * us. Use the old inode instead of the one we just
 		 * allocated.
 		 */
-		__iget(old);
-		spin_unlock(&inode_lock);
+		if (!__iget_hashed(old, locked)) {
+			inode_hash_relock(lock);
+			locked = 1;
+			goto repeat;
+		}
+		inode_hash_unlock(lock, locked);
 		destroy_inode(inode);
 		inode = old;
 		wait_on_inode(inode);
@@ -764,7 +1036,7 @@ static struct inode *get_new_inode(struct super_block *sb,
 	return inode;
 
 set_failed:
-	spin_unlock(&inode_lock);
+	inode_hash_unlock(lock, locked);
 	destroy_inode(inode);
 	return NULL;
 }
@@ -776,20 +1048,24 @@ set_failed:
 static struct inode *get_new_inode_fast(struct super_block *sb,
 				struct hlist_head *head, unsigned long ino)
 {
+	spinlock_t *lock = inode_hash_lock(head);
 	struct inode *inode;
 
 	inode = alloc_inode(sb);
 	if (inode) {
 		struct inode *old;
+		int locked = 0;
 
-		spin_lock(&inode_lock);
+		spin_lock(lock);
+repeat:
 		/* We released the lock, so.. */
-		old = find_inode_fast(sb, head, ino);
+		old = find_inode_fast(sb, head, ino, locked);
 		if (!old) {
 			inode->i_ino = ino;
-			__inode_add_to_lists(sb, head, inode);
 			inode->i_state = I_LOCK|I_NEW;
-			spin_unlock(&inode_lock);
+			__inode_hash_add(inode, head);
+			inode_hash_unlock(lock, locked);
+			inode_sb_list_add(inode);
 
 			/* Return the locked inode with I_NEW set, the
 			 * caller is responsible for filling in the contents
@@ -802,8 +1078,12 @@ static struct inode *get_new_inode_fast(struct super_block *sb,
 		 * us. Use the old inode instead of the one we just
 		 * allocated.
 		 */
-		__iget(old);
-		spin_unlock(&inode_lock);
+		if (!__iget_hashed(old, locked)) {
+			inode_hash_relock(lock);
+			locked = 1;
+			goto repeat;
+		}
+		inode_hash_unlock(lock, locked);
 		destroy_inode(inode);
 		inode = old;
 		wait_on_inode(inode);
@@ -811,6 +1091,27 @@ static struct inode *get_new_inode_fast(struct super_block *sb,
 	return inode;
 }
 
+/*
+ * Inodes that are being freed still count as using their number here.
+ */
+static int test_inode_iunique(struct super_block *sb, unsigned long ino)
+{
+	struct hlist_head *head = inode_hashtable + hash(sb, ino);
+	spinlock_t *lock = inode_hash_lock(head);
+	struct hlist_node *node;
+	struct inode *inode;
+
+	spin_lock(lock);
+	hlist_for_each_entry(inode, node, head, i_hash) {
+		if (inode->i_ino == ino && inode->i_sb == sb) {
+			spin_unlock(lock);
+			return 0;
+		}
+	}
+	spin_unlock(lock);
+	return 1;
+}
+
 /**
  *	iunique - get a unique inode number
  *	@sb: superblock
@@ -832,20 +1133,17 @@ ino_t iunique(struct super_block *sb, ino_t max_reserved)
 	 * error if st_ino won't fit in target struct field. Use 32bit counter
 	 * here to attempt to avoid that.
 	 */
+	static DEFINE_SPINLOCK(iunique_lock);
 	static unsigned int counter;
-	struct inode *inode;
-	struct hlist_head *head;
 	ino_t res;
 
-	spin_lock(&inode_lock);
+	spin_lock(&iunique_lock);
 	do {
 		if (counter <= max_reserved)
 			counter = max_reserved + 1;
 		res = counter++;
-		head = inode_hashtable + hash(sb, res);
-		inode = find_inode_fast(sb, head, res);
-	} while (inode != NULL);
-	spin_unlock(&inode_lock);
+	} while (!test_inode_iunique(sb, res));
+	spin_unlock(&iunique_lock);
 
 	return res;
 }
@@ -885,25 +1183,28 @@ EXPORT_SYMBOL(igrab);
  *
  * Otherwise NULL is returned.
  *
- * Note, @test is called with the inode_lock held, so can't sleep.
+ * Note, @test is called with the inode hash chain lock held, so can't sleep.
  */
 static struct inode *ifind(struct super_block *sb,
 		struct hlist_head *head, int (*test)(struct inode *, void *),
 		void *data, const int wait)
 {
+	spinlock_t *lock = inode_hash_lock(head);
 	struct inode *inode;
+	int locked = 0;
 
-	spin_lock(&inode_lock);
-	inode = find_inode(sb, head, test, data);
-	if (inode) {
-		__iget(inode);
-		spin_unlock(&inode_lock);
-		if (likely(wait))
-			wait_on_inode(inode);
-		return inode;
+	spin_lock(lock);
+repeat:
+	inode = find_inode(sb, head, test, data, locked);
+	if (inode && !__iget_hashed(inode, locked)) {
+		inode_hash_relock(lock);
+		locked = 1;
+		goto repeat;
 	}
-	spin_unlock(&inode_lock);
-	return NULL;
+	inode_hash_unlock(lock, locked);
+	if (inode && likely(wait))
+		wait_on_inode(inode);
+	return inode;
 }
 
 /**
@@ -924,18 +1225,22 @@ static struct inode *ifind(struct super_block *sb,
 static struct inode *ifind_fast(struct super_block *sb,
 		struct hlist_head *head, unsigned long ino)
 {
+	spinlock_t *lock = inode_hash_lock(head);
 	struct inode *inode;
+	int locked = 0;
 
-	spin_lock(&inode_lock);
-	inode = find_inode_fast(sb, head, ino);
-	if (inode) {
-		__iget(inode);
-		spin_unlock(&inode_lock);
-		wait_on_inode(inode);
-		return inode;
+	spin_lock(lock);
+repeat:
+	inode = find_inode_fast(sb, head, ino, locked);
+	if (inode && !__iget_hashed(inode, locked)) {
+		inode_hash_relock(lock);
+		locked = 1;
+		goto repeat;
 	}
-	spin_unlock(&inode_lock);
-	return NULL;
+	inode_hash_unlock(lock, locked);
+	if (inode)
+		wait_on_inode(inode);
+	return inode;
 }
 
 /**
@@ -957,7 +1262,7 @@ static struct inode *ifind_fast(struct super_block *sb,
  *
  * Otherwise NULL is returned.
  *
- * Note, @test is called with the inode_lock held, so can't sleep.
+ * Note, @test is called with the inode hash chain lock held, so can't sleep.
  */
 struct inode *ilookup5_nowait(struct super_block *sb, unsigned long hashval,
 		int (*test)(struct inode *, void *), void *data)
@@ -985,7 +1290,7 @@ EXPORT_SYMBOL(ilookup5_nowait);
  *
  * Otherwise NULL is returned.
  *
- * Note, @test is called with the inode_lock held, so can't sleep.
+ * Note, @test is called with the inode hash chain lock held, so can't sleep.
  */
 struct inode *ilookup5(struct super_block *sb, unsigned long hashval,
 		int (*test)(struct inode *, void *), void *data)
@@ -1036,7 +1341,8 @@ EXPORT_SYMBOL(ilookup);
  * inode and this is returned locked, hashed, and with the I_NEW flag set. The
  * file system gets to fill it in before unlocking it via unlock_new_inode().
  *
- * Note both @test and @set are called with the inode_lock held, so can't sleep.
+ * Note both @test and @set are called with the inode hash chain lock held, so
+ * can't sleep.
  */
 struct inode *iget5_locked(struct super_block *sb, unsigned long hashval,
 		int (*test)(struct inode *, void *),
@@ -1092,12 +1398,16 @@ int insert_inode_locked(struct inode *inode)
 	struct super_block *sb = inode->i_sb;
 	ino_t ino = inode->i_ino;
 	struct hlist_head *head = inode_hashtable + hash(sb, ino);
+	spinlock_t *lock = inode_hash_lock(head);
 
 	inode->i_state |= I_LOCK|I_NEW;
 	while (1) {
 		struct hlist_node *node;
 		struct inode *old = NULL;
-		spin_lock(&inode_lock);
+		int locked = 0;
+
+		spin_lock(lock);
+repeat:
 		hlist_for_each_entry(old, node, head, i_hash) {
 			if (old->i_ino != ino)
 				continue;
@@ -1108,12 +1418,16 @@ int insert_inode_locked(struct inode *inode)
 			break;
 		}
 		if (likely(!node)) {
-			hlist_add_head(&inode->i_hash, head);
-			spin_unlock(&inode_lock);
+			__inode_hash_add(inode, head);
+			inode_hash_unlock(lock, locked);
 			return 0;
 		}
-		__iget(old);
-		spin_unlock(&inode_lock);
+		if (!__iget_hashed(old, locked)) {
+			inode_hash_relock(lock);
+			locked = 1;
+			goto repeat;
+		}
+		inode_hash_unlock(lock, locked);
 		wait_on_inode(old);
 		if (unlikely(!hlist_unhashed(&old->i_hash))) {
 			iput(old);
@@ -1129,14 +1443,17 @@ int insert_inode_locked4(struct inode *inode, unsigned long hashval,
 {
 	struct super_block *sb = inode->i_sb;
 	struct hlist_head *head = inode_hashtable + hash(sb, hashval);
+	spinlock_t *lock = inode_hash_lock(head);
 
 	inode->i_state |= I_LOCK|I_NEW;
 
 	while (1) {
 		struct hlist_node *node;
 		struct inode *old = NULL;
+		int locked = 0;
 
-		spin_lock(&inode_lock);
+		spin_lock(lock);
+repeat:
 		hlist_for_each_entry(old, node, head, i_hash) {
 			if (old->i_sb != sb)
 				continue;
@@ -1147,12 +1464,16 @@ int insert_inode_locked4(struct inode *inode, unsigned long hashval,
 			break;
 		}
 		if (likely(!node)) {
-			hlist_add_head(&inode->i_hash, head);
-			spin_unlock(&inode_lock);
+			__inode_hash_add(inode, head);
+			inode_hash_unlock(lock, locked);
 			return 0;
 		}
-		__iget(old);
-		spin_unlock(&inode_lock);
+		if (!__iget_hashed(old, locked)) {
+			inode_hash_relock(lock);
+			locked = 1;
+			goto repeat;
+		}
+		inode_hash_unlock(lock, locked);
 		wait_on_inode(old);
 		if (unlikely(!hlist_unhashed(&old->i_hash))) {
 			iput(old);
@@ -1174,9 +1495,11 @@ EXPORT_SYMBOL(insert_inode_locked4);
 void __insert_inode_hash(struct inode *inode, unsigned long hashval)
 {
 	struct hlist_head *head = inode_hashtable + hash(inode->i_sb, hashval);
-	spin_lock(&inode_lock);
-	hlist_add_head(&inode->i_hash, head);
-	spin_unlock(&inode_lock);
+	spinlock_t *lock = inode_hash_lock(head);
+
+	spin_lock(lock);
+	__inode_hash_add(inode, head);
+	spin_unlock(lock);
 }
 EXPORT_SYMBOL(__insert_inode_hash);
 
@@ -1188,9 +1511,7 @@ EXPORT_SYMBOL(__insert_inode_hash);
  */
 void remove_inode_hash(struct inode *inode)
 {
-	spin_lock(&inode_lock);
-	hlist_del_init(&inode->i_hash);
-	spin_unlock(&inode_lock);
+	inode_hash_del(inode);
 }
 EXPORT_SYMBOL(remove_inode_hash);
 
@@ -1211,11 +1532,10 @@ void generic_delete_inode(struct inode *inode)
 	const struct super_operations *op = inode->i_sb->s_op;
 
 	list_del_init(&inode->i_list);
-	list_del_init(&inode->i_sb_list);
-	WARN_ON(inode->i_state & I_NEW);
-	inode->i_state |= I_FREEING;
-	inodes_stat.nr_inodes--;
+	inode_lru_list_del(inode);
+	inode_mark_freeing(inode, I_FREEING);
 	spin_unlock(&inode_lock);
+	inode_sb_list_del(inode);
 
 	security_inode_delete(inode);
 
@@ -1232,9 +1552,7 @@ void generic_delete_inode(struct inode *inode)
 		truncate_inode_pages(&inode->i_data, 0);
 		clear_inode(inode);
 	}
-	spin_lock(&inode_lock);
-	hlist_del_init(&inode->i_hash);
-	spin_unlock(&inode_lock);
+	inode_hash_del(inode);
 	wake_up_inode(inode);
 	BUG_ON(inode->i_state != I_CLEAR);
 	destroy_inode(inode);
@@ -1256,28 +1574,26 @@ int generic_detach_inode(struct inode *inode)
 
 	if (!hlist_unhashed(&inode->i_hash)) {
 		if (!(inode->i_state & (I_DIRTY|I_SYNC)))
-			list_move(&inode->i_list, &inode_unused);
-		inodes_stat.nr_unused++;
+			inode_lru_list_add(inode);
 		if (sb->s_flags & MS_ACTIVE) {
 			spin_unlock(&inode_lock);
 			return 0;
 		}
-		WARN_ON(inode->i_state & I_NEW);
-		inode->i_state |= I_WILL_FREE;
+		inode_mark_freeing(inode, I_WILL_FREE);
 		spin_unlock(&inode_lock);
 		write_inode_now(inode, 1);
 		spin_lock(&inode_lock);
 		WARN_ON(inode->i_state & I_NEW);
+		spin_lock(inode_hash_lock_of(inode));
 		inode->i_state &= ~I_WILL_FREE;
-		inodes_stat.nr_unused--;
 		hlist_del_init(&inode->i_hash);
+		spin_unlock(inode_hash_lock_of(inode));
 	}
 	list_del_init(&inode->i_list);
-	list_del_init(&inode->i_sb_list);
-	WARN_ON(inode->i_state & I_NEW);
-	inode->i_state |= I_FREEING;
-	inodes_stat.nr_inodes--;
+	inode_lru_list_del(inode);
+	inode_mark_freeing(inode, I_FREEING);
 	spin_unlock(&inode_lock);
+	inode_sb_list_del(inode);
 	return 1;
 }
 EXPORT_SYMBOL_GPL(generic_detach_inode);
@@ -1523,18 +1839,22 @@ EXPORT_SYMBOL(inode_wait);
  * It doesn't matter if I_LOCK is not set initially, a call to
  * wake_up_inode() after removing from the hash list will DTRT.
  *
- * This is called with inode_lock held.
+ * This is called with the hash chain lock @lock held, and with inode_lock
+ * held too if @locked.  Both are dropped while waiting.
  */
-static void __wait_on_freeing_inode(struct inode *inode)
+static void __wait_on_freeing_inode(struct inode *inode, spinlock_t *lock,
+				    int locked)
 {
 	wait_queue_head_t *wq;
 	DEFINE_WAIT_BIT(wait, &inode->i_state, __I_LOCK);
 	wq = bit_waitqueue(&inode->i_state, __I_LOCK);
 	prepare_to_wait(wq, &wait.wait, TASK_UNINTERRUPTIBLE);
-	spin_unlock(&inode_lock);
+	inode_hash_unlock(lock, locked);
 	schedule();
 	finish_wait(wq, &wait.wait);
-	spin_lock(&inode_lock);
+	if (locked)
+		spin_lock(&inode_lock);
+	spin_lock(lock);
 }
 
 static __initdata unsigned long ihash_entries;
@@ -1554,6 +1874,9 @@ void __init inode_init_early(void)
 {
 	int loop;
 
+	for (loop = 0; loop <= INODE_HASH_LOCK_MASK; loop++)
+		spin_lock_init(&inode_hash_locks[loop]);
+
 	/* If hashes are distributed across NUMA nodes, defer
 	 * hash allocation until vmalloc space is available.
 	 */
@@ -1586,6 +1909,7 @@ void __init inode_init(void)
 					 SLAB_MEM_SPREAD),
 					 init_once);
 	register_shrinker(&icache_shrinker);
+	percpu_counter_init(&nr_inodes, 0);
 
 	/* Hash may have been set up in inode_init_early */
 	if (!hashdist)
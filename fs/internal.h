@@ -84,3 +84,9 @@ extern void mark_files_ro(struct super_block *);
  * super.c
  */
 extern int do_remount_sb(struct super_block *, int, void *, int);
+
+/*
+ * inode.c
+ */
+extern void inode_lru_list_add(struct inode *inode);
+extern int get_nr_dirty_inodes(void);
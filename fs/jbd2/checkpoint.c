@@ -174,6 +174,28 @@ void __jbd2_log_wait_for_space(journal_t *journal)
 	}
 }
 
+/*
+ * __jbd2_log_kick_checkpoint: wake the background checkpoint thread if free
+ * log space is getting low.
+ *
+ * Called under j_state_lock.
+ */
+void __jbd2_log_kick_checkpoint(journal_t *journal)
+{
+	assert_spin_locked(&journal->j_state_lock);
+
+	if (journal->j_checkpoint_task &&
+	    jbd2_log_space_low(journal, JBD2_CHECKPOINT_LOW_SHIFT))
+		wake_up(&journal->j_wait_checkpoint);
+}
+
+void jbd2_log_kick_checkpoint(journal_t *journal)
+{
+	spin_lock(&journal->j_state_lock);
+	__jbd2_log_kick_checkpoint(journal);
+	spin_unlock(&journal->j_state_lock);
+}
+
 /*
  * We were unable to perform jbd_trylock_bh_state() inside j_list_lock.
  * The caller must restart a list walk.  Wait for someone else to run
@@ -720,6 +720,14 @@ start_journal_io:
 			blkdev_issue_flush(journal->j_dev, NULL);
 	}
 
+	/*
+	 * All log writes for this transaction are in flight.  If log space
+	 * is getting short, let the checkpoint thread write back older
+	 * transactions while we wait, rather than having the next handle
+	 * stall on a synchronous checkpoint after we are done.
+	 */
+	jbd2_log_kick_checkpoint(journal);
+
 	/*
 	 * This is the right place to wait for data buffers both for ASYNC
 	 * and !ASYNC commit. If commit is ASYNC, we need to wait only after
@@ -1057,6 +1065,8 @@ restart_loop:
 	}
 	spin_unlock(&journal->j_list_lock);
 
+	jbd2_log_kick_checkpoint(journal);
+
 	if (journal->j_commit_callback)
 		journal->j_commit_callback(journal, commit_transaction);
 
@@ -0,0 +1,420 @@
+/*
+ * linux/fs/jbd2/fast_commit.c
+ *
+ * This file is part of the Linux kernel and is made available under
+ * the terms of the GNU General Public License, version 2, or at your
+ * option, any later version, incorporated herein by reference.
+ *
+ * Fast commits for the generic filesystem journaling code.
+ *
+ * A full commit writes every metadata buffer the running transaction has
+ * touched, a descriptor and a commit block, and needs two cache flushes.
+ * For an fsync which only has to make a handful of bytes durable (the
+ * inode of a file being overwritten in place, say) that is a lot of IO.
+ *
+ * A fast commit instead logs the bytes themselves: a single block holding
+ * (filesystem block, offset, length, data) patches, written to a small
+ * area the journal reserves past the end of its circular log.  The
+ * running transaction is left running and is committed normally later.
+ *
+ * The client decides what may be fast committed; jbd2 only guarantees:
+ *
+ * + Every transaction before the one being fast committed is durable
+ *   before a fast commit block for it is written.
+ *
+ * + Nothing is added to the transaction while the patches are collected,
+ *   so they are a consistent snapshot.
+ *
+ * + On recovery, fast commit blocks are replayed only if they belong to
+ *   the first transaction which did not make it into the log, in the
+ *   order they were written, up to the first torn or stale block.  Once
+ *   that transaction commits, its fast commit blocks are dead.
+ *
+ * Fast commit blocks of a transaction are written from the start of the
+ * area; when it fills up the caller has to fall back to a full commit.
+ */
+
+#include <linux/fs.h>
+#include <linux/jbd2.h>
+#include <linux/errno.h>
+#include <linux/slab.h>
+#include <linux/crc32.h>
+#include <linux/blkdev.h>
+#include <linux/buffer_head.h>
+
+#define FC_ALIGN(len)	(((len) + 3) & ~3)
+
+/**
+ * int jbd2_fc_init() - reserve and enable a fast commit area
+ * @journal: journal to act on
+ * @nblocks: size of the area to reserve if the journal has none yet
+ *
+ * Must be called on a freshly loaded journal, before any handle has been
+ * started: carving the area out of the end of the log is only safe while
+ * the log is empty.  If the journal already has a fast commit area, its
+ * size is kept.
+ */
+int jbd2_fc_init(journal_t *journal, unsigned long nblocks)
+{
+	journal_superblock_t *sb = journal->j_superblock;
+	struct buffer_head *bh = journal->j_sb_buffer;
+
+	if (!journal->j_fc_buf) {
+		journal->j_fc_buf = kmalloc(journal->j_blocksize, GFP_KERNEL);
+		if (!journal->j_fc_buf)
+			return -ENOMEM;
+	}
+
+	if (JBD2_HAS_INCOMPAT_FEATURE(journal,
+				      JBD2_FEATURE_INCOMPAT_FC_PATCH))
+		return 0;
+
+	if (!jbd2_journal_check_available_features(journal, 0, 0,
+					JBD2_FEATURE_INCOMPAT_FC_PATCH))
+		goto out_free;
+
+	spin_lock(&journal->j_state_lock);
+	if (journal->j_running_transaction ||
+	    journal->j_committing_transaction ||
+	    journal->j_checkpoint_transactions ||
+	    journal->j_head != journal->j_first ||
+	    journal->j_tail != journal->j_first ||
+	    journal->j_first + JBD2_MIN_JOURNAL_BLOCKS + nblocks >
+				journal->j_last) {
+		spin_unlock(&journal->j_state_lock);
+		goto out_free;
+	}
+
+	sb->s_fc_patch_blks = cpu_to_be32(nblocks);
+	sb->s_feature_incompat |=
+			cpu_to_be32(JBD2_FEATURE_INCOMPAT_FC_PATCH);
+	journal->j_fc_last = journal->j_last;
+	journal->j_fc_first = journal->j_last - nblocks;
+	journal->j_last = journal->j_fc_first;
+	journal->j_free -= nblocks;
+	spin_unlock(&journal->j_state_lock);
+
+	/*
+	 * The log must never be recovered with the old j_last once a fast
+	 * commit block may be sitting there, so write the superblock now
+	 * rather than with the next commit.
+	 */
+	mark_buffer_dirty(bh);
+	sync_dirty_buffer(bh);
+	if (buffer_write_io_error(bh)) {
+		printk(KERN_ERR "JBD2: I/O error enabling fast commits on %s\n",
+		       journal->j_devname);
+		return -EIO;
+	}
+	return 0;
+
+out_free:
+	kfree(journal->j_fc_buf);
+	journal->j_fc_buf = NULL;
+	return -EINVAL;
+}
+
+/* Bytes of j_fc_buf used by the header and the patches added so far */
+static unsigned int jbd2_fc_used(journal_t *journal)
+{
+	jbd2_fc_header_t *hdr = (jbd2_fc_header_t *)journal->j_fc_buf;
+	unsigned int pos = sizeof(jbd2_fc_header_t);
+	int i;
+
+	for (i = be16_to_cpu(hdr->fc_count); i > 0; i--) {
+		jbd2_fc_tag_t *tag = (jbd2_fc_tag_t *)(journal->j_fc_buf + pos);
+
+		pos += sizeof(jbd2_fc_tag_t) + FC_ALIGN(be16_to_cpu(tag->ft_len));
+	}
+	return pos;
+}
+
+/**
+ * int jbd2_fc_begin_commit() - start building a fast commit
+ * @journal: journal to act on
+ * @tid: transaction the fast commit stands in for
+ *
+ * Returns -EAGAIN straight away if @tid has already committed or is not
+ * the running transaction.  Otherwise waits for any committing transaction,
+ * then locks out updates and checks again that @tid is still running and
+ * not on its way to a full commit.  On success the caller adds its patches
+ * with jbd2_fc_add_patch() and must finish with jbd2_fc_end_commit(); on
+ * failure nothing is held and the caller should commit @tid normally.
+ */
+int jbd2_fc_begin_commit(journal_t *journal, tid_t tid)
+{
+	jbd2_fc_header_t *hdr = (jbd2_fc_header_t *)journal->j_fc_buf;
+	transaction_t *transaction;
+	transaction_t *committing;
+	tid_t committing_tid = 0;
+	int err;
+
+	if (!hdr)
+		return -EOPNOTSUPP;
+	if (is_journal_aborted(journal))
+		return -EROFS;
+
+	/*
+	 * A transaction that has already committed, or is no longer the
+	 * running one, needs no fast commit; don't wait on the log or lock
+	 * out updates just to find that out.
+	 */
+	spin_lock(&journal->j_state_lock);
+	transaction = journal->j_running_transaction;
+	if (tid_geq(journal->j_commit_sequence, tid) ||
+	    !transaction || transaction->t_tid != tid ||
+	    journal->j_commit_request == tid) {
+		spin_unlock(&journal->j_state_lock);
+		return -EAGAIN;
+	}
+	committing = journal->j_committing_transaction;
+	if (committing)
+		committing_tid = committing->t_tid;
+	spin_unlock(&journal->j_state_lock);
+	if (committing) {
+		err = jbd2_log_wait_commit(journal, committing_tid);
+		if (err)
+			return err;
+	}
+
+	mutex_lock(&journal->j_fc_mutex);
+	jbd2_journal_lock_updates(journal);
+
+	spin_lock(&journal->j_state_lock);
+	transaction = journal->j_running_transaction;
+	if (!transaction || transaction->t_tid != tid ||
+	    journal->j_committing_transaction ||
+	    journal->j_commit_request == tid) {
+		err = -EAGAIN;
+		goto out_unlock;
+	}
+	if (journal->j_fc_tid != tid) {
+		journal->j_fc_tid = tid;
+		journal->j_fc_off = 0;
+	}
+	if (journal->j_fc_first + journal->j_fc_off >= journal->j_fc_last) {
+		err = -ENOSPC;
+		goto out_unlock;
+	}
+	spin_unlock(&journal->j_state_lock);
+
+	memset(hdr, 0, sizeof(*hdr));
+	hdr->fc_header.h_magic = cpu_to_be32(JBD2_MAGIC_NUMBER);
+	hdr->fc_header.h_blocktype = cpu_to_be32(JBD2_FC_PATCH_BLOCK);
+	hdr->fc_header.h_sequence = cpu_to_be32(tid);
+	hdr->fc_seq = cpu_to_be32(journal->j_fc_off);
+	return 0;
+
+out_unlock:
+	journal->j_fc_fallbacks++;
+	spin_unlock(&journal->j_state_lock);
+	jbd2_journal_unlock_updates(journal);
+	mutex_unlock(&journal->j_fc_mutex);
+	return err;
+}
+
+/**
+ * int jbd2_fc_add_patch() - log a byte range of a filesystem block
+ * @journal: journal to act on
+ * @blocknr: filesystem block the bytes belong to
+ * @offset: offset of the bytes within the block
+ * @data: current contents of the range
+ * @len: length of the range
+ *
+ * Returns -ENOSPC if the patch does not fit in the fast commit block.
+ */
+int jbd2_fc_add_patch(journal_t *journal, unsigned long long blocknr,
+		      unsigned int offset, const void *data, unsigned int len)
+{
+	jbd2_fc_header_t *hdr = (jbd2_fc_header_t *)journal->j_fc_buf;
+	unsigned int pos = jbd2_fc_used(journal);
+	jbd2_fc_tag_t *tag;
+
+	if (offset + len > journal->j_blocksize ||
+	    pos + sizeof(*tag) + FC_ALIGN(len) > journal->j_blocksize)
+		return -ENOSPC;
+
+	tag = (jbd2_fc_tag_t *)(journal->j_fc_buf + pos);
+	tag->ft_blocknr = cpu_to_be32(blocknr & (u32)~0);
+	tag->ft_blocknr_high = cpu_to_be32((blocknr >> 31) >> 1);
+	tag->ft_offset = cpu_to_be16(offset);
+	tag->ft_len = cpu_to_be16(len);
+	memcpy(tag + 1, data, len);
+	be16_add_cpu(&hdr->fc_count, 1);
+	return 0;
+}
+
+static int jbd2_fc_write(journal_t *journal)
+{
+	jbd2_fc_header_t *hdr = (jbd2_fc_header_t *)journal->j_fc_buf;
+	unsigned long long blocknr;
+	struct buffer_head *bh;
+	int err;
+
+	if (!hdr->fc_count)
+		return 0;
+
+	memset(journal->j_fc_buf + jbd2_fc_used(journal), 0,
+	       journal->j_blocksize - jbd2_fc_used(journal));
+	hdr->fc_crc = cpu_to_be32(crc32_be(~0, (void *)journal->j_fc_buf,
+					   journal->j_blocksize));
+
+	err = jbd2_journal_bmap(journal, journal->j_fc_first + journal->j_fc_off,
+				&blocknr);
+	if (err)
+		return err;
+	bh = __getblk(journal->j_dev, blocknr, journal->j_blocksize);
+	if (!bh)
+		return -ENOMEM;
+
+	/*
+	 * The data the patches describe has been written by the caller, but
+	 * may still sit in the filesystem device's cache.
+	 */
+	if (journal->j_flags & JBD2_BARRIER)
+		blkdev_issue_flush(journal->j_fs_dev, NULL);
+
+	lock_buffer(bh);
+	memcpy(bh->b_data, journal->j_fc_buf, journal->j_blocksize);
+	set_buffer_uptodate(bh);
+	mark_buffer_dirty(bh);
+	unlock_buffer(bh);
+	sync_dirty_buffer(bh);
+	if (buffer_write_io_error(bh) || !buffer_uptodate(bh))
+		err = -EIO;
+	brelse(bh);
+	if (err)
+		return err;
+
+	if (journal->j_flags & JBD2_BARRIER)
+		blkdev_issue_flush(journal->j_dev, NULL);
+	journal->j_fc_off++;
+	return 0;
+}
+
+/**
+ * int jbd2_fc_end_commit() - write out a fast commit
+ * @journal: journal to act on
+ * @err: error the caller hit while adding patches, if any
+ *
+ * Lets updates run again and, unless @err is set, writes the fast commit
+ * block and waits for it to be durable.  A non-zero return means the
+ * caller has to fall back to a full commit.
+ */
+int jbd2_fc_end_commit(journal_t *journal, int err)
+{
+	jbd2_journal_unlock_updates(journal);
+
+	if (!err)
+		err = jbd2_fc_write(journal);
+	if (err)
+		journal->j_fc_fallbacks++;
+	else
+		journal->j_fc_commits++;
+
+	mutex_unlock(&journal->j_fc_mutex);
+	return err;
+}
+
+static int jbd2_fc_replay_block(journal_t *journal, char *buf)
+{
+	jbd2_fc_header_t *hdr = (jbd2_fc_header_t *)buf;
+	unsigned int pos = sizeof(jbd2_fc_header_t);
+	int i;
+
+	for (i = be16_to_cpu(hdr->fc_count); i > 0; i--) {
+		jbd2_fc_tag_t *tag = (jbd2_fc_tag_t *)(buf + pos);
+		unsigned int offset = be16_to_cpu(tag->ft_offset);
+		unsigned int len = be16_to_cpu(tag->ft_len);
+		unsigned long long blocknr;
+		struct buffer_head *bh;
+
+		pos += sizeof(*tag) + FC_ALIGN(len);
+		if (pos > journal->j_blocksize ||
+		    offset + len > journal->j_blocksize)
+			return -EIO;
+
+		blocknr = be32_to_cpu(tag->ft_blocknr) |
+			(unsigned long long)be32_to_cpu(tag->ft_blocknr_high) << 32;
+
+		bh = __bread(journal->j_fs_dev, blocknr, journal->j_blocksize);
+		if (!bh) {
+			printk(KERN_ERR "JBD: IO error reading fast commit "
+			       "target block %llu\n", blocknr);
+			return -EIO;
+		}
+		lock_buffer(bh);
+		memcpy(bh->b_data + offset, tag + 1, len);
+		mark_buffer_dirty(bh);
+		unlock_buffer(bh);
+		brelse(bh);
+	}
+	return 0;
+}
+
+/**
+ * int jbd2_fc_replay() - replay the fast commit area after recovery
+ * @journal: journal being recovered
+ * @tid: the first transaction which is not in the log
+ *
+ * Called once the log itself has been replayed.  Only fast commits of
+ * @tid are applied; anything older has been superseded by a full commit.
+ */
+int jbd2_fc_replay(journal_t *journal, tid_t tid)
+{
+	unsigned long next;
+	int replayed = 0;
+	int err = 0;
+	char *buf;
+
+	if (!JBD2_HAS_INCOMPAT_FEATURE(journal,
+				       JBD2_FEATURE_INCOMPAT_FC_PATCH))
+		return 0;
+
+	buf = kmalloc(journal->j_blocksize, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	for (next = journal->j_fc_first; next < journal->j_fc_last; next++) {
+		jbd2_fc_header_t *hdr = (jbd2_fc_header_t *)buf;
+		unsigned long long blocknr;
+		struct buffer_head *bh;
+		__u32 crc;
+
+		err = jbd2_journal_bmap(journal, next, &blocknr);
+		if (err)
+			break;
+		bh = __bread(journal->j_dev, blocknr, journal->j_blocksize);
+		if (!bh) {
+			err = -EIO;
+			break;
+		}
+		memcpy(buf, bh->b_data, journal->j_blocksize);
+		brelse(bh);
+
+		if (hdr->fc_header.h_magic != cpu_to_be32(JBD2_MAGIC_NUMBER) ||
+		    hdr->fc_header.h_blocktype !=
+				cpu_to_be32(JBD2_FC_PATCH_BLOCK) ||
+		    be32_to_cpu(hdr->fc_header.h_sequence) != tid ||
+		    be32_to_cpu(hdr->fc_seq) != next - journal->j_fc_first)
+			break;
+		crc = be32_to_cpu(hdr->fc_crc);
+		hdr->fc_crc = 0;
+		if (crc32_be(~0, (void *)buf, journal->j_blocksize) != crc) {
+			printk(KERN_WARNING "JBD: fast commit block %lu of "
+			       "transaction %u is torn, stopping replay\n",
+			       next - journal->j_fc_first, tid);
+			break;
+		}
+
+		err = jbd2_fc_replay_block(journal, buf);
+		if (err)
+			break;
+		replayed++;
+	}
+	kfree(buf);
+
+	jbd_debug(1, "JBD: replayed %d fast commit blocks of transaction %u\n",
+		  replayed, tid);
+	return err;
+}
@@ -66,6 +66,10 @@ EXPORT_SYMBOL(journal_sync_buffer);
 #endif
 EXPORT_SYMBOL(jbd2_journal_flush);
 EXPORT_SYMBOL(jbd2_journal_revoke);
+EXPORT_SYMBOL(jbd2_fc_init);
+EXPORT_SYMBOL(jbd2_fc_begin_commit);
+EXPORT_SYMBOL(jbd2_fc_add_patch);
+EXPORT_SYMBOL(jbd2_fc_end_commit);
 
 EXPORT_SYMBOL(jbd2_journal_init_dev);
 EXPORT_SYMBOL(jbd2_journal_init_inode);
@@ -219,6 +223,117 @@ end_loop:
 	return 0;
 }
 
+/*
+ * jbd2_checkpoint_wanted: should the background checkpoint thread run?
+ */
+static int jbd2_checkpoint_wanted(journal_t *journal, int shift)
+{
+	int ret;
+
+	spin_lock(&journal->j_state_lock);
+	ret = !is_journal_aborted(journal) &&
+		journal->j_checkpoint_transactions != NULL &&
+		jbd2_log_space_low(journal, shift);
+	spin_unlock(&journal->j_state_lock);
+	return ret;
+}
+
+static int jbd2_commit_done_since(journal_t *journal, tid_t seq)
+{
+	int ret;
+
+	spin_lock(&journal->j_state_lock);
+	ret = journal->j_commit_sequence != seq;
+	spin_unlock(&journal->j_state_lock);
+	return ret;
+}
+
+/*
+ * jbd2_checkpoint_thread: keep log space free ahead of demand.
+ *
+ * Without this, checkpointing only happens when start_this_handle() finds
+ * the log full, and every new handle then waits for the checkpoint I/O.
+ * This thread is woken by __jbd2_log_kick_checkpoint() once free space
+ * falls below the low watermark, and writes back the oldest transactions
+ * until the high watermark is reached.  It runs concurrently with commit,
+ * so checkpoint I/O overlaps the commit thread waiting on its log writes.
+ *
+ * j_checkpoint_mutex is dropped between transactions so that a handle
+ * which still ran out of space is not stuck behind a long background pass.
+ *
+ * If the oldest transaction cannot be checkpointed yet, free space stays
+ * below the low watermark and waiting on j_wait_checkpoint would return at
+ * once, so the thread waits for the next commit to complete instead.
+ */
+static int jbd2_checkpoint_thread(void *arg)
+{
+	journal_t *journal = arg;
+	transaction_t *transaction;
+	tid_t tid, seq;
+	int stalled;
+
+	set_freezable();
+
+	while (!kthread_should_stop()) {
+		wait_event_freezable(journal->j_wait_checkpoint,
+			kthread_should_stop() ||
+			jbd2_checkpoint_wanted(journal,
+					       JBD2_CHECKPOINT_LOW_SHIFT));
+		if (kthread_should_stop())
+			break;
+
+		stalled = 0;
+		while (!kthread_should_stop() &&
+		       jbd2_checkpoint_wanted(journal,
+					      JBD2_CHECKPOINT_HIGH_SHIFT)) {
+			mutex_lock(&journal->j_checkpoint_mutex);
+			spin_lock(&journal->j_list_lock);
+			transaction = journal->j_checkpoint_transactions;
+			tid = transaction ? transaction->t_tid : 0;
+			spin_unlock(&journal->j_list_lock);
+
+			if (transaction)
+				jbd2_log_do_checkpoint(journal);
+
+			spin_lock(&journal->j_list_lock);
+			if (journal->j_checkpoint_transactions == transaction &&
+			    transaction && transaction->t_tid == tid)
+				transaction = NULL;	/* no progress */
+			spin_unlock(&journal->j_list_lock);
+			mutex_unlock(&journal->j_checkpoint_mutex);
+
+			if (!transaction) {
+				stalled = 1;
+				break;
+			}
+
+			spin_lock(&journal->j_state_lock);
+			journal->j_bg_checkpoints++;
+			spin_unlock(&journal->j_state_lock);
+			cond_resched();
+		}
+
+		/* Checkpointed transactions only free log space once the
+		 * tail moves past them. */
+		mutex_lock(&journal->j_checkpoint_mutex);
+		jbd2_cleanup_journal_tail(journal);
+		mutex_unlock(&journal->j_checkpoint_mutex);
+
+		if (stalled && jbd2_checkpoint_wanted(journal,
+					JBD2_CHECKPOINT_LOW_SHIFT)) {
+			spin_lock(&journal->j_state_lock);
+			seq = journal->j_commit_sequence;
+			spin_unlock(&journal->j_state_lock);
+			wait_event_freezable(journal->j_wait_done_commit,
+				kthread_should_stop() ||
+				jbd2_commit_done_since(journal, seq));
+		}
+	}
+
+	jbd_debug(1, "Checkpoint thread exiting.\n");
+	return 0;
+}
+
 static int jbd2_journal_start_thread(journal_t *journal)
 {
 	struct task_struct *t;
@@ -229,11 +344,32 @@ static int jbd2_journal_start_thread(journal_t *journal)
 		return PTR_ERR(t);
 
 	wait_event(journal->j_wait_done_commit, journal->j_task != NULL);
+
+	/*
+	 * Background checkpointing is only an optimisation: handles still
+	 * checkpoint for themselves in __jbd2_log_wait_for_space().
+	 */
+	t = kthread_run(jbd2_checkpoint_thread, journal, "jbd2-ckpt/%s",
+			journal->j_devname);
+	if (IS_ERR(t))
+		printk(KERN_WARNING "JBD2: cannot start checkpoint thread "
+		       "for %s: %ld\n", journal->j_devname, PTR_ERR(t));
+	else
+		journal->j_checkpoint_task = t;
 	return 0;
 }
 
 static void journal_kill_thread(journal_t *journal)
 {
+	/*
+	 * Stop the checkpoint thread first: it may be waiting for a commit
+	 * which only kjournald2 can complete.
+	 */
+	if (journal->j_checkpoint_task) {
+		kthread_stop(journal->j_checkpoint_task);
+		journal->j_checkpoint_task = NULL;
+	}
+
 	spin_lock(&journal->j_state_lock);
 	journal->j_flags |= JBD2_UNMOUNT;
 
@@ -703,6 +839,14 @@ static int jbd2_seq_info_show(struct seq_file *seq, void *v)
 	seq_printf(seq, "%lu transaction, each up to %u blocks\n",
 			s->stats->ts_tid,
 			s->journal->j_max_transaction_buffers);
+	seq_printf(seq, "%lu background checkpoints, %lu waits for log space\n",
+		   s->journal->j_bg_checkpoints,
+		   s->journal->j_log_space_waits);
+	if (JBD2_HAS_INCOMPAT_FEATURE(s->journal,
+				      JBD2_FEATURE_INCOMPAT_FC_PATCH))
+		seq_printf(seq, "%lu fast commits, %lu fell back to full "
+			   "commits\n", s->journal->j_fc_commits,
+			   s->journal->j_fc_fallbacks);
 	if (s->stats->ts_tid == 0)
 		return 0;
 	seq_printf(seq, "average: \n  %ums waiting for transaction\n",
@@ -829,6 +973,7 @@ static journal_t * journal_init_common (void)
 	init_waitqueue_head(&journal->j_wait_updates);
 	mutex_init(&journal->j_barrier);
 	mutex_init(&journal->j_checkpoint_mutex);
+	mutex_init(&journal->j_fc_mutex);
 	spin_lock_init(&journal->j_revoke_lock);
 	spin_lock_init(&journal->j_list_lock);
 	spin_lock_init(&journal->j_state_lock);
@@ -1013,6 +1158,24 @@ static void journal_fail_superblock (journal_t *journal)
 	journal->j_sb_buffer = NULL;
 }
 
+/*
+ * The fast commit area, if any, takes the last s_fc_patch_blks blocks of
+ * the journal; the circular log ends where it begins.
+ */
+static void journal_set_fc_area(journal_t *journal)
+{
+	journal_superblock_t *sb = journal->j_superblock;
+	unsigned long num_fc = 0;
+
+	if (JBD2_HAS_INCOMPAT_FEATURE(journal,
+				      JBD2_FEATURE_INCOMPAT_FC_PATCH))
+		num_fc = be32_to_cpu(sb->s_fc_patch_blks);
+
+	journal->j_fc_last = be32_to_cpu(sb->s_maxlen);
+	journal->j_fc_first = journal->j_fc_last - num_fc;
+	journal->j_last = journal->j_fc_first;
+}
+
 /*
  * Given a journal_t structure, initialise the various fields for
  * startup of a new journaling session.  We use this both when creating
@@ -1025,8 +1188,9 @@ static int journal_reset(journal_t *journal)
 	journal_superblock_t *sb = journal->j_superblock;
 	unsigned long long first, last;
 
+	journal_set_fc_area(journal);
 	first = be32_to_cpu(sb->s_first);
-	last = be32_to_cpu(sb->s_maxlen);
+	last = journal->j_fc_first;
 	if (first + JBD2_MIN_JOURNAL_BLOCKS > last + 1) {
 		printk(KERN_ERR "JBD: Journal too short (blocks %llu-%llu).\n",
 		       first, last);
@@ -1212,9 +1376,18 @@ static int load_superblock(journal_t *journal)
 	journal->j_tail_sequence = be32_to_cpu(sb->s_sequence);
 	journal->j_tail = be32_to_cpu(sb->s_start);
 	journal->j_first = be32_to_cpu(sb->s_first);
-	journal->j_last = be32_to_cpu(sb->s_maxlen);
+	journal_set_fc_area(journal);
 	journal->j_errno = be32_to_cpu(sb->s_errno);
 
+	if (journal->j_last > journal->j_fc_last ||
+	    journal->j_first + JBD2_MIN_JOURNAL_BLOCKS > journal->j_last) {
+		printk(KERN_WARNING "JBD: journal fast commit area too large "
+		       "(%lu of %u blocks)\n",
+		       journal->j_fc_last - journal->j_fc_first,
+		       be32_to_cpu(sb->s_maxlen));
+		return -EINVAL;
+	}
+
 	return 0;
 }
 
@@ -1341,6 +1514,7 @@ int jbd2_journal_destroy(journal_t *journal)
 	if (journal->j_revoke)
 		jbd2_journal_destroy_revoke(journal);
 	kfree(journal->j_wbuf);
+	kfree(journal->j_fc_buf);
 	kfree(journal);
 
 	return err;
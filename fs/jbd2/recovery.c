@@ -243,7 +243,15 @@ int jbd2_journal_recover(journal_t *journal)
 		jbd_debug(1, "No recovery required, last transaction %d\n",
 			  be32_to_cpu(sb->s_sequence));
 		journal->j_transaction_sequence = be32_to_cpu(sb->s_sequence) + 1;
-		return 0;
+		/*
+		 * A fast commit may have been written for the first
+		 * transaction after the log was last emptied.
+		 */
+		err = jbd2_fc_replay(journal, be32_to_cpu(sb->s_sequence));
+		err2 = sync_blockdev(journal->j_fs_dev);
+		if (!err)
+			err = err2;
+		return err;
 	}
 
 	err = do_one_pass(journal, &info, PASS_SCAN);
@@ -251,6 +259,8 @@ int jbd2_journal_recover(journal_t *journal)
 		err = do_one_pass(journal, &info, PASS_REVOKE);
 	if (!err)
 		err = do_one_pass(journal, &info, PASS_REPLAY);
+	if (!err)
+		err = jbd2_fc_replay(journal, info.end_transaction);
 
 	jbd_debug(1, "JBD: recovery, exit status %d, "
 		  "recovered transactions %u to %u\n",
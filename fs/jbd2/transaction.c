@@ -215,10 +215,12 @@ repeat_locked:
 	 */
 	if (__jbd2_log_space_left(journal) < jbd_space_needed(journal)) {
 		jbd_debug(2, "Handle %p waiting for checkpoint...\n", handle);
+		journal->j_log_space_waits++;
 		spin_unlock(&transaction->t_handle_lock);
 		__jbd2_log_wait_for_space(journal);
 		goto repeat_locked;
 	}
+	__jbd2_log_kick_checkpoint(journal);
 
 	/* OK, account for the buffers that this operation expects to
 	 * use and add the handle to the running transaction. */
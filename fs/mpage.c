@@ -381,27 +381,39 @@ mpage_readpages(struct address_space *mapping, struct list_head *pages,
 				unsigned nr_pages, get_block_t get_block)
 {
 	struct bio *bio = NULL;
+	struct pagevec pvec;
 	unsigned page_idx;
 	sector_t last_block_in_bio = 0;
 	struct buffer_head map_bh;
 	unsigned long first_logical_block = 0;
+	int i;
 
 	map_bh.b_state = 0;
 	map_bh.b_size = 0;
+	pagevec_init(&pvec, 1);
 	for (page_idx = 0; page_idx < nr_pages; page_idx++) {
 		struct page *page = list_entry(pages->prev, struct page, lru);
 
 		prefetchw(&page->flags);
 		list_del(&page->lru);
-		if (!add_to_page_cache_lru(page, mapping,
-					page->index, GFP_KERNEL)) {
-			bio = do_mpage_readpage(bio, page,
-					nr_pages - page_idx,
+		if (pagevec_add(&pvec, page) && page_idx + 1 < nr_pages)
+			continue;
+
+		/*
+		 * Insert the whole run into the pagecache at once, then map
+		 * and submit it.  The remaining count passed down is only a
+		 * hint for how far ahead get_block() may map.
+		 */
+		add_to_page_cache_lru_batch(mapping, &pvec, GFP_KERNEL);
+		for (i = 0; i < pagevec_count(&pvec); i++) {
+			bio = do_mpage_readpage(bio, pvec.pages[i],
+					nr_pages - page_idx - 1 +
+						pagevec_count(&pvec) - i,
 					&last_block_in_bio, &map_bh,
 					&first_logical_block,
 					get_block);
 		}
-		page_cache_release(page);
+		pagevec_release(&pvec);
 	}
 	BUG_ON(!list_empty(pages));
 	if (bio)
@@ -466,6 +466,139 @@ ok:
 	return security_inode_permission(inode, MAY_EXEC);
 }
 
+/*
+ * The MAY_EXEC check of exec_permission_lite() for the lockless path walk.
+ * Only the DAC bits are looked at, anything that would need a call into
+ * the filesystem, the ACL code or a security module returns -EAGAIN and
+ * is left to the normal walk, which also produces the real error.
+ */
+static int exec_permission_rcu(struct inode *inode)
+{
+#ifdef CONFIG_SECURITY
+	return -EAGAIN;
+#else
+	if (inode->i_op->permission)
+		return -EAGAIN;
+	if (IS_POSIXACL(inode) && inode->i_op->check_acl)
+		return -EAGAIN;
+	if (acl_permission_check(inode, MAY_EXEC, NULL))
+		return -EAGAIN;
+	return 0;
+#endif
+}
+
+/*
+ * Inodes of @sb are freed after an RCU grace period, see destroy_inode().
+ */
+static inline int rcu_walk_sb(struct super_block *sb)
+{
+	return !sb->s_op->destroy_inode ||
+		(sb->s_type->fs_flags & FS_RCU_INODES);
+}
+
+/*
+ * Lockless path walk.
+ *
+ * Walk as many intermediate components of @name as possible under
+ * rcu_read_lock(), without taking dentry references, d_lock or
+ * dcache_lock.  Every step is validated against the d_seq of the parent
+ * and of the child.  The walk stops at anything it cannot handle this way:
+ * the last component, "." and "..", names that are not in the dcache or
+ * need ->d_revalidate, ->d_hash or ->d_compare, mountpoints, symlinks and
+ * directories that need more than a DAC permission check.
+ *
+ * The dentry the walk stopped at is then pinned if its d_seq is unchanged
+ * and replaces nd->path.dentry (the walk never leaves nd->path.mnt).  If it
+ * has changed, nothing is done and the caller walks the same components
+ * again the refcounted way.
+ *
+ * Returns the first component that still has to be looked up.
+ */
+static const char *rcu_walk_components(const char *name, struct nameidata *nd)
+{
+	struct dentry *old = nd->path.dentry;
+	struct dentry *parent = old;
+	struct inode *inode = parent->d_inode;
+	const char *start = name, *walked = name;
+	unsigned seq, parent_seq;
+
+	if (!rcu_walk_sb(parent->d_sb))
+		return name;
+
+	rcu_read_lock();
+	parent_seq = read_seqcount_begin(&parent->d_seq);
+	for (;;) {
+		struct dentry *dentry;
+		unsigned long hash;
+		struct qstr this;
+		unsigned int c;
+
+		if (parent->d_op &&
+		    (parent->d_op->d_hash || parent->d_op->d_compare))
+			break;
+		if (exec_permission_rcu(inode))
+			break;
+
+		this.name = name;
+		c = *(const unsigned char *)name;
+
+		hash = init_name_hash();
+		do {
+			name++;
+			hash = partial_name_hash(c, hash);
+			c = *(const unsigned char *)name;
+		} while (c && (c != '/'));
+		this.len = name - (const char *) this.name;
+		this.hash = end_name_hash(hash);
+
+		/* The last component is always looked up the usual way */
+		if (!c)
+			break;
+		while (*++name == '/');
+		if (!*name)
+			break;
+		if (this.name[0] == '.' && (this.len == 1 ||
+				(this.len == 2 && this.name[1] == '.')))
+			break;
+
+		dentry = __d_lookup_rcu(parent, &this, &seq);
+		if (!dentry)
+			break;
+		if (dentry->d_op && dentry->d_op->d_revalidate)
+			break;
+		if (d_mountpoint(dentry))
+			break;
+		inode = dentry->d_inode;
+		if (read_seqcount_retry(&dentry->d_seq, seq))
+			break;
+		if (!inode || inode->i_op->follow_link || !inode->i_op->lookup)
+			break;
+		/* @dentry was found in @parent, make sure it still is */
+		if (read_seqcount_retry(&parent->d_seq, parent_seq))
+			break;
+
+		parent = dentry;
+		parent_seq = seq;
+		walked = name;
+	}
+
+	if (parent != old) {
+		spin_lock(&parent->d_lock);
+		if (!read_seqcount_retry(&parent->d_seq, parent_seq) &&
+		    !d_unhashed(parent)) {
+			atomic_inc(&parent->d_count);
+			nd->path.dentry = parent;
+		}
+		spin_unlock(&parent->d_lock);
+	}
+	rcu_read_unlock();
+
+	if (nd->path.dentry == old)
+		return start;
+	dput(old);
+	return walked;
+}
+
 /*
  * This is called when everything else fails, and we actually have
  * to go to the low-level filesystem to find out what we should do..
@@ -870,6 +1003,10 @@ static int __link_path_walk(const char *name, struct nameidata *nd)
 		unsigned int c;
 
 		nd->flags |= LOOKUP_CONTINUE;
+
+		name = rcu_walk_components(name, nd);
+		inode = nd->path.dentry->d_inode;
+
 		err = exec_permission_lite(inode);
  		if (err)
 			break;
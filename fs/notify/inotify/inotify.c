@@ -41,7 +41,7 @@ static atomic_t inotify_cookie;
  *
  * dentry->d_lock (used to keep d_move() away from dentry->d_parent)
  * iprune_mutex (synchronize shrink_icache_memory())
- * 	inode_lock (protects the super_block->s_inodes list)
+ * 	inode_lock, sb->s_inodes_lock (protects the super_block->s_inodes list)
  * 	inode->inotify_mutex (protects inode->inotify_watches and watches->i_list)
  * 		inotify_handle->mutex (protects inotify_handle and watches->h_list)
  *
@@ -367,15 +367,17 @@ EXPORT_SYMBOL_GPL(inotify_get_cookie);
  * inotify_unmount_inodes - an sb is unmounting.  handle any watched inodes.
  * @list: list of inodes being unmounted (sb->s_inodes)
  *
- * Called with inode_lock held, protecting the unmounting super block's list
- * of inodes, and with iprune_mutex held, keeping shrink_icache_memory() at bay.
- * We temporarily drop inode_lock, however, and CAN block.
+ * Called with inode_lock and the unmounting super block's s_inodes_lock held,
+ * the latter protecting its list of inodes, and with iprune_mutex held,
+ * keeping shrink_icache_memory() at bay.  We temporarily drop both locks,
+ * however, and CAN block.
  */
 void inotify_unmount_inodes(struct list_head *list)
 {
 	struct inode *inode, *next_i, *need_iput = NULL;
 
 	list_for_each_entry_safe(inode, next_i, list, i_sb_list) {
+		struct super_block *sb = inode->i_sb;
 		struct inotify_watch *watch, *next_w;
 		struct inode *need_iput_tmp;
 		struct list_head *watches;
@@ -414,11 +416,12 @@ void inotify_unmount_inodes(struct list_head *list)
 		}
 
 		/*
-		 * We can safely drop inode_lock here because we hold
+		 * We can safely drop the locks here because we hold
 		 * references on both inode and next_i.  Also no new inodes
 		 * will be added since the umount has begun.  Finally,
 		 * iprune_mutex keeps shrink_icache_memory() away.
 		 */
+		spin_unlock(&sb->s_inodes_lock);
 		spin_unlock(&inode_lock);
 
 		if (need_iput_tmp)
@@ -441,6 +444,7 @@ void inotify_unmount_inodes(struct list_head *list)
 		iput(inode);		
 
 		spin_lock(&inode_lock);
+		spin_lock(&sb->s_inodes_lock);
 	}
 }
 EXPORT_SYMBOL_GPL(inotify_unmount_inodes);
@@ -0,0 +1,327 @@
+/*
+ * Squashfs - a compressed read only filesystem for Linux
+ *
+ * Copyright (c) 2002, 2003, 2004, 2005, 2006, 2007, 2008
+ * Phillip Lougher <phillip@lougher.demon.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * decompressor.c
+ */
+
+/*
+ * This file implements the decompressor lookup and the management of
+ * decompressor streams.  The decompressor is selected by the compression
+ * id in the superblock.  A filesystem can be mounted with one of three
+ * stream modes (threads= mount option):
+ *
+ * single: one stream shared by all readers, serialised by a mutex.  This
+ *	   uses the least memory but decompresses one block at a time.
+ *
+ * multi:  a pool of streams, one per online CPU.  Streams are created on
+ *	   demand and readers wait for a free one once the pool is full.
+ *
+ * percpu: one stream per possible CPU.  Decompression runs with
+ *	   preemption disabled on the local CPU's stream, so no locking is
+ *	   needed but every CPU pays for a workspace up front.
+ */
+
+#include <linux/fs.h>
+#include <linux/vfs.h>
+#include <linux/slab.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+#include <linux/percpu.h>
+#include <linux/cpumask.h>
+#include <linux/buffer_head.h>
+
+#include "squashfs_fs.h"
+#include "squashfs_fs_sb.h"
+#include "squashfs_fs_i.h"
+#include "squashfs.h"
+#include "decompressor.h"
+
+/*
+ * This table lists the compressors squashfs knows about.  Entries that are
+ * not built into this kernel are kept so that a sensible error can be given
+ * when mounting a filesystem that uses them.
+ */
+static const struct squashfs_decompressor squashfs_lzma_unsupported_comp_ops = {
+	NULL, NULL, NULL, LZMA_COMPRESSION, "lzma", 0
+};
+
+#ifndef CONFIG_SQUASHFS_LZO
+static const struct squashfs_decompressor squashfs_lzo_comp_ops = {
+	NULL, NULL, NULL, LZO_COMPRESSION, "lzo", 0
+};
+#endif
+
+static const struct squashfs_decompressor squashfs_xz_unsupported_comp_ops = {
+	NULL, NULL, NULL, XZ_COMPRESSION, "xz", 0
+};
+
+static const struct squashfs_decompressor squashfs_unknown_comp_ops = {
+	NULL, NULL, NULL, 0, "unknown", 0
+};
+
+static const struct squashfs_decompressor *decompressor[] = {
+	&squashfs_zlib_comp_ops,
+	&squashfs_lzma_unsupported_comp_ops,
+	&squashfs_lzo_comp_ops,
+	&squashfs_xz_unsupported_comp_ops,
+	&squashfs_unknown_comp_ops
+};
+
+
+const struct squashfs_decompressor *squashfs_lookup_decompressor(int id)
+{
+	int i;
+
+	for (i = 0; decompressor[i]->id; i++)
+		if (id == decompressor[i]->id)
+			break;
+
+	return decompressor[i];
+}
+
+
+struct squashfs_stream {
+	void			*stream;
+	struct list_head	list;
+};
+
+struct squashfs_streams {
+	/* SQUASHFS_THREADS_SINGLE */
+	struct mutex		mutex;
+	struct squashfs_stream	*single;
+	/* SQUASHFS_THREADS_MULTI */
+	spinlock_t		lock;
+	struct list_head	idle;
+	int			avail;
+	int			max;
+	wait_queue_head_t	wait;
+	/* SQUASHFS_THREADS_PERCPU */
+	struct squashfs_stream	*percpu;
+};
+
+
+static struct squashfs_stream *squashfs_stream_alloc(
+	struct squashfs_sb_info *msblk)
+{
+	struct squashfs_stream *strm = kmalloc(sizeof(*strm), GFP_KERNEL);
+
+	if (strm == NULL)
+		return NULL;
+
+	strm->stream = msblk->decompressor->init(msblk);
+	if (strm->stream == NULL) {
+		kfree(strm);
+		return NULL;
+	}
+
+	return strm;
+}
+
+
+static void squashfs_stream_free(struct squashfs_sb_info *msblk,
+	struct squashfs_stream *strm)
+{
+	if (strm) {
+		msblk->decompressor->free(strm->stream);
+		kfree(strm);
+	}
+}
+
+
+/*
+ * Return the maximum number of blocks that can be decompressed at the
+ * same time.
+ */
+int squashfs_max_decompressors(struct squashfs_sb_info *msblk)
+{
+	if (msblk->threads == SQUASHFS_THREADS_SINGLE)
+		return 1;
+
+	return num_online_cpus();
+}
+
+
+int squashfs_decompressor_create(struct squashfs_sb_info *msblk)
+{
+	struct squashfs_streams *s;
+	struct squashfs_stream *strm;
+	int cpu;
+
+	s = kzalloc(sizeof(*s), GFP_KERNEL);
+	if (s == NULL)
+		return -ENOMEM;
+
+	mutex_init(&s->mutex);
+	spin_lock_init(&s->lock);
+	INIT_LIST_HEAD(&s->idle);
+	init_waitqueue_head(&s->wait);
+	msblk->streams = s;
+
+	switch (msblk->threads) {
+	case SQUASHFS_THREADS_MULTI:
+		/* Start with one stream, the rest are created on demand */
+		strm = squashfs_stream_alloc(msblk);
+		if (strm == NULL)
+			goto failed;
+		list_add(&strm->list, &s->idle);
+		s->avail = 1;
+		s->max = squashfs_max_decompressors(msblk);
+		break;
+	case SQUASHFS_THREADS_PERCPU:
+		s->percpu = alloc_percpu(struct squashfs_stream);
+		if (s->percpu == NULL)
+			goto failed;
+		for_each_possible_cpu(cpu) {
+			strm = per_cpu_ptr(s->percpu, cpu);
+			strm->stream = msblk->decompressor->init(msblk);
+			if (strm->stream == NULL)
+				goto failed;
+		}
+		break;
+	default:
+		s->single = squashfs_stream_alloc(msblk);
+		if (s->single == NULL)
+			goto failed;
+	}
+
+	return 0;
+
+failed:
+	squashfs_decompressor_destroy(msblk);
+	return -ENOMEM;
+}
+
+
+void squashfs_decompressor_destroy(struct squashfs_sb_info *msblk)
+{
+	struct squashfs_streams *s = msblk->streams;
+	struct squashfs_stream *strm;
+	int cpu;
+
+	if (s == NULL)
+		return;
+
+	while (!list_empty(&s->idle)) {
+		strm = list_entry(s->idle.next, struct squashfs_stream, list);
+		list_del(&strm->list);
+		squashfs_stream_free(msblk, strm);
+	}
+
+	if (s->percpu) {
+		for_each_possible_cpu(cpu)
+			msblk->decompressor->free(
+				per_cpu_ptr(s->percpu, cpu)->stream);
+		free_percpu(s->percpu);
+	}
+
+	squashfs_stream_free(msblk, s->single);
+	kfree(s);
+	msblk->streams = NULL;
+}
+
+
+/*
+ * Get an idle stream from the pool, creating a new one if the pool has
+ * not reached its maximum size, otherwise wait for one to be released.
+ */
+static struct squashfs_stream *get_stream(struct squashfs_sb_info *msblk,
+	struct squashfs_streams *s)
+{
+	struct squashfs_stream *strm;
+
+	while (1) {
+		spin_lock(&s->lock);
+		if (!list_empty(&s->idle)) {
+			strm = list_entry(s->idle.next, struct squashfs_stream,
+				list);
+			list_del(&strm->list);
+			spin_unlock(&s->lock);
+			return strm;
+		}
+
+		if (s->avail < s->max) {
+			s->avail++;
+			spin_unlock(&s->lock);
+
+			strm = squashfs_stream_alloc(msblk);
+			if (strm)
+				return strm;
+
+			/*
+			 * Out of memory, fall back to waiting for one of the
+			 * existing streams.  There is always at least one.
+			 */
+			spin_lock(&s->lock);
+			s->avail--;
+		}
+		spin_unlock(&s->lock);
+
+		wait_event(s->wait, !list_empty(&s->idle));
+	}
+}
+
+
+static void put_stream(struct squashfs_streams *s,
+	struct squashfs_stream *strm)
+{
+	spin_lock(&s->lock);
+	list_add(&strm->list, &s->idle);
+	spin_unlock(&s->lock);
+	wake_up(&s->wait);
+}
+
+
+/*
+ * Decompress the block held in buffer_heads bh[0..b) into the page sized
+ * buffers handed out by @output.  The buffer_heads must be uptodate.
+ * Returns the decompressed length or -EIO.
+ */
+int squashfs_decompress(struct squashfs_sb_info *msblk,
+	struct squashfs_page_actor *output, struct buffer_head **bh, int b,
+	int offset, int length, int srclength)
+{
+	struct squashfs_streams *s = msblk->streams;
+	struct squashfs_stream *strm;
+	int res;
+
+	switch (msblk->threads) {
+	case SQUASHFS_THREADS_MULTI:
+		strm = get_stream(msblk, s);
+		res = msblk->decompressor->decompress(msblk, strm->stream,
+			output, bh, b, offset, length, srclength);
+		put_stream(s, strm);
+		break;
+	case SQUASHFS_THREADS_PERCPU:
+		strm = per_cpu_ptr(s->percpu, get_cpu());
+		res = msblk->decompressor->decompress(msblk, strm->stream,
+			output, bh, b, offset, length, srclength);
+		put_cpu();
+		break;
+	default:
+		mutex_lock(&s->mutex);
+		res = msblk->decompressor->decompress(msblk, s->single->stream,
+			output, bh, b, offset, length, srclength);
+		mutex_unlock(&s->mutex);
+	}
+
+	return res;
+}
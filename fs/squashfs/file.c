@@ -53,6 +53,7 @@
 #include "squashfs_fs_sb.h"
 #include "squashfs_fs_i.h"
 #include "squashfs.h"
+#include "page_actor.h"
 
 /*
  * Locate cache slot in range [offset, index] for specified inode.  If
@@ -372,6 +373,101 @@ static int read_blocklist(struct inode *inode, int index, u64 *block)
 }
 
 
+/*
+ * Decompress a datablock straight into the page cache pages it covers,
+ * avoiding the intermediate read_page cache and the copy out of it.  This
+ * is only possible if all the pages of the block can be grabbed and none
+ * are already uptodate, otherwise -EAGAIN is returned and the caller falls
+ * back to reading through the cache.  On success @page has been filled
+ * and unlocked.
+ *
+ * The pages are filled through a page actor, which maps only the page
+ * being written at any time.
+ */
+static int squashfs_readpage_block(struct page *page, u64 block, int bsize)
+{
+	struct inode *inode = page->mapping->host;
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int mask = (1 << (msblk->block_log - PAGE_CACHE_SHIFT)) - 1;
+	int start_index = page->index & ~mask;
+	int end_index = start_index | mask;
+	int file_pages = (i_size_read(inode) + PAGE_CACHE_SIZE - 1) >>
+				PAGE_CACHE_SHIFT;
+	int i, n, pages, res = -EAGAIN, bytes;
+	struct page **page_array;
+	struct squashfs_page_actor actor;
+	void *pageaddr;
+
+	if (end_index >= file_pages)
+		end_index = file_pages - 1;
+	pages = end_index - start_index + 1;
+
+	/* Out of memory is no reason to fail the read, use the cache */
+	page_array = kcalloc(pages, sizeof(*page_array), GFP_KERNEL);
+	if (page_array == NULL)
+		return -EAGAIN;
+
+	/*
+	 * Grab the pages, giving up on the direct path if any of them is
+	 * missing or has already been read in.
+	 */
+	for (i = 0, n = start_index; n <= end_index; i++, n++) {
+		page_array[i] = (n == page->index) ? page :
+			grab_cache_page_nowait(page->mapping, n);
+
+		if (page_array[i] == NULL)
+			goto release_pages;
+
+		if (PageUptodate(page_array[i])) {
+			if (page_array[i] != page) {
+				unlock_page(page_array[i]);
+				page_cache_release(page_array[i]);
+			}
+			page_array[i] = NULL;
+			goto release_pages;
+		}
+	}
+
+	squashfs_actor_init_pages(&actor, page_array, pages);
+	res = squashfs_read_data(inode->i_sb, &actor, block, bsize, NULL,
+			msblk->block_size);
+	if (res < 0)
+		goto release_pages;
+
+	for (i = 0, bytes = res; i < pages; i++, bytes -= PAGE_CACHE_SIZE) {
+		int avail = clamp_t(int, bytes, 0, PAGE_CACHE_SIZE);
+
+		if (avail < PAGE_CACHE_SIZE) {
+			pageaddr = kmap_atomic(page_array[i], KM_USER0);
+			memset(pageaddr + avail, 0, PAGE_CACHE_SIZE - avail);
+			kunmap_atomic(pageaddr, KM_USER0);
+		}
+		flush_dcache_page(page_array[i]);
+		SetPageUptodate(page_array[i]);
+		unlock_page(page_array[i]);
+		if (page_array[i] != page)
+			page_cache_release(page_array[i]);
+	}
+
+	kfree(page_array);
+	return 0;
+
+release_pages:
+	/*
+	 * Leave @page locked for the caller, it either falls back to the
+	 * cache or zeroes and errors the page
+	 */
+	for (i = 0; i < pages && page_array[i]; i++) {
+		if (page_array[i] != page) {
+			unlock_page(page_array[i]);
+			page_cache_release(page_array[i]);
+		}
+	}
+	kfree(page_array);
+	return res;
+}
+
+
 static int squashfs_readpage(struct file *file, struct page *page)
 {
 	struct inode *inode = page->mapping->host;
@@ -411,8 +507,18 @@ static int squashfs_readpage(struct file *file, struct page *page)
 			sparse = 1;
 		} else {
 			/*
-			 * Read and decompress datablock.
+			 * Read and decompress datablock, directly into the
+			 * page cache if possible.
 			 */
+			int res = squashfs_readpage_block(page, block, bsize);
+			if (res == 0)
+				return 0;
+			if (res != -EAGAIN) {
+				ERROR("Unable to read page, block %llx, size %x"
+					"\n", block, bsize);
+				goto error_out;
+			}
+
 			buffer = squashfs_get_datablock(inode->i_sb,
 								block, bsize);
 			if (buffer->error) {
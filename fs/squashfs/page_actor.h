@@ -0,0 +1,92 @@
+#ifndef PAGE_ACTOR_H
+#define PAGE_ACTOR_H
+/*
+ * Squashfs - a compressed read only filesystem for Linux
+ *
+ * Copyright (c) 2002, 2003, 2004, 2005, 2006, 2007, 2008
+ * Phillip Lougher <phillip@lougher.demon.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * page_actor.h
+ */
+
+#include <linux/highmem.h>
+
+/*
+ * A page actor hands the output of a block to squashfs_read_data() and
+ * the decompressors one page sized buffer at a time.  The buffers are
+ * either kernel addresses (cache entries and tables), or page cache pages
+ * which are only mapped with kmap_atomic() while they are being filled.
+ * A reader therefore never holds more than one highmem mapping, however
+ * many pages the block spans.
+ */
+struct squashfs_page_actor {
+	void		**buffer;
+	struct page	**page;
+	void		*pageaddr;
+	int		pages;
+	int		next_page;
+};
+
+static inline void squashfs_actor_init(struct squashfs_page_actor *actor,
+	void **buffer, int pages)
+{
+	actor->buffer = buffer;
+	actor->page = NULL;
+	actor->pageaddr = NULL;
+	actor->pages = pages;
+	actor->next_page = 0;
+}
+
+static inline void squashfs_actor_init_pages(struct squashfs_page_actor *actor,
+	struct page **page, int pages)
+{
+	actor->buffer = NULL;
+	actor->page = page;
+	actor->pageaddr = NULL;
+	actor->pages = pages;
+	actor->next_page = 0;
+}
+
+/* Release the mapping of the page being filled, if any */
+static inline void squashfs_finish_page(struct squashfs_page_actor *actor)
+{
+	if (actor->pageaddr) {
+		kunmap_atomic(actor->pageaddr, KM_USER0);
+		actor->pageaddr = NULL;
+	}
+}
+
+/* Returns the next output buffer, or NULL once all have been used */
+static inline void *squashfs_next_page(struct squashfs_page_actor *actor)
+{
+	squashfs_finish_page(actor);
+	if (actor->next_page == actor->pages)
+		return NULL;
+	if (actor->buffer)
+		return actor->buffer[actor->next_page++];
+	actor->pageaddr = kmap_atomic(actor->page[actor->next_page++],
+								KM_USER0);
+	return actor->pageaddr;
+}
+
+static inline void *squashfs_first_page(struct squashfs_page_actor *actor)
+{
+	squashfs_finish_page(actor);
+	actor->next_page = 0;
+	return squashfs_next_page(actor);
+}
+#endif
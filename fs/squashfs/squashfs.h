@@ -32,9 +32,21 @@ static inline struct squashfs_inode_info *squashfs_i(struct inode *inode)
 	return list_entry(inode, struct squashfs_inode_info, vfs_inode);
 }
 
+struct squashfs_page_actor;
+
 /* block.c */
-extern int squashfs_read_data(struct super_block *, void **, u64, int, u64 *,
-				int, int);
+extern int squashfs_read_data(struct super_block *,
+				struct squashfs_page_actor *, u64, int, u64 *,
+				int);
+
+/* decompressor.c */
+extern const struct squashfs_decompressor *squashfs_lookup_decompressor(int);
+extern int squashfs_decompressor_create(struct squashfs_sb_info *);
+extern void squashfs_decompressor_destroy(struct squashfs_sb_info *);
+extern int squashfs_decompress(struct squashfs_sb_info *,
+				struct squashfs_page_actor *,
+				struct buffer_head **, int, int, int, int);
+extern int squashfs_max_decompressors(struct squashfs_sb_info *);
 
 /* cache.c */
 extern struct squashfs_cache *squashfs_cache_init(char *, int, int);
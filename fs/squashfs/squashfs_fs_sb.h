@@ -51,6 +51,14 @@ struct squashfs_cache_entry {
 	void			**data;
 };
 
+/* Decompressor parallelisation, selected with the threads= mount option */
+#define SQUASHFS_THREADS_SINGLE		0
+#define SQUASHFS_THREADS_MULTI		1
+#define SQUASHFS_THREADS_PERCPU		2
+
+struct squashfs_streams;
+struct squashfs_decompressor;
+
 struct squashfs_sb_info {
 	int			devblksize;
 	int			devblksize_log2;
@@ -61,10 +69,11 @@ struct squashfs_sb_info {
 	__le64			*id_table;
 	__le64			*fragment_index;
 	unsigned int		*fragment_index_2;
-	struct mutex		read_data_mutex;
 	struct mutex		meta_index_mutex;
 	struct meta_index	*meta_index;
-	z_stream		stream;
+	const struct squashfs_decompressor *decompressor;
+	int			threads;
+	struct squashfs_streams	*streams;
 	__le64			*inode_lookup_table;
 	u64			inode_table;
 	u64			directory_table;
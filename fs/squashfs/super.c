@@ -37,16 +37,79 @@
 #include <linux/module.h>
 #include <linux/zlib.h>
 #include <linux/magic.h>
+#include <linux/parser.h>
+#include <linux/seq_file.h>
+#include <linux/mount.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
 #include "squashfs_fs_i.h"
 #include "squashfs.h"
+#include "decompressor.h"
 
 static struct file_system_type squashfs_fs_type;
 static const struct super_operations squashfs_super_ops;
 
-static int supported_squashfs_filesystem(short major, short minor, short comp)
+#if defined(CONFIG_SQUASHFS_DECOMP_MULTI_PERCPU)
+#define SQUASHFS_THREADS_DEFAULT	SQUASHFS_THREADS_PERCPU
+#elif defined(CONFIG_SQUASHFS_DECOMP_MULTI)
+#define SQUASHFS_THREADS_DEFAULT	SQUASHFS_THREADS_MULTI
+#else
+#define SQUASHFS_THREADS_DEFAULT	SQUASHFS_THREADS_SINGLE
+#endif
+
+enum {
+	Opt_threads_single, Opt_threads_multi, Opt_threads_percpu, Opt_err
+};
+
+static const match_table_t tokens = {
+	{Opt_threads_single, "threads=single"},
+	{Opt_threads_multi, "threads=multi"},
+	{Opt_threads_percpu, "threads=percpu"},
+	{Opt_err, NULL}
+};
+
+static const char *threads_names[] = {
+	[SQUASHFS_THREADS_SINGLE] = "single",
+	[SQUASHFS_THREADS_MULTI] = "multi",
+	[SQUASHFS_THREADS_PERCPU] = "percpu",
+};
+
+static int squashfs_parse_options(char *options, int *threads)
+{
+	substring_t args[MAX_OPT_ARGS];
+	char *p;
+
+	*threads = SQUASHFS_THREADS_DEFAULT;
+	if (options == NULL)
+		return 0;
+
+	while ((p = strsep(&options, ",")) != NULL) {
+		if (!*p)
+			continue;
+
+		switch (match_token(p, tokens, args)) {
+		case Opt_threads_single:
+			*threads = SQUASHFS_THREADS_SINGLE;
+			break;
+		case Opt_threads_multi:
+			*threads = SQUASHFS_THREADS_MULTI;
+			break;
+		case Opt_threads_percpu:
+			*threads = SQUASHFS_THREADS_PERCPU;
+			break;
+		default:
+			ERROR("Unrecognised mount option \"%s\"\n", p);
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+
+static int supported_squashfs_filesystem(struct squashfs_sb_info *msblk,
+	short major, short minor, short id)
 {
 	if (major < SQUASHFS_MAJOR) {
 		ERROR("Major/Minor mismatch, older Squashfs %d.%d "
@@ -59,8 +122,12 @@ static int supported_squashfs_filesystem(short major, short minor, short comp)
 		return -EINVAL;
 	}
 
-	if (comp != ZLIB_COMPRESSION)
+	msblk->decompressor = squashfs_lookup_decompressor(id);
+	if (!msblk->decompressor->supported) {
+		ERROR("Filesystem uses \"%s\" compression.  This is not "
+			"supported\n", msblk->decompressor->name);
 		return -EINVAL;
+	}
 
 	return 0;
 }
@@ -87,11 +154,11 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 	}
 	msblk = sb->s_fs_info;
 
-	msblk->stream.workspace = kmalloc(zlib_inflate_workspacesize(),
-		GFP_KERNEL);
-	if (msblk->stream.workspace == NULL) {
-		ERROR("Failed to allocate zlib workspace\n");
-		goto failure;
+	err = squashfs_parse_options(data, &msblk->threads);
+	if (err) {
+		kfree(sb->s_fs_info);
+		sb->s_fs_info = NULL;
+		return err;
 	}
 
 	sblk = kzalloc(sizeof(*sblk), GFP_KERNEL);
@@ -103,7 +170,6 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 	msblk->devblksize = sb_min_blocksize(sb, BLOCK_SIZE);
 	msblk->devblksize_log2 = ffz(~msblk->devblksize);
 
-	mutex_init(&msblk->read_data_mutex);
 	mutex_init(&msblk->meta_index_mutex);
 
 	/*
@@ -131,7 +197,7 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 	}
 
 	/* Check the MAJOR & MINOR versions and compression type */
-	err = supported_squashfs_filesystem(le16_to_cpu(sblk->s_major),
+	err = supported_squashfs_filesystem(msblk, le16_to_cpu(sblk->s_major),
 			le16_to_cpu(sblk->s_minor),
 			le16_to_cpu(sblk->compression));
 	if (err < 0)
@@ -172,6 +238,15 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 	if (msblk->block_log > SQUASHFS_FILE_MAX_LOG)
 		goto failed_mount;
 
+	/* The decompressor workspaces are sized from the block size */
+	err = squashfs_decompressor_create(msblk);
+	if (err) {
+		ERROR("Failed to allocate %s decompressor\n",
+			msblk->decompressor->name);
+		goto failed_mount;
+	}
+	err = -EINVAL;
+
 	/* Check the root inode for sanity */
 	root_inode = le64_to_cpu(sblk->root_inode);
 	if (SQUASHFS_INODE_OFFSET(root_inode) > SQUASHFS_METADATA_SIZE)
@@ -189,6 +264,7 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 				? "un" : "");
 	TRACE("Filesystem size %lld bytes\n", msblk->bytes_used);
 	TRACE("Block size %d\n", msblk->block_size);
+	TRACE("Compression %s\n", msblk->decompressor->name);
 	TRACE("Number of inodes %d\n", msblk->inodes);
 	TRACE("Number of fragments %d\n", le32_to_cpu(sblk->fragments));
 	TRACE("Number of ids %d\n", le16_to_cpu(sblk->no_ids));
@@ -210,7 +286,11 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 	if (msblk->block_cache == NULL)
 		goto failed_mount;
 
-	/* Allocate read_page block */
+	/*
+	 * Allocate read_page block.  Datablocks are normally decompressed
+	 * directly into the page cache, this is only used when some of the
+	 * pages of a block cannot be grabbed.
+	 */
 	msblk->read_page = squashfs_cache_init("data", 1, msblk->block_size);
 	if (msblk->read_page == NULL) {
 		ERROR("Failed to allocate read_page block\n");
@@ -295,14 +375,13 @@ failed_mount:
 	kfree(msblk->inode_lookup_table);
 	kfree(msblk->fragment_index);
 	kfree(msblk->id_table);
-	kfree(msblk->stream.workspace);
+	squashfs_decompressor_destroy(msblk);
 	kfree(sb->s_fs_info);
 	sb->s_fs_info = NULL;
 	kfree(sblk);
 	return err;
 
 failure:
-	kfree(msblk->stream.workspace);
 	kfree(sb->s_fs_info);
 	sb->s_fs_info = NULL;
 	return -ENOMEM;
@@ -330,6 +409,17 @@ static int squashfs_statfs(struct dentry *dentry, struct kstatfs *buf)
 }
 
 
+static int squashfs_show_options(struct seq_file *seq, struct vfsmount *mnt)
+{
+	struct squashfs_sb_info *msblk = mnt->mnt_sb->s_fs_info;
+
+	if (msblk->threads != SQUASHFS_THREADS_DEFAULT)
+		seq_printf(seq, ",threads=%s", threads_names[msblk->threads]);
+
+	return 0;
+}
+
+
 static int squashfs_remount(struct super_block *sb, int *flags, char *data)
 {
 	*flags |= MS_RDONLY;
@@ -349,7 +439,7 @@ static void squashfs_put_super(struct super_block *sb)
 		kfree(sbi->id_table);
 		kfree(sbi->fragment_index);
 		kfree(sbi->meta_index);
-		kfree(sbi->stream.workspace);
+		squashfs_decompressor_destroy(sbi);
 		kfree(sb->s_fs_info);
 		sb->s_fs_info = NULL;
 	}
@@ -390,6 +480,8 @@ static int __init init_inodecache(void)
 
 static void destroy_inodecache(void)
 {
+	/* Wait for inodes still waiting to be freed by squashfs_i_callback */
+	rcu_barrier();
 	kmem_cache_destroy(squashfs_inode_cachep);
 }
 
@@ -430,18 +522,25 @@ static struct inode *squashfs_alloc_inode(struct super_block *sb)
 }
 
 
-static void squashfs_destroy_inode(struct inode *inode)
+static void squashfs_i_callback(struct rcu_head *head)
 {
+	struct inode *inode = container_of(head, struct inode, i_rcu);
 	kmem_cache_free(squashfs_inode_cachep, squashfs_i(inode));
 }
 
 
+static void squashfs_destroy_inode(struct inode *inode)
+{
+	call_rcu(&inode->i_rcu, squashfs_i_callback);
+}
+
+
 static struct file_system_type squashfs_fs_type = {
 	.owner = THIS_MODULE,
 	.name = "squashfs",
 	.get_sb = squashfs_get_sb,
 	.kill_sb = kill_block_super,
-	.fs_flags = FS_REQUIRES_DEV
+	.fs_flags = FS_REQUIRES_DEV | FS_RCU_INODES
 };
 
 static const struct super_operations squashfs_super_ops = {
@@ -449,6 +548,7 @@ static const struct super_operations squashfs_super_ops = {
 	.destroy_inode = squashfs_destroy_inode,
 	.statfs = squashfs_statfs,
 	.put_super = squashfs_put_super,
+	.show_options = squashfs_show_options,
 	.remount_fs = squashfs_remount
 };
 
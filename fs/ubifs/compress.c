@@ -28,6 +28,7 @@
  */
 
 #include <linux/crypto.h>
+#include <linux/percpu.h>
 #include "ubifs.h"
 
 /* Fake description object for the "none" compressor */
@@ -38,11 +39,9 @@ static struct ubifs_compressor none_compr = {
 };
 
 #ifdef CONFIG_UBIFS_FS_LZO
-static DEFINE_MUTEX(lzo_mutex);
-
 static struct ubifs_compressor lzo_compr = {
 	.compr_type = UBIFS_COMPR_LZO,
-	.comp_mutex = &lzo_mutex,
+	.comp_lock = 1,
 	.name = "lzo",
 	.capi_name = "lzo",
 };
@@ -54,13 +53,10 @@ static struct ubifs_compressor lzo_compr = {
 #endif
 
 #ifdef CONFIG_UBIFS_FS_ZLIB
-static DEFINE_MUTEX(deflate_mutex);
-static DEFINE_MUTEX(inflate_mutex);
-
 static struct ubifs_compressor zlib_compr = {
 	.compr_type = UBIFS_COMPR_ZLIB,
-	.comp_mutex = &deflate_mutex,
-	.decomp_mutex = &inflate_mutex,
+	.comp_lock = 1,
+	.decomp_lock = 1,
 	.name = "zlib",
 	.capi_name = "deflate",
 };
@@ -74,6 +70,19 @@ static struct ubifs_compressor zlib_compr = {
 /* All UBIFS compressors */
 struct ubifs_compressor *ubifs_compressors[UBIFS_COMPR_TYPES_CNT];
 
+/**
+ * get_compr_ws - get the compressor workspace of the current CPU.
+ * @compr: compressor description object
+ *
+ * The caller may be migrated to another CPU after this returns, which is why
+ * the workspace has its own mutexes rather than relying on preemption being
+ * disabled. Compression may take a while and must not disable preemption.
+ */
+static struct ubifs_compr_ws *get_compr_ws(struct ubifs_compressor *compr)
+{
+	return per_cpu_ptr(compr->ws, raw_smp_processor_id());
+}
+
 /**
  * ubifs_compress - compress data.
  * @in_buf: data to compress
@@ -97,6 +106,7 @@ void ubifs_compress(const void *in_buf, int in_len, void *out_buf, int *out_len,
 {
 	int err;
 	struct ubifs_compressor *compr = ubifs_compressors[*compr_type];
+	struct ubifs_compr_ws *ws;
 
 	if (*compr_type == UBIFS_COMPR_NONE)
 		goto no_compr;
@@ -105,12 +115,13 @@ void ubifs_compress(const void *in_buf, int in_len, void *out_buf, int *out_len,
 	if (in_len < UBIFS_MIN_COMPR_LEN)
 		goto no_compr;
 
-	if (compr->comp_mutex)
-		mutex_lock(compr->comp_mutex);
-	err = crypto_comp_compress(compr->cc, in_buf, in_len, out_buf,
+	ws = get_compr_ws(compr);
+	if (compr->comp_lock)
+		mutex_lock(&ws->comp_mutex);
+	err = crypto_comp_compress(ws->cc, in_buf, in_len, out_buf,
 				   (unsigned int *)out_len);
-	if (compr->comp_mutex)
-		mutex_unlock(compr->comp_mutex);
+	if (compr->comp_lock)
+		mutex_unlock(&ws->comp_mutex);
 	if (unlikely(err)) {
 		ubifs_warn("cannot compress %d bytes, compressor %s, "
 			   "error %d, leave data uncompressed",
@@ -150,6 +161,7 @@ int ubifs_decompress(const void *in_buf, int in_len, void *out_buf,
 {
 	int err;
 	struct ubifs_compressor *compr;
+	struct ubifs_compr_ws *ws;
 
 	if (unlikely(compr_type < 0 || compr_type >= UBIFS_COMPR_TYPES_CNT)) {
 		ubifs_err("invalid compression type %d", compr_type);
@@ -169,12 +181,13 @@ int ubifs_decompress(const void *in_buf, int in_len, void *out_buf,
 		return 0;
 	}
 
-	if (compr->decomp_mutex)
-		mutex_lock(compr->decomp_mutex);
-	err = crypto_comp_decompress(compr->cc, in_buf, in_len, out_buf,
+	ws = get_compr_ws(compr);
+	if (compr->decomp_lock)
+		mutex_lock(&ws->decomp_mutex);
+	err = crypto_comp_decompress(ws->cc, in_buf, in_len, out_buf,
 				     (unsigned int *)out_len);
-	if (compr->decomp_mutex)
-		mutex_unlock(compr->decomp_mutex);
+	if (compr->decomp_lock)
+		mutex_unlock(&ws->decomp_mutex);
 	if (err)
 		ubifs_err("cannot decompress %d bytes, compressor %s, "
 			  "error %d", in_len, compr->name, err);
@@ -182,21 +195,56 @@ int ubifs_decompress(const void *in_buf, int in_len, void *out_buf,
 	return err;
 }
 
+/**
+ * free_compr_ws - free per-CPU compressor workspaces.
+ * @compr: compressor description object
+ */
+static void free_compr_ws(struct ubifs_compressor *compr)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct ubifs_compr_ws *ws = per_cpu_ptr(compr->ws, cpu);
+
+		if (ws->cc)
+			crypto_free_comp(ws->cc);
+	}
+	free_percpu(compr->ws);
+	compr->ws = NULL;
+}
+
 /**
  * compr_init - initialize a compressor.
  * @compr: compressor description object
  *
- * This function initializes the requested compressor and returns zero in case
- * of success or a negative error code in case of failure.
+ * This function initializes the requested compressor and allocates a
+ * cryptoapi handle for each possible CPU. Returns zero in case of success or
+ * a negative error code in case of failure.
  */
 static int __init compr_init(struct ubifs_compressor *compr)
 {
+	int cpu;
+
 	if (compr->capi_name) {
-		compr->cc = crypto_alloc_comp(compr->capi_name, 0, 0);
-		if (IS_ERR(compr->cc)) {
-			ubifs_err("cannot initialize compressor %s, error %ld",
-				  compr->name, PTR_ERR(compr->cc));
-			return PTR_ERR(compr->cc);
+		compr->ws = alloc_percpu(struct ubifs_compr_ws);
+		if (!compr->ws)
+			return -ENOMEM;
+
+		for_each_possible_cpu(cpu) {
+			struct ubifs_compr_ws *ws = per_cpu_ptr(compr->ws, cpu);
+			struct crypto_comp *cc;
+
+			cc = crypto_alloc_comp(compr->capi_name, 0, 0);
+			if (IS_ERR(cc)) {
+				ubifs_err("cannot initialize compressor %s, "
+					  "error %ld", compr->name,
+					  PTR_ERR(cc));
+				free_compr_ws(compr);
+				return PTR_ERR(cc);
+			}
+			ws->cc = cc;
+			mutex_init(&ws->comp_mutex);
+			mutex_init(&ws->decomp_mutex);
 		}
 	}
 
@@ -211,7 +259,7 @@ static int __init compr_init(struct ubifs_compressor *compr)
 static void compr_exit(struct ubifs_compressor *compr)
 {
 	if (compr->capi_name)
-		crypto_free_comp(compr->cc);
+		free_compr_ws(compr);
 	return;
 }
 
@@ -805,19 +805,36 @@ struct ubifs_node_range {
 };
 
 /**
- * struct ubifs_compressor - UBIFS compressor description structure.
- * @compr_type: compressor type (%UBIFS_COMPR_LZO, etc)
+ * struct ubifs_compr_ws - per-CPU compressor workspace.
  * @cc: cryptoapi compressor handle
  * @comp_mutex: mutex used during compression
  * @decomp_mutex: mutex used during decompression
+ *
+ * Each CPU has its own cryptoapi handle, so compression on different CPUs
+ * runs in parallel. The mutexes are still needed because a task may be
+ * preempted or migrated while using the workspace of the CPU it started on,
+ * but they are practically never contended.
+ */
+struct ubifs_compr_ws {
+	struct crypto_comp *cc;
+	struct mutex comp_mutex;
+	struct mutex decomp_mutex;
+};
+
+/**
+ * struct ubifs_compressor - UBIFS compressor description structure.
+ * @compr_type: compressor type (%UBIFS_COMPR_LZO, etc)
+ * @ws: per-CPU compressor workspaces
+ * @comp_lock: non-zero if compression has to be serialized per workspace
+ * @decomp_lock: non-zero if decompression has to be serialized per workspace
  * @name: compressor name
  * @capi_name: cryptoapi compressor name
  */
 struct ubifs_compressor {
 	int compr_type;
-	struct crypto_comp *cc;
-	struct mutex *comp_mutex;
-	struct mutex *decomp_mutex;
+	struct ubifs_compr_ws *ws;
+	unsigned int comp_lock:1;
+	unsigned int decomp_lock:1;
 	const char *name;
 	const char *capi_name;
 };
@@ -51,6 +51,9 @@ extern const char *yaffs_guts_c_version;
 #include <linux/interrupt.h>
 #include <linux/string.h>
 #include <linux/ctype.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
+#include <linux/kobject.h>
 
 #include "asm/div64.h"
 
@@ -364,17 +367,94 @@ static const struct super_operations yaffs_super_ops = {
 	.write_super = yaffs_write_super,
 };
 
+/*
+ * Locking
+ *
+ * grossLock is a rw_semaphore.  Anything that changes the namespace or
+ * object metadata (create, unlink, rename, setattr, flush, sync, inode
+ * teardown, mount/unmount) takes it exclusively, exactly as the old gross
+ * lock was taken.  Data reads and writes, lookup, readdir, readlink and
+ * statfs only take it shared, so they no longer queue up behind each
+ * other for the whole of an operation.
+ *
+ * yaffs_guts itself is not reentrant.  Shared holders therefore take
+ * gutsLock around every call into it; this is what serialises block
+ * allocation, garbage collection, the chunk cache and NAND buffer use.
+ * It is only held for the duration of a guts call.  Exclusive holders
+ * already exclude every shared holder and do not need it.  readdir drops
+ * both locks around filldir(), which may fault on a yaffs mapping.
+ *
+ * Data I/O on an object is additionally ordered by one of a small set of
+ * hashed per-object rw_semaphores: reads of an object share it, and a
+ * write holds it exclusively until the inode size has been updated, so
+ * a reader never sees a half-applied write to the same file.  Reads and
+ * writes of different objects only meet on gutsLock.
+ *
+ * Lock order: grossLock -> object lock -> gutsLock.
+ */
 static void yaffs_GrossLock(yaffs_Device *dev)
 {
 	T(YAFFS_TRACE_OS, ("yaffs locking %p\n", current));
-	down(&dev->grossLock);
+	down_write(&dev->grossLock);
 	T(YAFFS_TRACE_OS, ("yaffs locked %p\n", current));
 }
 
 static void yaffs_GrossUnlock(yaffs_Device *dev)
 {
 	T(YAFFS_TRACE_OS, ("yaffs unlocking %p\n", current));
-	up(&dev->grossLock);
+	up_write(&dev->grossLock);
+}
+
+static void yaffs_SharedLock(yaffs_Device *dev)
+{
+	T(YAFFS_TRACE_OS, ("yaffs shared locking %p\n", current));
+	down_read(&dev->grossLock);
+}
+
+static void yaffs_SharedUnlock(yaffs_Device *dev)
+{
+	T(YAFFS_TRACE_OS, ("yaffs shared unlocking %p\n", current));
+	up_read(&dev->grossLock);
+}
+
+static void yaffs_GutsLock(yaffs_Device *dev)
+{
+	mutex_lock(&dev->gutsLock);
+}
+
+static void yaffs_GutsUnlock(yaffs_Device *dev)
+{
+	mutex_unlock(&dev->gutsLock);
+}
+
+static struct rw_semaphore *yaffs_ObjectLock(yaffs_Object *obj)
+{
+	yaffs_Device *dev = obj->myDev;
+
+	return &dev->objectLock[obj->objectId & (YAFFS_NOBJECT_LOCKS - 1)];
+}
+
+/*
+ * Tell background GC that the device is busy with writes, and kick it if
+ * the write path has eaten into its reserve of erased blocks.
+ * Called with gutsLock held.
+ */
+static void yaffs_NoteWrite(yaffs_Device *dev)
+{
+	dev->lastWriteJiffies = jiffies;
+	if (dev->bgGCThread && dev->backgroundGC &&
+	    dev->nErasedBlocks < dev->bgReserveBlocks)
+		wake_up_process(dev->bgGCThread);
+}
+
+static void yaffs_InitLocks(yaffs_Device *dev)
+{
+	int i;
+
+	init_rwsem(&dev->grossLock);
+	mutex_init(&dev->gutsLock);
+	for (i = 0; i < YAFFS_NOBJECT_LOCKS; i++)
+		init_rwsem(&dev->objectLock[i]);
 }
 
 
@@ -501,11 +581,13 @@ static int yaffs_readlink(struct dentry *dentry, char __user *buffer,
 
 	yaffs_Device *dev = yaffs_DentryToObject(dentry)->myDev;
 
-	yaffs_GrossLock(dev);
+	yaffs_SharedLock(dev);
+	yaffs_GutsLock(dev);
 
 	alias = yaffs_GetSymlinkAlias(yaffs_DentryToObject(dentry));
 
-	yaffs_GrossUnlock(dev);
+	yaffs_GutsUnlock(dev);
+	yaffs_SharedUnlock(dev);
 
 	if (!alias)
 		return -ENOMEM;
@@ -525,11 +607,13 @@ static int yaffs_follow_link(struct dentry *dentry, struct nameidata *nd)
 	int ret;
 	yaffs_Device *dev = yaffs_DentryToObject(dentry)->myDev;
 
-	yaffs_GrossLock(dev);
+	yaffs_SharedLock(dev);
+	yaffs_GutsLock(dev);
 
 	alias = yaffs_GetSymlinkAlias(yaffs_DentryToObject(dentry));
 
-	yaffs_GrossUnlock(dev);
+	yaffs_GutsUnlock(dev);
+	yaffs_SharedUnlock(dev);
 
 	if (!alias) {
 		ret = -ENOMEM;
@@ -565,7 +649,8 @@ static struct dentry *yaffs_lookup(struct inode *dir, struct dentry *dentry)
 
 	yaffs_Device *dev = yaffs_InodeToObject(dir)->myDev;
 
-	yaffs_GrossLock(dev);
+	yaffs_SharedLock(dev);
+	yaffs_GutsLock(dev);
 
 	T(YAFFS_TRACE_OS,
 		("yaffs_lookup for %d:%s\n",
@@ -576,8 +661,10 @@ static struct dentry *yaffs_lookup(struct inode *dir, struct dentry *dentry)
 
 	obj = yaffs_GetEquivalentObject(obj);	/* in case it was a hardlink */
 
+	yaffs_GutsUnlock(dev);
+
 	/* Can't hold gross lock when calling yaffs_get_inode() */
-	yaffs_GrossUnlock(dev);
+	yaffs_SharedUnlock(dev);
 
 	if (obj) {
 		T(YAFFS_TRACE_OS,
@@ -739,13 +826,17 @@ static int yaffs_readpage_nolock(struct file *f, struct page *pg)
 	pg_buf = kmap(pg);
 	/* FIXME: Can kmap fail? */
 
-	yaffs_GrossLock(dev);
+	yaffs_SharedLock(dev);
+	down_read(yaffs_ObjectLock(obj));
+	yaffs_GutsLock(dev);
 
 	ret = yaffs_ReadDataFromFile(obj, pg_buf,
 				pg->index << PAGE_CACHE_SHIFT,
 				PAGE_CACHE_SIZE);
 
-	yaffs_GrossUnlock(dev);
+	yaffs_GutsUnlock(dev);
+	up_read(yaffs_ObjectLock(obj));
+	yaffs_SharedUnlock(dev);
 
 	if (ret >= 0)
 		ret = 0;
@@ -824,7 +915,9 @@ static int yaffs_writepage(struct page *page)
 	buffer = kmap(page);
 
 	obj = yaffs_InodeToObject(inode);
-	yaffs_GrossLock(obj->myDev);
+	yaffs_SharedLock(obj->myDev);
+	down_write(yaffs_ObjectLock(obj));
+	yaffs_GutsLock(obj->myDev);
 
 	T(YAFFS_TRACE_OS,
 		("yaffs_writepage at %08x, size %08x\n",
@@ -835,12 +928,15 @@ static int yaffs_writepage(struct page *page)
 
 	nWritten = yaffs_WriteDataToFile(obj, buffer,
 			page->index << PAGE_CACHE_SHIFT, nBytes, 0);
+	yaffs_NoteWrite(obj->myDev);
 
 	T(YAFFS_TRACE_OS,
 		("writepag1: obj = %05x, ino = %05x\n",
 		(int)obj->variant.fileVariant.fileSize, (int)inode->i_size));
 
-	yaffs_GrossUnlock(obj->myDev);
+	yaffs_GutsUnlock(obj->myDev);
+	up_write(yaffs_ObjectLock(obj));
+	yaffs_SharedUnlock(obj->myDev);
 
 	kunmap(page);
 	SetPageUptodate(page);
@@ -1156,7 +1252,8 @@ static ssize_t yaffs_file_write(struct file *f, const char *buf, size_t n,
 
 	dev = obj->myDev;
 
-	yaffs_GrossLock(dev);
+	yaffs_SharedLock(dev);
+	down_write(yaffs_ObjectLock(obj));
 
 	inode = f->f_dentry->d_inode;
 
@@ -1174,7 +1271,10 @@ static ssize_t yaffs_file_write(struct file *f, const char *buf, size_t n,
 			"to object %d at %d\n",
 			n, obj->objectId, ipos));
 
+	yaffs_GutsLock(dev);
 	nWritten = yaffs_WriteDataToFile(obj, buf, ipos, n, 0);
+	yaffs_NoteWrite(dev);
+	yaffs_GutsUnlock(dev);
 
 	T(YAFFS_TRACE_OS,
 		("yaffs_file_write writing %zu bytes, %d written at %d\n",
@@ -1194,7 +1294,8 @@ static ssize_t yaffs_file_write(struct file *f, const char *buf, size_t n,
 		}
 
 	}
-	yaffs_GrossUnlock(dev);
+	up_write(yaffs_ObjectLock(obj));
+	yaffs_SharedUnlock(dev);
 	return (nWritten == 0) && (n > 0) ? -ENOSPC : nWritten;
 }
 
@@ -1214,11 +1315,13 @@ static ssize_t yaffs_hold_space(struct file *f)
 
 	dev = obj->myDev;
 
-	yaffs_GrossLock(dev);
+	yaffs_SharedLock(dev);
+	yaffs_GutsLock(dev);
 
 	nFreeChunks = yaffs_GetNumberOfFreeChunks(dev);
 
-	yaffs_GrossUnlock(dev);
+	yaffs_GutsUnlock(dev);
+	yaffs_SharedUnlock(dev);
 
 	return (nFreeChunks > 20) ? 1 : 0;
 }
@@ -1233,10 +1336,10 @@ static void yaffs_release_space(struct file *f)
 
 	dev = obj->myDev;
 
-	yaffs_GrossLock(dev);
+	yaffs_SharedLock(dev);
 
 
-	yaffs_GrossUnlock(dev);
+	yaffs_SharedUnlock(dev);
 }
 
 static int yaffs_readdir(struct file *f, void *dirent, filldir_t filldir)
@@ -1254,7 +1357,8 @@ static int yaffs_readdir(struct file *f, void *dirent, filldir_t filldir)
 	obj = yaffs_DentryToObject(f->f_dentry);
 	dev = obj->myDev;
 
-	yaffs_GrossLock(dev);
+	yaffs_SharedLock(dev);
+	yaffs_GutsLock(dev);
 
 	offset = f->f_pos;
 
@@ -1270,12 +1374,15 @@ static int yaffs_readdir(struct file *f, void *dirent, filldir_t filldir)
 		T(YAFFS_TRACE_OS,
 			("yaffs_readdir: entry . ino %d \n",
 			(int)inode->i_ino));
-		yaffs_GrossUnlock(dev);
+		yaffs_GutsUnlock(dev);
+		yaffs_SharedUnlock(dev);
 		if (filldir(dirent, ".", 1, offset, inode->i_ino, DT_DIR) < 0) {
-			yaffs_GrossLock(dev);
+			yaffs_SharedLock(dev);
+			yaffs_GutsLock(dev);
 			goto out;
 		}
-		yaffs_GrossLock(dev);
+		yaffs_SharedLock(dev);
+		yaffs_GutsLock(dev);
 		offset++;
 		f->f_pos++;
 	}
@@ -1283,13 +1390,16 @@ static int yaffs_readdir(struct file *f, void *dirent, filldir_t filldir)
 		T(YAFFS_TRACE_OS,
 			("yaffs_readdir: entry .. ino %d \n",
 			(int)f->f_dentry->d_parent->d_inode->i_ino));
-		yaffs_GrossUnlock(dev);
+		yaffs_GutsUnlock(dev);
+		yaffs_SharedUnlock(dev);
 		if (filldir(dirent, "..", 2, offset,
 			f->f_dentry->d_parent->d_inode->i_ino, DT_DIR) < 0){
-			yaffs_GrossLock(dev);
+			yaffs_SharedLock(dev);
+			yaffs_GutsLock(dev);
 			goto out;
 		}
-		yaffs_GrossLock(dev);
+		yaffs_SharedLock(dev);
+		yaffs_GutsLock(dev);
 		offset++;
 		f->f_pos++;
 	}
@@ -1318,7 +1428,8 @@ static int yaffs_readdir(struct file *f, void *dirent, filldir_t filldir)
 			  ("yaffs_readdir: %s inode %d\n", name,
 			   yaffs_GetObjectInode(l)));
 
-                        yaffs_GrossUnlock(dev);
+                        yaffs_GutsUnlock(dev);
+                        yaffs_SharedUnlock(dev);
 
 			if (filldir(dirent,
 					name,
@@ -1326,11 +1437,13 @@ static int yaffs_readdir(struct file *f, void *dirent, filldir_t filldir)
 					offset,
 					this_inode,
 					this_type) < 0){
-				yaffs_GrossLock(dev);
+				yaffs_SharedLock(dev);
+				yaffs_GutsLock(dev);
 				goto out;
 			}
 
-                        yaffs_GrossLock(dev);
+                        yaffs_SharedLock(dev);
+                        yaffs_GutsLock(dev);
 
 			offset++;
 			f->f_pos++;
@@ -1340,7 +1453,8 @@ static int yaffs_readdir(struct file *f, void *dirent, filldir_t filldir)
 
 out:
         yaffs_EndSearch(sc);
-	yaffs_GrossUnlock(dev);
+	yaffs_GutsUnlock(dev);
+	yaffs_SharedUnlock(dev);
 
 	return retVal;
 }
@@ -1682,7 +1796,8 @@ static int yaffs_statfs(struct super_block *sb, struct statfs *buf)
 
 	T(YAFFS_TRACE_OS, ("yaffs_statfs\n"));
 
-	yaffs_GrossLock(dev);
+	yaffs_SharedLock(dev);
+	yaffs_GutsLock(dev);
 
 	buf->f_type = YAFFS_MAGIC;
 	buf->f_bsize = sb->s_blocksize;
@@ -1731,7 +1846,8 @@ static int yaffs_statfs(struct super_block *sb, struct statfs *buf)
 	buf->f_ffree = 0;
 	buf->f_bavail = buf->f_bfree;
 
-	yaffs_GrossUnlock(dev);
+	yaffs_GutsUnlock(dev);
+	yaffs_SharedUnlock(dev);
 	return 0;
 }
 
@@ -1810,13 +1926,15 @@ static struct inode *yaffs_iget(struct super_block *sb, unsigned long ino)
 	 * need to lock again.
 	 */
 
-	yaffs_GrossLock(dev);
+	yaffs_SharedLock(dev);
+	yaffs_GutsLock(dev);
 
 	obj = yaffs_FindObjectByNumber(dev, inode->i_ino);
 
 	yaffs_FillInodeFromObject(inode, obj);
 
-	yaffs_GrossUnlock(dev);
+	yaffs_GutsUnlock(dev);
+	yaffs_SharedUnlock(dev);
 
 	unlock_new_inode(inode);
 	return inode;
@@ -1837,13 +1955,15 @@ static void yaffs_read_inode(struct inode *inode)
 	T(YAFFS_TRACE_OS,
 		("yaffs_read_inode for %d\n", (int)inode->i_ino));
 
-	yaffs_GrossLock(dev);
+	yaffs_SharedLock(dev);
+	yaffs_GutsLock(dev);
 
 	obj = yaffs_FindObjectByNumber(dev, inode->i_ino);
 
 	yaffs_FillInodeFromObject(inode, obj);
 
-	yaffs_GrossUnlock(dev);
+	yaffs_GutsUnlock(dev);
+	yaffs_SharedUnlock(dev);
 }
 
 #endif
@@ -1880,12 +2000,272 @@ static int yaffs_remount_fs(struct super_block *sb, int *flags, char *data)
 }
 #endif
 
+/*
+ * Background garbage collection
+ *
+ * With background GC running, the write path no longer does leisurely
+ * collection itself: a per-device thread tidies up dirty blocks when the
+ * device has been quiet for a little while, and keeps bgReserveBlocks
+ * erased blocks in hand so that writers rarely have to wait for an
+ * aggressive collection.  It backs off while writes are going on unless
+ * the reserve has run low, and never waits on the device locks.
+ */
+#define YAFFS_BG_GC_IDLE	(HZ / 10)	/* Quiet time before tidying */
+#define YAFFS_BG_GC_POLL	(2 * HZ)	/* Recheck with nothing to do */
+
+static int yaffs_BackgroundGCThread(void *data)
+{
+	yaffs_Device *dev = data;
+	struct super_block *sb = dev->superBlock;
+
+	set_freezable();
+
+	while (!kthread_should_stop()) {
+		long timeout = YAFFS_BG_GC_POLL;
+		int urgent = dev->nErasedBlocks < dev->bgReserveBlocks;
+
+		try_to_freeze();
+
+		if (!dev->backgroundGC || (sb->s_flags & MS_RDONLY))
+			goto sleep;
+
+		if (!urgent && time_before(jiffies,
+				dev->lastWriteJiffies + YAFFS_BG_GC_IDLE)) {
+			timeout = YAFFS_BG_GC_IDLE;
+			goto sleep;
+		}
+
+		timeout = YAFFS_BG_GC_IDLE;
+		if (!down_read_trylock(&dev->grossLock))
+			goto sleep;
+		if (mutex_trylock(&dev->gutsLock)) {
+			if (yaffs_BackgroundGarbageCollect(dev))
+				timeout = 1;
+			else if (!urgent)
+				timeout = YAFFS_BG_GC_POLL;
+			mutex_unlock(&dev->gutsLock);
+		}
+		up_read(&dev->grossLock);
+sleep:
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!kthread_should_stop())
+			schedule_timeout(timeout);
+		__set_current_state(TASK_RUNNING);
+	}
+
+	return 0;
+}
+
+static void yaffs_StartBackgroundGC(yaffs_Device *dev)
+{
+	struct super_block *sb = dev->superBlock;
+	struct task_struct *t;
+
+	dev->bgReserveBlocks = dev->nReservedBlocks * 3;
+
+	t = kthread_run(yaffs_BackgroundGCThread, dev, "yaffs-gc/%s",
+			sb->s_id);
+	if (IS_ERR(t)) {
+		printk(KERN_WARNING
+			"yaffs: could not start background GC for %s\n",
+			sb->s_id);
+		return;
+	}
+
+	dev->bgGCThread = t;
+	dev->backgroundGC = 1;
+}
+
+static void yaffs_StopBackgroundGC(yaffs_Device *dev)
+{
+	if (!dev->bgGCThread)
+		return;
+
+	dev->backgroundGC = 0;
+	kthread_stop(dev->bgGCThread);
+	dev->bgGCThread = NULL;
+}
+
+/*
+ * sysfs: /sys/fs/yaffs/<device>/
+ */
+static struct kset *yaffs_kset;
+
+struct yaffs_attr {
+	struct attribute attr;
+	ssize_t (*show)(struct yaffs_attr *, yaffs_Device *, char *);
+	ssize_t (*store)(struct yaffs_attr *, yaffs_Device *,
+			 const char *, size_t);
+	int offset;
+};
+
+static ssize_t yaffs_dev_int_show(struct yaffs_attr *a,
+				  yaffs_Device *dev, char *buf)
+{
+	int *i = (int *)(((char *)dev) + a->offset);
+
+	return snprintf(buf, PAGE_SIZE, "%d\n", *i);
+}
+
+static ssize_t yaffs_dev_int_store(struct yaffs_attr *a,
+				   yaffs_Device *dev,
+				   const char *buf, size_t count)
+{
+	int *i = (int *)(((char *)dev) + a->offset);
+	unsigned long t;
+	char *endp;
+
+	t = simple_strtoul(skip_spaces(buf), &endp, 0);
+	endp = skip_spaces(endp);
+	if (*endp || t > INT_MAX)
+		return -EINVAL;
+	*i = t;
+	if (dev->bgGCThread)
+		wake_up_process(dev->bgGCThread);
+	return count;
+}
+
+/*
+ * bg_gc takes leisurely GC out of the write path, which is only safe while
+ * the background thread is there to do it instead.
+ */
+static ssize_t yaffs_bg_gc_store(struct yaffs_attr *a, yaffs_Device *dev,
+				 const char *buf, size_t count)
+{
+	unsigned long t;
+
+	t = simple_strtoul(skip_spaces(buf), NULL, 0);
+	if (t && !dev->bgGCThread)
+		return -ESRCH;
+	return yaffs_dev_int_store(a, dev, buf, count);
+}
+
+static ssize_t fg_gc_stall_us_show(struct yaffs_attr *a,
+				   yaffs_Device *dev, char *buf)
+{
+	__u64 t;
+
+	mutex_lock(&dev->gutsLock);
+	t = dev->foregroundGCTime;
+	mutex_unlock(&dev->gutsLock);
+
+	return snprintf(buf, PAGE_SIZE, "%llu\n", (unsigned long long)t);
+}
+
+#define YAFFS_ATTR_OFFSET(_name, _mode, _show, _store, _elname)	\
+static struct yaffs_attr yaffs_attr_##_name = {			\
+	.attr = {.name = __stringify(_name), .mode = _mode },	\
+	.show	= _show,					\
+	.store	= _store,					\
+	.offset = offsetof(yaffs_Device, _elname),		\
+}
+#define YAFFS_RO_ATTR(name) \
+static struct yaffs_attr yaffs_attr_##name = __ATTR(name, 0444, name##_show, NULL)
+#define YAFFS_RO_ATTR_DEV_INT(name, elname) \
+	YAFFS_ATTR_OFFSET(name, 0444, yaffs_dev_int_show, NULL, elname)
+#define YAFFS_RW_ATTR_DEV_INT(name, elname) \
+	YAFFS_ATTR_OFFSET(name, 0644, yaffs_dev_int_show, \
+			  yaffs_dev_int_store, elname)
+#define ATTR_LIST(name) (&yaffs_attr_##name.attr)
+
+YAFFS_ATTR_OFFSET(bg_gc, 0644, yaffs_dev_int_show, yaffs_bg_gc_store,
+		  backgroundGC);
+YAFFS_RW_ATTR_DEV_INT(bg_gc_reserve, bgReserveBlocks);
+YAFFS_RO_ATTR_DEV_INT(bg_gc_steps, backgroundGCs);
+YAFFS_RO_ATTR_DEV_INT(bg_gc_blocks, backgroundGCBlocks);
+YAFFS_RO_ATTR_DEV_INT(fg_gc_steps, foregroundGCs);
+YAFFS_RO_ATTR(fg_gc_stall_us);
+YAFFS_RO_ATTR_DEV_INT(erased_blocks, nErasedBlocks);
+
+static struct attribute *yaffs_attrs[] = {
+	ATTR_LIST(bg_gc),
+	ATTR_LIST(bg_gc_reserve),
+	ATTR_LIST(bg_gc_steps),
+	ATTR_LIST(bg_gc_blocks),
+	ATTR_LIST(fg_gc_steps),
+	ATTR_LIST(fg_gc_stall_us),
+	ATTR_LIST(erased_blocks),
+	NULL,
+};
+
+static ssize_t yaffs_attr_show(struct kobject *kobj,
+			       struct attribute *attr, char *buf)
+{
+	yaffs_Device *dev = container_of(kobj, yaffs_Device, kobj);
+	struct yaffs_attr *a = container_of(attr, struct yaffs_attr, attr);
+
+	return a->show ? a->show(a, dev, buf) : 0;
+}
+
+static ssize_t yaffs_attr_store(struct kobject *kobj,
+				struct attribute *attr,
+				const char *buf, size_t len)
+{
+	yaffs_Device *dev = container_of(kobj, yaffs_Device, kobj);
+	struct yaffs_attr *a = container_of(attr, struct yaffs_attr, attr);
+
+	return a->store ? a->store(a, dev, buf, len) : 0;
+}
+
+static void yaffs_dev_release(struct kobject *kobj)
+{
+	yaffs_Device *dev = container_of(kobj, yaffs_Device, kobj);
+
+	complete(&dev->kobjUnregister);
+}
+
+static const struct sysfs_ops yaffs_attr_ops = {
+	.show	= yaffs_attr_show,
+	.store	= yaffs_attr_store,
+};
+
+static struct kobj_type yaffs_ktype = {
+	.default_attrs	= yaffs_attrs,
+	.sysfs_ops	= &yaffs_attr_ops,
+	.release	= yaffs_dev_release,
+};
+
+static void yaffs_SysfsRegister(yaffs_Device *dev)
+{
+	struct super_block *sb = dev->superBlock;
+
+	if (!yaffs_kset)
+		return;
+
+	dev->kobj.kset = yaffs_kset;
+	init_completion(&dev->kobjUnregister);
+	if (kobject_init_and_add(&dev->kobj, &yaffs_ktype, NULL,
+				 "%s", sb->s_id)) {
+		/* Our release has run by now, nothing to wait for */
+		kobject_put(&dev->kobj);
+		return;
+	}
+	dev->kobjRegistered = 1;
+}
+
+static void yaffs_SysfsUnregister(yaffs_Device *dev)
+{
+	if (!dev->kobjRegistered)
+		return;
+
+	kobject_put(&dev->kobj);
+	wait_for_completion(&dev->kobjUnregister);
+	dev->kobjRegistered = 0;
+}
+
 static void yaffs_put_super(struct super_block *sb)
 {
 	yaffs_Device *dev = yaffs_SuperToDevice(sb);
 
 	T(YAFFS_TRACE_OS, ("yaffs_put_super\n"));
 
+	/*
+	 * The sysfs stores wake the GC thread: take them away, and wait
+	 * for any in progress, before the thread goes.
+	 */
+	yaffs_SysfsUnregister(dev);
+	yaffs_StopBackgroundGC(dev);
+
 	yaffs_GrossLock(dev);
 
 	yaffs_FlushEntireDeviceCache(dev);
@@ -1936,6 +2316,7 @@ typedef struct {
 	int skip_checkpoint_read;
 	int skip_checkpoint_write;
 	int no_cache;
+	int cache_size;
 	int empty_lost_and_found_overridden;
 	int empty_lost_and_found;
 	int tags_ecc_on;
@@ -1970,6 +2351,9 @@ static int yaffs_parse_options(yaffs_options *options, const char *options_str)
 			options->inband_tags = 1;
 		else if (!strcmp(cur_opt, "no-cache"))
 			options->no_cache = 1;
+		else if (!strncmp(cur_opt, "cache-size=", 11))
+			options->cache_size =
+				simple_strtoul(cur_opt + 11, NULL, 10);
 		else if (!strcmp(cur_opt, "no-checkpoint-read"))
 			options->skip_checkpoint_read = 1;
 		else if (!strcmp(cur_opt, "no-checkpoint-write"))
@@ -2198,7 +2582,8 @@ static struct super_block *yaffs_internal_read_super(int yaffsVersion,
 	dev->nChunksPerBlock = YAFFS_CHUNKS_PER_BLOCK;
 	dev->totalBytesPerChunk = YAFFS_BYTES_PER_CHUNK;
 	dev->nReservedBlocks = 5;
-	dev->nShortOpCaches = (options.no_cache) ? 0 : 10;
+	dev->nShortOpCaches = (options.no_cache) ? 0 :
+			(options.cache_size > 0) ? options.cache_size : 10;
 	dev->inbandTags = options.inband_tags;
 #ifdef CONFIG_YAFFS_DOES_TAGS_ECC
 	dev->doesTagsEcc = !options.tags_ecc_off;
@@ -2270,7 +2655,7 @@ static struct super_block *yaffs_internal_read_super(int yaffsVersion,
         YINIT_LIST_HEAD(&dev->searchContexts);
         dev->removeObjectCallback = yaffs_RemoveObjectCallback;
 
-	init_MUTEX(&dev->grossLock);
+	yaffs_InitLocks(dev);
 
 	yaffs_GrossLock(dev);
 
@@ -2309,6 +2694,9 @@ static struct super_block *yaffs_internal_read_super(int yaffsVersion,
 	T(YAFFS_TRACE_ALWAYS,
 	  ("yaffs_read_super: isCheckpointed %d\n", dev->isCheckpointed));
 
+	yaffs_StartBackgroundGC(dev);
+	yaffs_SysfsRegister(dev);
+
 	T(YAFFS_TRACE_OS, ("yaffs_read_super: done\n"));
 	return sb;
 }
@@ -2433,6 +2821,12 @@ static char *yaffs_dump_dev(char *buf, yaffs_Device * dev)
 	buf += sprintf(buf, "garbageCollections. %d\n", dev->garbageCollections);
 	buf += sprintf(buf, "passiveGCs......... %d\n",
 		    dev->passiveGarbageCollections);
+	buf += sprintf(buf, "foregroundGCs...... %d\n", dev->foregroundGCs);
+	buf += sprintf(buf, "foregroundGCTime... %llu us\n",
+		    (unsigned long long)dev->foregroundGCTime);
+	buf += sprintf(buf, "backgroundGCs...... %d\n", dev->backgroundGCs);
+	buf += sprintf(buf, "backgroundGCBlocks. %d\n",
+		    dev->backgroundGCBlocks);
 	buf += sprintf(buf, "nRetriedWrites..... %d\n", dev->nRetriedWrites);
 	buf += sprintf(buf, "nShortOpCaches..... %d\n", dev->nShortOpCaches);
 	buf += sprintf(buf, "nRetireBlocks...... %d\n", dev->nRetiredBlocks);
@@ -2660,6 +3054,9 @@ static int __init init_yaffs_fs(void)
 	} else
 		return -ENOMEM;
 
+	/* Per-device tunables and GC statistics; not fatal if missing */
+	yaffs_kset = kset_create_and_add("yaffs", NULL, fs_kobj);
+
 	/* Now add the file system entries */
 
 	fsinst = fs_to_install;
@@ -2682,6 +3079,9 @@ static int __init init_yaffs_fs(void)
 			}
 			fsinst++;
 		}
+
+		if (yaffs_kset)
+			kset_unregister(yaffs_kset);
 	}
 
 	return error;
@@ -2706,6 +3106,9 @@ static void __exit exit_yaffs_fs(void)
 		}
 		fsinst++;
 	}
+
+	if (yaffs_kset)
+		kset_unregister(yaffs_kset);
 }
 
 module_init(init_yaffs_fs)
@@ -3221,13 +3221,18 @@ static int yaffs_GarbageCollectBlock(yaffs_Device *dev, int block,
  *
  * The idea is to help clear out space in a more spread-out manner.
  * Dunno if it really does anything useful.
+ *
+ * When background GC is enabled the write path only does aggressive gc;
+ * the background caller does the leasurely kind, and goes aggressive
+ * itself when the device drops below bgReserveBlocks erased blocks.
  */
-static int yaffs_CheckGarbageCollection(yaffs_Device *dev)
+static int yaffs_CheckGarbageCollection(yaffs_Device *dev, int background)
 {
 	int block;
 	int aggressive;
 	int gcOk = YAFFS_OK;
 	int maxTries = 0;
+	__u64 start;
 
 	int checkpointBlockAdjust;
 
@@ -3255,6 +3260,16 @@ static int yaffs_CheckGarbageCollection(yaffs_Device *dev)
 			aggressive = 0;
 		}
 
+		if (background) {
+			if (dev->nErasedBlocks < dev->bgReserveBlocks)
+				aggressive = 1;
+			/* Background steps are already paced by the caller */
+			dev->nonAggressiveSkip = 0;
+		} else if (!aggressive && dev->backgroundGC) {
+			/* Leave it to the background */
+			break;
+		}
+
 		if (dev->gcBlock <= 0) {
 			dev->gcBlock = yaffs_FindBlockForGarbageCollection(dev, aggressive);
 			dev->gcChunk = 0;
@@ -3272,7 +3287,16 @@ static int yaffs_CheckGarbageCollection(yaffs_Device *dev)
 			   ("yaffs: GC erasedBlocks %d aggressive %d" TENDSTR),
 			   dev->nErasedBlocks, aggressive));
 
+			start = Y_CLOCK_US();
 			gcOk = yaffs_GarbageCollectBlock(dev, block, aggressive);
+			if (background) {
+				dev->backgroundGCs++;
+				if (dev->gcBlock <= 0)
+					dev->backgroundGCBlocks++;
+			} else {
+				dev->foregroundGCs++;
+				dev->foregroundGCTime += Y_CLOCK_US() - start;
+			}
 		}
 
 		if (dev->nErasedBlocks < (dev->nReservedBlocks) && block > 0) {
@@ -3288,6 +3312,19 @@ static int yaffs_CheckGarbageCollection(yaffs_Device *dev)
 	return aggressive ? gcOk : YAFFS_OK;
 }
 
+/* yaffs_BackgroundGarbageCollect() does one step of garbage collection for
+ * a background thread. Returns 1 if a step was done, so it is worth calling
+ * again soon, or 0 if there was nothing to collect.
+ */
+int yaffs_BackgroundGarbageCollect(yaffs_Device *dev)
+{
+	int before = dev->backgroundGCs;
+
+	yaffs_CheckGarbageCollection(dev, 1);
+
+	return dev->backgroundGCs != before;
+}
+
 /*-------------------------  TAGS --------------------------------*/
 
 static int yaffs_TagsMatch(const yaffs_ExtendedTags *tags, int objectId,
@@ -3642,7 +3679,7 @@ static int yaffs_WriteChunkDataToObject(yaffs_Object *in, int chunkInInode,
 
 	yaffs_Device *dev = in->myDev;
 
-	yaffs_CheckGarbageCollection(dev);
+	yaffs_CheckGarbageCollection(dev, 0);
 
 	/* Get the previous chunk at this location in the file if it exists */
 	prevChunkId = yaffs_FindChunkInFile(in, chunkInInode, &prevTags);
@@ -3709,7 +3746,7 @@ int yaffs_UpdateObjectHeader(yaffs_Object *in, const YCHAR *name, int force,
 		in == dev->rootDir || /* The rootDir should also be saved */
 		force) {
 
-		yaffs_CheckGarbageCollection(dev);
+		yaffs_CheckGarbageCollection(dev, 0);
 		yaffs_CheckObjectDetailsLoaded(in);
 
 		buffer = yaffs_GetTempBuffer(in->myDev, __LINE__);
@@ -3855,75 +3892,166 @@ int yaffs_UpdateObjectHeader(yaffs_Object *in, const YCHAR *name, int force,
  *   In Linux, the page cache provides read buffering aand the short op cache provides write
  *   buffering.
  *
- *   There are a limited number (~10) of cache chunks per device so that we don't
- *   need a very intelligent search.
+ *   Caches in use are indexed by a hash on (object, chunkId) and kept on an LRU
+ *   list, most recently used first. Unused caches sit on a free list. Lookup,
+ *   grabbing and eviction are therefore independent of the number of caches,
+ *   which allows much larger caches than the original ~10.
  */
 
+static struct ylist_head *yaffs_ChunkCacheBucket(yaffs_Device *dev,
+						  const yaffs_Object *obj,
+						  int chunkId)
+{
+	__u32 hash = obj->objectId * 0x9E3779B1 + chunkId;
+
+	return &dev->srHash[hash & dev->srHashMask];
+}
+
+/* Take a cache out of the index and put it back on the free list */
+static void yaffs_ReleaseChunkCache(yaffs_Device *dev, yaffs_ChunkCache *cache)
+{
+	cache->object = NULL;
+	cache->dirty = 0;
+	ylist_del_init(&cache->hashLink);
+	ylist_del(&cache->lruLink);
+	ylist_add_tail(&cache->lruLink, &dev->srFree);
+}
+
 static int yaffs_ObjectHasCachedWriteData(yaffs_Object *obj)
 {
 	yaffs_Device *dev = obj->myDev;
-	int i;
+	struct ylist_head *i;
 	yaffs_ChunkCache *cache;
-	int nCaches = obj->myDev->nShortOpCaches;
 
-	for (i = 0; i < nCaches; i++) {
-		cache = &dev->srCache[i];
-		if (cache->object == obj &&
-		    cache->dirty)
-			return 1;
+	if (dev->nShortOpCaches > 0) {
+		ylist_for_each(i, &dev->srLru) {
+			cache = ylist_entry(i, yaffs_ChunkCache, lruLink);
+			if (cache->object == obj &&
+			    cache->dirty)
+				return 1;
+		}
 	}
 
 	return 0;
 }
 
+/* Look a chunk up in the index without counting it as a cache hit */
+static yaffs_ChunkCache *yaffs_LookupChunkCache(const yaffs_Object *obj,
+						int chunkId)
+{
+	yaffs_Device *dev = obj->myDev;
+	struct ylist_head *bucket;
+	struct ylist_head *i;
+	yaffs_ChunkCache *cache;
+
+	if (dev->nShortOpCaches > 0) {
+		bucket = yaffs_ChunkCacheBucket(dev, obj, chunkId);
+		ylist_for_each(i, bucket) {
+			cache = ylist_entry(i, yaffs_ChunkCache, hashLink);
+			if (cache->object == obj &&
+			    cache->chunkId == chunkId)
+				return cache;
+		}
+	}
+	return NULL;
+}
+
+/* Find a cached chunk */
+static yaffs_ChunkCache *yaffs_FindChunkCache(const yaffs_Object *obj,
+					      int chunkId)
+{
+	yaffs_ChunkCache *cache = yaffs_LookupChunkCache(obj, chunkId);
+
+	if (cache)
+		obj->myDev->cacheHits++;
+
+	return cache;
+}
+
+/* Write out one dirty cache and free it up. Returns the result of the write. */
+static int yaffs_WriteOutChunkCache(yaffs_ChunkCache *cache)
+{
+	int chunkWritten;
+
+	chunkWritten = yaffs_WriteChunkDataToObject(cache->object,
+						    cache->chunkId,
+						    cache->data,
+						    cache->nBytes,
+						    1);
+	yaffs_ReleaseChunkCache(cache->object->myDev, cache);
+
+	return chunkWritten;
+}
 
 static void yaffs_FlushFilesChunkCache(yaffs_Object *obj)
 {
 	yaffs_Device *dev = obj->myDev;
 	int lowest = -99;	/* Stop compiler whining. */
-	int i;
+	int highest = -99;
+	int nDirty = 0;
+	int chunkId;
+	struct ylist_head *i;
 	yaffs_ChunkCache *cache;
-	int chunkWritten = 0;
-	int nCaches = obj->myDev->nShortOpCaches;
+	int chunkWritten = 1;
 
-	if (nCaches > 0) {
-		do {
-			cache = NULL;
+	if (dev->nShortOpCaches <= 0)
+		return;
 
-			/* Find the dirty cache for this object with the lowest chunk id. */
-			for (i = 0; i < nCaches; i++) {
-				if (dev->srCache[i].object == obj &&
-				    dev->srCache[i].dirty) {
-					if (!cache
-					    || dev->srCache[i].chunkId <
-					    lowest) {
-						cache = &dev->srCache[i];
-						lowest = cache->chunkId;
-					}
-				}
-			}
+	/* Find the range of dirty chunks this object has in the cache. */
+	ylist_for_each(i, &dev->srLru) {
+		cache = ylist_entry(i, yaffs_ChunkCache, lruLink);
+		if (cache->object == obj && cache->dirty) {
+			if (!nDirty || cache->chunkId < lowest)
+				lowest = cache->chunkId;
+			if (!nDirty || cache->chunkId > highest)
+				highest = cache->chunkId;
+			nDirty++;
+		}
+	}
 
-			if (cache && !cache->locked) {
-				/* Write it out and free it up */
+	if (!nDirty)
+		return;
 
-				chunkWritten =
-				    yaffs_WriteChunkDataToObject(cache->object,
-								 cache->chunkId,
-								 cache->data,
-								 cache->nBytes,
-								 1);
-				cache->dirty = 0;
-				cache->object = NULL;
+	cache = NULL;
+
+	if (highest - lowest < 4 * nDirty) {
+		/* Dense enough to walk the range through the index. */
+		for (chunkId = lowest;
+		     chunkId <= highest && chunkWritten > 0;
+		     chunkId++) {
+			cache = yaffs_LookupChunkCache(obj, chunkId);
+			if (cache && cache->dirty && !cache->locked)
+				chunkWritten = yaffs_WriteOutChunkCache(cache);
+			cache = NULL;
+		}
+	}
+
+	/* Sparse (or something was locked): write the rest out in chunk order. */
+	do {
+		cache = NULL;
+
+		ylist_for_each(i, &dev->srLru) {
+			yaffs_ChunkCache *c =
+				ylist_entry(i, yaffs_ChunkCache, lruLink);
+			if (c->object == obj && c->dirty &&
+			    (!cache || c->chunkId < lowest)) {
+				cache = c;
+				lowest = c->chunkId;
 			}
+		}
 
-		} while (cache && chunkWritten > 0);
+		if (cache && !cache->locked && chunkWritten > 0)
+			chunkWritten = yaffs_WriteOutChunkCache(cache);
+		else
+			break;
 
-		if (cache) {
-			/* Hoosterman, disk full while writing cache out. */
-			T(YAFFS_TRACE_ERROR,
-			  (TSTR("yaffs tragedy: no space during cache write" TENDSTR)));
+	} while (1);
+
+	if (cache && chunkWritten <= 0) {
+		/* Hoosterman, disk full while writing cache out. */
+		T(YAFFS_TRACE_ERROR,
+		  (TSTR("yaffs tragedy: no space during cache write" TENDSTR)));
 
-		}
 	}
 
 }
@@ -3936,19 +4064,23 @@ static void yaffs_FlushFilesChunkCache(yaffs_Object *obj)
 void yaffs_FlushEntireDeviceCache(yaffs_Device *dev)
 {
 	yaffs_Object *obj;
-	int nCaches = dev->nShortOpCaches;
-	int i;
+	struct ylist_head *i;
+	yaffs_ChunkCache *cache;
+
+	if (dev->nShortOpCaches <= 0)
+		return;
 
 	/* Find a dirty object in the cache and flush it...
 	 * until there are no further dirty objects.
 	 */
 	do {
 		obj = NULL;
-		for (i = 0; i < nCaches && !obj; i++) {
-			if (dev->srCache[i].object &&
-			    dev->srCache[i].dirty)
-				obj = dev->srCache[i].object;
-
+		ylist_for_each(i, &dev->srLru) {
+			cache = ylist_entry(i, yaffs_ChunkCache, lruLink);
+			if (cache->object && cache->dirty) {
+				obj = cache->object;
+				break;
+			}
 		}
 		if (obj)
 			yaffs_FlushFilesChunkCache(obj);
@@ -3960,111 +4092,70 @@ void yaffs_FlushEntireDeviceCache(yaffs_Device *dev)
 
 /* Grab us a cache chunk for use.
  * First look for an empty one.
- * Then look for the least recently used non-dirty one.
- * Then look for the least recently used dirty one...., flush and look again.
+ * Then take the least recently used unlocked one. If it is dirty, flush its
+ * object (which frees it and the object's other dirty chunks) and look again.
  */
 static yaffs_ChunkCache *yaffs_GrabChunkCacheWorker(yaffs_Device *dev)
 {
-	int i;
-
-	if (dev->nShortOpCaches > 0) {
-		for (i = 0; i < dev->nShortOpCaches; i++) {
-			if (!dev->srCache[i].object)
-				return &dev->srCache[i];
-		}
-	}
+	if (dev->nShortOpCaches > 0 && !ylist_empty(&dev->srFree))
+		return ylist_entry(dev->srFree.next, yaffs_ChunkCache, lruLink);
 
 	return NULL;
 }
 
-static yaffs_ChunkCache *yaffs_GrabChunkCache(yaffs_Device *dev)
+static yaffs_ChunkCache *yaffs_GrabChunkCache(yaffs_Object *obj, int chunkId)
 {
+	yaffs_Device *dev = obj->myDev;
 	yaffs_ChunkCache *cache;
-	yaffs_Object *theObj;
-	int usage;
-	int i;
-	int pushout;
-
-	if (dev->nShortOpCaches > 0) {
-		/* Try find a non-dirty one... */
-
-		cache = yaffs_GrabChunkCacheWorker(dev);
+	struct ylist_head *i;
 
-		if (!cache) {
-			/* They were all dirty, find the last recently used object and flush
-			 * its cache, then  find again.
-			 * NB what's here is not very accurate, we actually flush the object
-			 * the last recently used page.
-			 */
+	if (dev->nShortOpCaches <= 0)
+		return NULL;
 
-			/* With locking we can't assume we can use entry zero */
+	cache = yaffs_GrabChunkCacheWorker(dev);
 
-			theObj = NULL;
-			usage = -1;
+	if (!cache) {
+		/* With locking we can't assume we can use the tail entry */
+		for (i = dev->srLru.prev; i != &dev->srLru; i = i->prev) {
+			cache = ylist_entry(i, yaffs_ChunkCache, lruLink);
+			if (!cache->locked)
+				break;
 			cache = NULL;
-			pushout = -1;
-
-			for (i = 0; i < dev->nShortOpCaches; i++) {
-				if (dev->srCache[i].object &&
-				    !dev->srCache[i].locked &&
-				    (dev->srCache[i].lastUse < usage || !cache)) {
-					usage = dev->srCache[i].lastUse;
-					theObj = dev->srCache[i].object;
-					cache = &dev->srCache[i];
-					pushout = i;
-				}
-			}
-
-			if (!cache || cache->dirty) {
-				/* Flush and try again */
-				yaffs_FlushFilesChunkCache(theObj);
-				cache = yaffs_GrabChunkCacheWorker(dev);
-			}
-
 		}
-		return cache;
-	} else
-		return NULL;
 
-}
+		if (!cache)
+			return NULL;
 
-/* Find a cached chunk */
-static yaffs_ChunkCache *yaffs_FindChunkCache(const yaffs_Object *obj,
-					      int chunkId)
-{
-	yaffs_Device *dev = obj->myDev;
-	int i;
-	if (dev->nShortOpCaches > 0) {
-		for (i = 0; i < dev->nShortOpCaches; i++) {
-			if (dev->srCache[i].object == obj &&
-			    dev->srCache[i].chunkId == chunkId) {
-				dev->cacheHits++;
+		if (cache->dirty)
+			yaffs_FlushFilesChunkCache(cache->object);
+		else
+			yaffs_ReleaseChunkCache(dev, cache);
 
-				return &dev->srCache[i];
-			}
-		}
+		cache = yaffs_GrabChunkCacheWorker(dev);
+		if (!cache)
+			return NULL;
 	}
-	return NULL;
+
+	cache->object = obj;
+	cache->chunkId = chunkId;
+	cache->dirty = 0;
+	cache->locked = 0;
+	cache->nBytes = 0;
+	ylist_add(&cache->hashLink, yaffs_ChunkCacheBucket(dev, obj, chunkId));
+	ylist_del(&cache->lruLink);
+	ylist_add(&cache->lruLink, &dev->srLru);
+
+	return cache;
 }
 
-/* Mark the chunk for the least recently used algorithym */
+/* Mark the chunk as most recently used */
 static void yaffs_UseChunkCache(yaffs_Device *dev, yaffs_ChunkCache *cache,
 				int isAWrite)
 {
 
 	if (dev->nShortOpCaches > 0) {
-		if (dev->srLastUse < 0 || dev->srLastUse > 100000000) {
-			/* Reset the cache usages */
-			int i;
-			for (i = 1; i < dev->nShortOpCaches; i++)
-				dev->srCache[i].lastUse = 0;
-
-			dev->srLastUse = 0;
-		}
-
-		dev->srLastUse++;
-
-		cache->lastUse = dev->srLastUse;
+		ylist_del(&cache->lruLink);
+		ylist_add(&cache->lruLink, &dev->srLru);
 
 		if (isAWrite)
 			cache->dirty = 1;
@@ -4081,7 +4172,7 @@ static void yaffs_InvalidateChunkCache(yaffs_Object *object, int chunkId)
 		yaffs_ChunkCache *cache = yaffs_FindChunkCache(object, chunkId);
 
 		if (cache)
-			cache->object = NULL;
+			yaffs_ReleaseChunkCache(object->myDev, cache);
 	}
 }
 
@@ -4090,14 +4181,17 @@ static void yaffs_InvalidateChunkCache(yaffs_Object *object, int chunkId)
  */
 static void yaffs_InvalidateWholeChunkCache(yaffs_Object *in)
 {
-	int i;
+	struct ylist_head *i;
+	struct ylist_head *n;
+	yaffs_ChunkCache *cache;
 	yaffs_Device *dev = in->myDev;
 
 	if (dev->nShortOpCaches > 0) {
 		/* Invalidate it. */
-		for (i = 0; i < dev->nShortOpCaches; i++) {
-			if (dev->srCache[i].object == in)
-				dev->srCache[i].object = NULL;
+		ylist_for_each_safe(i, n, &dev->srLru) {
+			cache = ylist_entry(i, yaffs_ChunkCache, lruLink);
+			if (cache->object == in)
+				yaffs_ReleaseChunkCache(dev, cache);
 		}
 	}
 }
@@ -4719,15 +4813,10 @@ int yaffs_ReadDataFromFile(yaffs_Object *in, __u8 *buffer, loff_t offset,
 				/* If we can't find the data in the cache, then load it up. */
 
 				if (!cache) {
-					cache = yaffs_GrabChunkCache(in->myDev);
-					cache->object = in;
-					cache->chunkId = chunk;
-					cache->dirty = 0;
-					cache->locked = 0;
+					cache = yaffs_GrabChunkCache(in, chunk);
 					yaffs_ReadChunkDataFromObject(in, chunk,
 								      cache->
 								      data);
-					cache->nBytes = 0;
 				}
 
 				yaffs_UseChunkCache(dev, cache, 0);
@@ -4849,11 +4938,7 @@ int yaffs_WriteDataToFile(yaffs_Object *in, const __u8 *buffer, loff_t offset,
 				if (!cache
 				    && yaffs_CheckSpaceForAllocation(in->
 								     myDev)) {
-					cache = yaffs_GrabChunkCache(in->myDev);
-					cache->object = in;
-					cache->chunkId = chunk;
-					cache->dirty = 0;
-					cache->locked = 0;
+					cache = yaffs_GrabChunkCache(in, chunk);
 					yaffs_ReadChunkDataFromObject(in, chunk,
 								      cache->
 								      data);
@@ -5008,7 +5093,7 @@ int yaffs_ResizeFile(yaffs_Object *in, loff_t newSize)
 	yaffs_FlushFilesChunkCache(in);
 	yaffs_InvalidateWholeChunkCache(in);
 
-	yaffs_CheckGarbageCollection(dev);
+	yaffs_CheckGarbageCollection(dev, 0);
 
 	if (in->variantType != YAFFS_OBJECT_TYPE_FILE)
 		return YAFFS_FAIL;
@@ -7438,6 +7523,10 @@ int yaffs_GutsInitialise(yaffs_Device *dev)
 	/* More device initialisation */
 	dev->garbageCollections = 0;
 	dev->passiveGarbageCollections = 0;
+	dev->foregroundGCs = 0;
+	dev->foregroundGCTime = 0;
+	dev->backgroundGCs = 0;
+	dev->backgroundGCBlocks = 0;
 	dev->currentDirtyChecker = 0;
 	dev->bufferedBlock = -1;
 	dev->doingBufferedBlockRewrite = 0;
@@ -7458,6 +7547,7 @@ int yaffs_GutsInitialise(yaffs_Device *dev)
 		init_failed = 1;
 
 	dev->srCache = NULL;
+	dev->srHash = NULL;
 	dev->gcCleanupList = NULL;
 
 
@@ -7477,16 +7567,32 @@ int yaffs_GutsInitialise(yaffs_Device *dev)
 		if (dev->srCache)
 			memset(dev->srCache, 0, srCacheBytes);
 
+		YINIT_LIST_HEAD(&dev->srLru);
+		YINIT_LIST_HEAD(&dev->srFree);
+
 		for (i = 0; i < dev->nShortOpCaches && buf; i++) {
 			dev->srCache[i].object = NULL;
-			dev->srCache[i].lastUse = 0;
 			dev->srCache[i].dirty = 0;
+			YINIT_LIST_HEAD(&dev->srCache[i].hashLink);
+			ylist_add_tail(&dev->srCache[i].lruLink, &dev->srFree);
 			dev->srCache[i].data = buf = YMALLOC_DMA(dev->totalBytesPerChunk);
 		}
+
+		if (buf) {
+			unsigned nBuckets = YAFFS_MIN_CHUNK_CACHE_BUCKETS;
+
+			while (nBuckets < dev->nShortOpCaches)
+				nBuckets <<= 1;
+
+			dev->srHash = YMALLOC(nBuckets * sizeof(struct ylist_head));
+			buf = dev->srHash;
+			for (i = 0; buf && i < nBuckets; i++)
+				YINIT_LIST_HEAD(&dev->srHash[i]);
+			dev->srHashMask = nBuckets - 1;
+		}
+
 		if (!buf)
 			init_failed = 1;
-
-		dev->srLastUse = 0;
 	}
 
 	dev->cacheHits = 0;
@@ -7609,6 +7715,11 @@ void yaffs_Deinitialise(yaffs_Device *dev)
 			dev->srCache = NULL;
 		}
 
+		if (dev->srHash) {
+			YFREE(dev->srHash);
+			dev->srHash = NULL;
+		}
+
 		YFREE(dev->gcCleanupList);
 
 		for (i = 0; i < YAFFS_N_TEMP_BUFFERS; i++)
@@ -60,6 +60,13 @@
 
 #define YAFFS_NOBJECT_BUCKETS		256
 
+#define YAFFS_NOBJECT_LOCKS		16
+
+/* Monotonic clock for GC stall accounting, if the environment has one */
+#ifndef Y_CLOCK_US
+#define Y_CLOCK_US() 0
+#endif
+
 
 #define YAFFS_OBJECT_SPACE		0x40000
 
@@ -88,7 +95,12 @@
 
 /* */
 
-#define YAFFS_MAX_SHORT_OP_CACHES	20
+#define YAFFS_MAX_SHORT_OP_CACHES	1024
+
+/* Minimum number of hash buckets for the short op cache index. The table is
+ * sized to the next power of two at or above the number of caches.
+ */
+#define YAFFS_MIN_CHUNK_CACHE_BUCKETS	16
 
 #define YAFFS_N_TEMP_BUFFERS		6
 
@@ -115,7 +127,8 @@
 typedef struct {
 	struct yaffs_ObjectStruct *object;
 	int chunkId;
-	int lastUse;
+	struct ylist_head hashLink;	/* Hash chain, or unused if free */
+	struct ylist_head lruLink;	/* On srLru if in use, else on srFree */
 	int dirty;
 	int nBytes;		/* Only valid if the cache is dirty */
 	int locked;		/* Can't push out or flush while locked. */
@@ -639,8 +652,19 @@ struct yaffs_DeviceStruct {
 #ifdef __KERNEL__
 
 	struct semaphore sem;	/* Semaphore for waiting on erasure.*/
-	struct semaphore grossLock;	/* Gross locking semaphore */
+	struct rw_semaphore grossLock;	/* Exclusive for namespace changes,
+					 * shared by data I/O and lookups */
+	struct mutex gutsLock;	/* Serialises shared grossLock holders
+				 * inside yaffs_guts: allocation, GC,
+				 * chunk cache and NAND buffers */
+	struct rw_semaphore objectLock[YAFFS_NOBJECT_LOCKS];
+				/* Hashed per-object data I/O locks */
 	struct rw_semaphore dirLock; /* Lock the directory structure */
+	struct task_struct *bgGCThread;	/* Background garbage collector */
+	unsigned long lastWriteJiffies;	/* Lets background GC back off */
+	struct kobject kobj;		/* /sys/fs/yaffs/<device> */
+	struct completion kobjUnregister;
+	int kobjRegistered;
 	__u8 *spareBuffer;	/* For mtdif2 use. Don't know the size of the buffer
 				 * at compile time so we have to allocate it.
 
@@ -720,6 +744,10 @@ struct yaffs_DeviceStruct {
 	__u32 *gcCleanupList;	/* objects to delete at the end of a GC. */
 	int nonAggressiveSkip;	/* GC state/mode */
 
+	/* Background GC, driven by yaffs_BackgroundGarbageCollect() */
+	int backgroundGC;	/* Leave leisurely GC out of the write path */
+	int bgReserveBlocks;	/* Erased blocks background GC keeps in hand */
+
 	/* Statistcs */
 	int nPageWrites;
 	int nPageReads;
@@ -728,6 +756,10 @@ struct yaffs_DeviceStruct {
 	int nGCCopies;
 	int garbageCollections;
 	int passiveGarbageCollections;
+	int foregroundGCs;	/* GC steps run from the write path */
+	__u64 foregroundGCTime;	/* Time writers stalled in them, in us */
+	int backgroundGCs;	/* GC steps run in the background */
+	int backgroundGCBlocks;	/* Blocks reclaimed in the background */
 	int nRetriedWrites;
 	int nRetiredBlocks;
 	int eccFixed;
@@ -752,7 +784,10 @@ struct yaffs_DeviceStruct {
 	int doingBufferedBlockRewrite;
 
 	yaffs_ChunkCache *srCache;
-	int srLastUse;
+	struct ylist_head *srHash;	/* (object, chunkId) index into srCache */
+	unsigned srHashMask;
+	struct ylist_head srLru;	/* In-use caches, most recently used first */
+	struct ylist_head srFree;	/* Caches not holding any chunk */
 
 	int cacheHits;
 
@@ -826,6 +861,7 @@ int yaffs_GutsInitialise(yaffs_Device *dev);
 void yaffs_Deinitialise(yaffs_Device *dev);
 
 int yaffs_GetNumberOfFreeChunks(yaffs_Device *dev);
+int yaffs_BackgroundGarbageCollect(yaffs_Device *dev);
 
 int yaffs_RenameObject(yaffs_Object *oldDir, const YCHAR *oldName,
 		       yaffs_Object *newDir, const YCHAR *newName);
@@ -47,6 +47,7 @@
 #include <linux/string.h>
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
+#include <linux/hrtimer.h>
 
 #define YCHAR char
 #define YUCHAR unsigned char
@@ -85,6 +86,8 @@
 #define Y_TIME_CONVERT(x) (x)
 #endif
 
+#define Y_CLOCK_US() ((__u64)ktime_to_us(ktime_get()))
+
 #define yaffs_SumCompare(x, y) ((x) == (y))
 #define yaffs_strcmp(a, b) strcmp(a, b)
 
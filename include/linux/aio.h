@@ -6,6 +6,7 @@
 #include <linux/aio_abi.h>
 #include <linux/uio.h>
 #include <linux/rcupdate.h>
+#include <linux/mutex.h>
 
 #include <asm/atomic.h>
 
@@ -118,6 +119,7 @@ struct kiocb {
 
 	struct list_head	ki_list;	/* the aio core uses this
 						 * for cancellation */
+	struct list_head	ki_batch;	/* batch allocation */
 
 	/*
 	 * If the aio_resfd field of the userspace iocb is not zero,
@@ -169,7 +171,7 @@ struct aio_ring_info {
 	unsigned long		mmap_size;
 
 	struct page		**ring_pages;
-	spinlock_t		ring_lock;
+	struct mutex		ring_lock;
 	long			nr_pages;
 
 	unsigned		nr, tail;
@@ -177,6 +179,15 @@ struct aio_ring_info {
 	struct page		*internal_pages[AIO_RING_PAGES];
 };
 
+/* Submission ring, only present for contexts set up with one */
+struct aio_sq_info {
+	struct aio_sq_ring __user *ring;	/* owned by userspace */
+
+	struct mutex		lock;		/* serialises submitters */
+
+	unsigned		nr, head;	/* trusted copies */
+};
+
 struct kioctx {
 	atomic_t		users;
 	int			dead;
@@ -196,8 +207,10 @@ struct kioctx {
 
 	/* sys_io_setup currently limits this to an unsigned int */
 	unsigned		max_reqs;
+	unsigned		flags;		/* IOCTX_FLAG_* */
 
 	struct aio_ring_info	ring_info;
+	struct aio_sq_info	sq_info;
 
 	struct delayed_work	wq;
 
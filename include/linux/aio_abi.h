@@ -54,6 +54,20 @@ enum {
  */
 #define IOCB_FLAG_RESFD		(1 << 0)
 
+/*
+ * Flags or'ed into the nr_events argument of io_setup().  Kernels that
+ * do not know them fail io_setup() with -EINVAL.
+ *
+ * IOCTX_FLAG_SQ_RING - *ctxp holds the address of a struct aio_sq_ring
+ *                      to use as the context's submission ring.
+ * IOCTX_FLAG_POLLED  - io_getevents() busy-polls the completion ring
+ *                      instead of sleeping while it waits for events.
+ *                      Only valid with IOCTX_FLAG_SQ_RING.
+ */
+#define IOCTX_FLAG_SQ_RING	(1U << 31)
+#define IOCTX_FLAG_POLLED	(1U << 30)
+#define IOCTX_FLAG_MASK		(IOCTX_FLAG_SQ_RING | IOCTX_FLAG_POLLED)
+
 /* read() from /dev/aio returns these structures. */
 struct io_event {
 	__u64		data;		/* the data field from the iocb */
@@ -104,6 +118,29 @@ struct iocb {
 	__u32	aio_resfd;
 }; /* 64 bytes */
 
+#define AIO_SQ_RING_MAGIC	0xa10a10a2
+#define AIO_SQ_RING_MAX		(1U << 16)	/* max iocb slots */
+
+/*
+ * Submission ring, allocated by userspace and handed to io_setup() with
+ * IOCTX_FLAG_SQ_RING.  Userspace sets nr to a power of two first; the
+ * kernel fills in the rest of the header.  Userspace then fills in
+ * iocbs[tail & (nr - 1)] and advances tail.  io_submit(ctx, nr, NULL)
+ * submits the iocbs between head and tail and advances head once their
+ * slots may be reused.  An iocb that cannot be submitted is consumed
+ * too, and its error is reported as its completion event.
+ */
+struct aio_sq_ring {
+	__u32	nr;		/* number of iocb slots */
+	__u32	head;		/* written by the kernel */
+	__u32	tail;		/* written by userspace */
+	__u32	magic;
+	__u32	header_length;	/* size of struct aio_sq_ring */
+	__u32	reserved[3];
+
+	struct iocb	iocbs[0];
+}; /* 32 bytes + ring size */
+
 #undef IFBIG
 #undef IFLITTLE
 
@@ -27,6 +27,10 @@ extern unsigned long compaction_suitable(struct zone *zone, int order);
 extern unsigned long compact_zone_order(struct zone *zone, int order,
 						gfp_t gfp_mask);
 
+extern void wakeup_kcompactd(pg_data_t *pgdat, int order);
+extern int kcompactd_run(int nid);
+extern void kcompactd_stop(int nid);
+
 /* Do not skip compaction more than 64 times */
 #define COMPACT_MAX_DEFER_SHIFT 6
 
@@ -83,6 +87,19 @@ static inline bool compaction_deferred(struct zone *zone)
 	return 1;
 }
 
+static inline void wakeup_kcompactd(pg_data_t *pgdat, int order)
+{
+}
+
+static inline int kcompactd_run(int nid)
+{
+	return 0;
+}
+
+static inline void kcompactd_stop(int nid)
+{
+}
+
 #endif /* CONFIG_COMPACTION */
 
 #if defined(CONFIG_COMPACTION) && defined(CONFIG_SYSFS) && defined(CONFIG_NUMA)
@@ -129,6 +129,7 @@ typedef struct journal_s	journal_t;	/* Journal control structure */
 #define JBD2_SUPERBLOCK_V1	3
 #define JBD2_SUPERBLOCK_V2	4
 #define JBD2_REVOKE_BLOCK	5
+#define JBD2_FC_PATCH_BLOCK	0x100	/* only in the FC_PATCH area */
 
 /*
  * Standard header for all descriptor blocks:
@@ -192,6 +193,29 @@ typedef struct jbd2_journal_revoke_header_s
 } jbd2_journal_revoke_header_t;
 
 
+/*
+ * The fast commit block: a header followed by fc_count tags, each tag
+ * immediately followed by ft_len bytes to be copied to ft_offset in the
+ * filesystem block it names.  Tags and their data are padded to 4
+ * bytes.  fc_crc is the crc32_be of the whole block with fc_crc zero.
+ */
+typedef struct jbd2_fc_header_s
+{
+	journal_header_t fc_header;	/* h_sequence is the tid covered */
+	__be32		fc_seq;		/* index within that tid's blocks */
+	__be16		fc_count;	/* number of tags in the block */
+	__be16		fc_padding;
+	__be32		fc_crc;
+} jbd2_fc_header_t;
+
+typedef struct jbd2_fc_tag_s
+{
+	__be32		ft_blocknr;	/* filesystem block to patch */
+	__be32		ft_blocknr_high;
+	__be16		ft_offset;	/* byte offset within the block */
+	__be16		ft_len;		/* bytes of data following the tag */
+} jbd2_fc_tag_t;
+
 /* Definitions for the journal tag flags word: */
 #define JBD2_FLAG_ESCAPE		1	/* on-disk block is escaped */
 #define JBD2_FLAG_SAME_UUID	2	/* block has same uuid as previous */
@@ -240,7 +264,12 @@ typedef struct journal_superblock_s
 	__be32	s_max_trans_data;	/* Limit of data blocks per trans. */
 
 /* 0x0050 */
-	__u32	s_padding[44];
+	__u32	s_padding[42];
+
+/* 0x00F8 */
+	__be32	s_fc_patch_blks;	/* Nr of fast commit blocks at the
+					 * end of the journal (FC_PATCH) */
+	__u32	s_padding2;
 
 /* 0x0100 */
 	__u8	s_users[16*48];		/* ids of all fs'es sharing the log */
@@ -262,13 +291,20 @@ typedef struct journal_superblock_s
 #define JBD2_FEATURE_INCOMPAT_REVOKE		0x00000001
 #define JBD2_FEATURE_INCOMPAT_64BIT		0x00000002
 #define JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT	0x00000004
+/*
+ * Vendor private: the patch based fast commit area in fast_commit.c.  This
+ * is not the upstream fast commit format (incompat bit 0x20), so it takes
+ * a bit from the top of the word to stay clear of it.
+ */
+#define JBD2_FEATURE_INCOMPAT_FC_PATCH		0x80000000
 
 /* Features known to this kernel version: */
 #define JBD2_KNOWN_COMPAT_FEATURES	JBD2_FEATURE_COMPAT_CHECKSUM
 #define JBD2_KNOWN_ROCOMPAT_FEATURES	0
 #define JBD2_KNOWN_INCOMPAT_FEATURES	(JBD2_FEATURE_INCOMPAT_REVOKE | \
 					JBD2_FEATURE_INCOMPAT_64BIT | \
-					JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT)
+					JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT | \
+					JBD2_FEATURE_INCOMPAT_FC_PATCH)
 
 #ifdef __KERNEL__
 
@@ -730,6 +766,7 @@ jbd2_time_diff(unsigned long start, unsigned long end)
  *     commit
  * @j_uuid: Uuid of client object.
  * @j_task: Pointer to the current commit thread for this journal
+ * @j_checkpoint_task: Pointer to the background checkpoint thread
  * @j_max_transaction_buffers:  Maximum number of metadata buffers to allow in a
  *     single compound commit transaction
  * @j_commit_interval: What is the maximum transaction lifetime before we begin
@@ -749,6 +786,16 @@ jbd2_time_diff(unsigned long start, unsigned long end)
  * @j_history_lock: Protect the transactions statistics history
  * @j_proc_entry: procfs entry for the jbd statistics directory
  * @j_stats: Overall statistics
+ * @j_bg_checkpoints: Number of checkpoints done by the background thread
+ * @j_log_space_waits: Number of handles which had to wait for log space
+ * @j_fc_first: First block of the fast commit area
+ * @j_fc_last: One beyond the last block of the fast commit area
+ * @j_fc_off: Number of fast commit blocks written for @j_fc_tid
+ * @j_fc_tid: Transaction the fast commit area currently describes
+ * @j_fc_mutex: Serialises fast commits
+ * @j_fc_buf: Staging buffer for the fast commit block being built
+ * @j_fc_commits: Number of fast commits written
+ * @j_fc_fallbacks: Number of fast commits which fell back to a full commit
  * @j_private: An opaque pointer to fs-private information.
  */
 
@@ -919,6 +966,12 @@ struct journal_s
 	/* Pointer to the current commit thread for this journal */
 	struct task_struct	*j_task;
 
+	/*
+	 * Pointer to the thread which checkpoints in the background to keep
+	 * log space free ahead of demand
+	 */
+	struct task_struct	*j_checkpoint_task;
+
 	/*
 	 * Maximum number of metadata buffers to allow in a single compound
 	 * commit transaction
@@ -978,6 +1031,26 @@ struct journal_s
 	struct proc_dir_entry	*j_proc_entry;
 	struct transaction_stats_s j_stats;
 
+	/*
+	 * Background checkpoints done, and handles which still had to wait
+	 * for log space in start_this_handle() [j_state_lock]
+	 */
+	unsigned long		j_bg_checkpoints;
+	unsigned long		j_log_space_waits;
+
+	/*
+	 * Fast commit area: [j_fc_first, j_fc_last) sits past j_last and is
+	 * rewritten from its start for every new transaction.  [j_fc_mutex]
+	 */
+	unsigned long		j_fc_first;
+	unsigned long		j_fc_last;
+	unsigned long		j_fc_off;
+	tid_t			j_fc_tid;
+	struct mutex		j_fc_mutex;
+	char			*j_fc_buf;
+	unsigned long		j_fc_commits;
+	unsigned long		j_fc_fallbacks;
+
 	/* Failed journal commit ID */
 	unsigned int		j_failed_commit;
 
@@ -1182,6 +1255,15 @@ extern int	jbd2_journal_test_revoke(journal_t *, unsigned long long, tid_t);
 extern void	jbd2_journal_clear_revoke(journal_t *);
 extern void	jbd2_journal_switch_revoke_table(journal_t *journal);
 
+/* Fast commit support */
+#define JBD2_DEFAULT_FC_BLOCKS	256
+extern int	jbd2_fc_init(journal_t *, unsigned long);
+extern int	jbd2_fc_begin_commit(journal_t *, tid_t);
+extern int	jbd2_fc_add_patch(journal_t *, unsigned long long,
+				  unsigned int, const void *, unsigned int);
+extern int	jbd2_fc_end_commit(journal_t *, int);
+extern int	jbd2_fc_replay(journal_t *, tid_t);
+
 /*
  * The log thread user interface:
  *
@@ -1198,6 +1280,8 @@ int jbd2_log_wait_commit(journal_t *journal, tid_t tid);
 int jbd2_log_do_checkpoint(journal_t *journal);
 
 void __jbd2_log_wait_for_space(journal_t *journal);
+void __jbd2_log_kick_checkpoint(journal_t *journal);
+void jbd2_log_kick_checkpoint(journal_t *journal);
 extern void __jbd2_journal_drop_transaction(journal_t *, transaction_t *);
 extern int jbd2_cleanup_journal_tail(journal_t *);
 
@@ -1270,6 +1354,24 @@ static inline int jbd_space_needed(journal_t *journal)
 	return nblocks;
 }
 
+/*
+ * The background checkpoint thread is woken once free log space drops
+ * below what a new transaction needs plus 1/8 of the journal, and keeps
+ * going until 1/4 of the journal above that is free again.
+ */
+#define JBD2_CHECKPOINT_LOW_SHIFT	3
+#define JBD2_CHECKPOINT_HIGH_SHIFT	2
+
+/*
+ * Return true if free log space is below the given watermark.  Must be
+ * called under j_state_lock.
+ */
+static inline int jbd2_log_space_low(journal_t *journal, int shift)
+{
+	return __jbd2_log_space_left(journal) <
+		jbd_space_needed(journal) + (journal->j_maxlen >> shift);
+}
+
 /*
  * Definitions which augment the buffer_head layer
  */
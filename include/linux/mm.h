@@ -1294,6 +1294,16 @@ void task_dirty_inc(struct task_struct *tsk);
 #define VM_MAX_READAHEAD	512	/* kbytes */
 #define VM_MIN_READAHEAD	16	/* kbytes (includes current page) */
 
+/* access patterns reported by the readahead tracepoint */
+enum ra_pattern {
+	RA_PATTERN_INITIAL,	/* start of file or new sequential stream */
+	RA_PATTERN_SEQUENTIAL,	/* expected sequential continuation */
+	RA_PATTERN_CONTEXT,	/* interleaved stream found via page cache */
+	RA_PATTERN_STRIDE,	/* fixed-distance jumps, forwards or back */
+	RA_PATTERN_BACKWARD,	/* contiguous backward scan */
+	RA_PATTERN_RANDOM,	/* no readahead, read as is */
+};
+
 int force_page_cache_readahead(struct address_space *mapping, struct file *filp,
 			pgoff_t offset, unsigned long nr_to_read);
 
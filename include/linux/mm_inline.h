@@ -19,10 +19,65 @@ static inline int page_is_file_cache(struct page *page)
 	return !PageSwapBacked(page);
 }
 
+#ifdef CONFIG_LRU_GEN
+static inline int lru_gen_enabled(struct zone *zone)
+{
+	return zone->lru_gen.enabled;
+}
+
+/*
+ * Active pages join the youngest generation.  Inactive file pages join
+ * the oldest one, so use-once cache goes first, while new anon pages are
+ * given one more generation to be referenced.
+ */
+static inline struct list_head *lru_gen_list(struct zone *zone,
+					     enum lru_list l)
+{
+	struct lru_gen *lrugen = &zone->lru_gen;
+	int file = is_file_lru(l);
+	unsigned long seq;
+
+	if (is_active_lru(l))
+		seq = lrugen->max_seq;
+	else if (file)
+		seq = lrugen->min_seq[file];
+	else
+		seq = lrugen->min_seq[file] + 1;
+
+	return &lrugen->lists[lru_gen_from_seq(seq)][file];
+}
+#else
+static inline int lru_gen_enabled(struct zone *zone)
+{
+	return 0;
+}
+
+static inline struct list_head *lru_gen_list(struct zone *zone,
+					     enum lru_list l)
+{
+	return NULL;
+}
+#endif
+
+/**
+ * zone_lru_list - the list head an LRU page of type @l is linked on
+ * @zone: the page's zone
+ * @l: the LRU list index derived from the page flags
+ *
+ * Must be called with zone->lru_lock held.
+ */
+static inline struct list_head *zone_lru_list(struct zone *zone,
+					      enum lru_list l)
+{
+	if (lru_gen_enabled(zone) && l != LRU_UNEVICTABLE)
+		return lru_gen_list(zone, l);
+	return &zone->lru[l].list;
+}
+
 static inline void
 add_page_to_lru_list(struct zone *zone, struct page *page, enum lru_list l)
 {
-	list_add(&page->lru, &zone->lru[l].list);
+	list_add(&page->lru, zone_lru_list(zone, l));
 	__inc_zone_state(zone, NR_LRU_BASE + l);
 	mem_cgroup_add_lru_list(page, l);
 }
@@ -11,6 +11,7 @@
 #include <linux/rwsem.h>
 #include <linux/completion.h>
 #include <linux/cpumask.h>
+#include <linux/workqueue.h>
 #include <linux/page-debug-flags.h>
 #include <asm/page.h>
 #include <asm/mmu.h>
@@ -312,6 +313,10 @@ struct mm_struct {
 #ifdef CONFIG_ZRAM_FOR_ANDROID
 	int mm_swap_done;
 #endif /* CONFIG_ZRAM_FOR_ANDROID */
+#ifdef CONFIG_LRU_GEN
+	struct list_head lru_gen_list;	/* walked by the multi-gen LRU aging */
+	struct work_struct async_put_work;	/* for mmput_async() */
+#endif
 
 	/* How many tasks sharing this mm are OOM_DISABLE */
 	atomic_t oom_disable_count;
@@ -43,6 +43,13 @@
 #define MIGRATE_ISOLATE       4 /* can't allocate from here */
 #define MIGRATE_TYPES         5
 
+/*
+ * Orders up to and including PAGE_ALLOC_COSTLY_ORDER are cached on the
+ * per-cpu lists, one list per order and pcp migratetype.
+ */
+#define NR_PCP_ORDERS		(PAGE_ALLOC_COSTLY_ORDER + 1)
+#define NR_PCP_LISTS		(MIGRATE_PCPTYPES * NR_PCP_ORDERS)
+
 #define for_each_migratetype_order(order, type) \
 	for (order = 0; order < MAX_ORDER; order++) \
 		for (type = 0; type < MIGRATE_TYPES; type++)
@@ -104,6 +111,9 @@ enum zone_stat_item {
 	NR_ISOLATED_ANON,	/* Temporary isolated pages from anon lru */
 	NR_ISOLATED_FILE,	/* Temporary isolated pages from file lru */
 	NR_SHMEM,		/* shmem pages (included tmpfs/GEM pages) */
+	WORKINGSET_REFAULT,	/* evicted file pages faulted back in */
+	WORKINGSET_ACTIVATE,	/* refaults that were activated */
+	WORKINGSET_SHADOWS,	/* shadow entries in the page cache */
 #ifdef CONFIG_NUMA
 	NUMA_HIT,		/* allocated in intended node */
 	NUMA_MISS,		/* allocated in non intended node */
@@ -167,12 +177,15 @@ enum zone_watermarks {
 #define high_wmark_pages(z) (z->watermark[WMARK_HIGH])
 
 struct per_cpu_pages {
-	int count;		/* number of pages in the list */
+	int count;		/* number of base pages in the lists */
 	int high;		/* high watermark, emptying needed */
 	int batch;		/* chunk size for buddy add/remove */
 
-	/* Lists of pages, one per migrate type stored on the pcp-lists */
-	struct list_head lists[MIGRATE_PCPTYPES];
+	/*
+	 * Lists of pages, one per order and migrate type stored on the
+	 * pcp-lists. See order_to_pindex().
+	 */
+	struct list_head lists[NR_PCP_LISTS];
 };
 
 struct per_cpu_pageset {
@@ -283,6 +296,33 @@ struct zone_reclaim_stat {
 	unsigned long		nr_saved_scan[NR_LRU_LISTS];
 };
 
+#ifdef CONFIG_LRU_GEN
+/*
+ * The multi-generational LRU sorts the evictable pages of a zone into
+ * generations instead of the active and inactive lists.  A generation
+ * is identified by a sequence number; max_seq is the youngest and
+ * min_seq[] the oldest generation still holding anon [0] and file [1]
+ * pages.  The page flags and NR_LRU_BASE counters keep their classic
+ * meaning, only the list a page is linked on differs.
+ *
+ * All fields are protected by zone->lru_lock.
+ */
+#define MIN_NR_GENS		2
+#define MAX_NR_GENS		4
+
+struct lru_gen {
+	int			enabled;
+	unsigned long		max_seq;
+	unsigned long		min_seq[2];
+	struct list_head	lists[MAX_NR_GENS][2];
+};
+
+static inline int lru_gen_from_seq(unsigned long seq)
+{
+	return seq % MAX_NR_GENS;
+}
+#endif
+
 struct zone {
 	/* Fields commonly accessed by the page allocator */
 
@@ -355,10 +395,16 @@ struct zone {
 	} lru[NR_LRU_LISTS];
 
 	struct zone_reclaim_stat reclaim_stat;
+#ifdef CONFIG_LRU_GEN
+	struct lru_gen		lru_gen;
+#endif
 
 	unsigned long		pages_scanned;	   /* since last reclaim */
 	unsigned long		flags;		   /* zone flags, see below */
 
+	/* Evictions & activations on the inactive file list */
+	atomic_long_t		inactive_age;
+
 	/* Zone statistics */
 	atomic_long_t		vm_stat[NR_VM_ZONE_STAT_ITEMS];
 
@@ -643,6 +689,11 @@ typedef struct pglist_data {
 	wait_queue_head_t kswapd_wait;
 	struct task_struct *kswapd;
 	int kswapd_max_order;
+#ifdef CONFIG_COMPACTION
+	wait_queue_head_t kcompactd_wait;
+	struct task_struct *kcompactd;
+	int kcompactd_max_order;
+#endif
 } pg_data_t;
 
 #define node_present_pages(nid)	(NODE_DATA(nid)->node_present_pages)
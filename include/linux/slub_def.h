@@ -32,6 +32,9 @@ enum stat_item {
 	DEACTIVATE_TO_TAIL,	/* Cpu slab was moved to the tail of partials */
 	DEACTIVATE_REMOTE_FREES,/* Slab contained remotely freed objects */
 	ORDER_FALLBACK,		/* Number of times fallback was necessary */
+	ALLOC_BULK,		/* Objects allocated by kmem_cache_alloc_bulk */
+	FREE_BULK,		/* Objects freed by kmem_cache_free_bulk */
+	FREE_BULK_SLAB,		/* Several objects freed to a slab at once */
 	NR_SLUB_STAT_ITEMS };
 
 struct kmem_cache_cpu {
@@ -195,6 +195,14 @@ struct swap_list_t {
 /* Swap 50% full? Release swapcache more aggressively.. */
 #define vm_swap_full() (nr_swap_pages*2 < total_swap_pages)
 
+/* linux/mm/workingset.c */
+extern void *workingset_eviction(struct address_space *mapping,
+				 struct page *page);
+extern int workingset_refault(void *shadow);
+extern void workingset_activation(struct page *page);
+extern void workingset_shadow_add(struct address_space *mapping, void *shadow);
+extern void workingset_shadow_del(struct address_space *mapping, void *shadow);
+
 /* linux/mm/page_alloc.c */
 extern unsigned long totalram_pages;
 extern unsigned long totalreserve_pages;
@@ -280,6 +288,25 @@ extern void scan_mapping_unevictable_pages(struct address_space *);
 extern unsigned long scan_unevictable_pages;
 extern int scan_unevictable_handler(struct ctl_table *, int,
 					void __user *, size_t *, loff_t *);
+#ifdef CONFIG_LRU_GEN
+extern int sysctl_lru_gen_enabled;
+extern int lru_gen_sysctl_handler(struct ctl_table *, int,
+					void __user *, size_t *, loff_t *);
+extern void lru_gen_init_zone(struct zone *zone);
+extern void lru_gen_add_mm(struct mm_struct *mm);
+extern void lru_gen_del_mm(struct mm_struct *mm);
+#else
+static inline void lru_gen_init_zone(struct zone *zone)
+{
+}
+static inline void lru_gen_add_mm(struct mm_struct *mm)
+{
+}
+static inline void lru_gen_del_mm(struct mm_struct *mm)
+{
+}
+#endif
+
 #ifdef CONFIG_NUMA
 extern int scan_unevictable_register_node(struct node *node);
 extern void scan_unevictable_unregister_node(struct node *node);
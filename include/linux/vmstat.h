@@ -28,9 +28,14 @@
 
 #define FOR_ALL_ZONES(xx) DMA_ZONE(xx) DMA32_ZONE(xx) xx##_NORMAL HIGHMEM_ZONE(xx) , xx##_MOVABLE
 
+/* One item per order kept on the per-cpu lists (0..PAGE_ALLOC_COSTLY_ORDER) */
+#define FOR_PCP_ORDERS(xx) xx##_ORDER0, xx##_ORDER1, xx##_ORDER2, xx##_ORDER3
+
 enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 		FOR_ALL_ZONES(PGALLOC),
 		PGFREE, PGACTIVATE, PGDEACTIVATE,
+		FOR_PCP_ORDERS(PCP_HIT),
+		FOR_PCP_ORDERS(PCP_MISS),
 		PGFAULT, PGMAJFAULT,
 		FOR_ALL_ZONES(PGREFILL),
 		FOR_ALL_ZONES(PGSTEAL),
@@ -43,9 +48,18 @@ enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 		KSWAPD_LOW_WMARK_HIT_QUICKLY, KSWAPD_HIGH_WMARK_HIT_QUICKLY,
 		KSWAPD_SKIP_CONGESTION_WAIT,
 		PAGEOUTRUN, ALLOCSTALL, PGROTATED,
+		READAHEAD_HIT, READAHEAD_MISS,
+		READAHEAD_STRIDE, READAHEAD_BACKWARD,
 #ifdef CONFIG_COMPACTION
 		COMPACTBLOCKS, COMPACTPAGES, COMPACTPAGEFAILED,
-		COMPACTSTALL, COMPACTFAIL, COMPACTSUCCESS,
+		COMPACTSTALL, COMPACTFAIL, COMPACTSUCCESS, COMPACTSTALL_USECS,
+		KCOMPACTD_WAKE, KCOMPACTD_SUCCESS, KCOMPACTD_FAIL,
+		KCOMPACTD_USECS, KCOMPACTD_FRAGINDEX,
+		KCOMPACTD_FRAGINDEX_SAMPLES,
+#endif
+#ifdef CONFIG_LRU_GEN
+		LRU_GEN_AGING, LRU_GEN_PROMOTED, LRU_GEN_REFERENCED,
+		LRU_GEN_EVICTED, LRU_GEN_WALK_USECS, LRU_GEN_EVICT_USECS,
 #endif
 #ifdef CONFIG_HUGETLB_PAGE
 		HTLB_BUDDY_PGALLOC, HTLB_BUDDY_PGALLOC_FAIL,
@@ -139,6 +153,9 @@ static inline void vm_events_fold_cpu(int cpu)
 		__count_vm_events(item##_NORMAL - ZONE_NORMAL + \
 		zone_idx(zone), delta)
 
+#define __count_pcp_vm_event(item, order) \
+		__count_vm_event(item##_ORDER0 + (order))
+
 /*
  * Zone based page accounting with per cpu differentials.
  */
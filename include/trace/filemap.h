@@ -15,5 +15,9 @@ DECLARE_TRACE(add_to_page_cache,
 DECLARE_TRACE(remove_from_page_cache,
 	TP_PROTO(struct address_space *mapping),
 		TP_ARGS(mapping));
+DECLARE_TRACE(readahead,
+	TP_PROTO(struct address_space *mapping, pgoff_t offset,
+		unsigned long nr_pages, int pattern),
+		TP_ARGS(mapping, offset, nr_pages, pattern));
 
 #endif
@@ -660,8 +660,8 @@ static int subbuf_splice_actor(struct file *in,
 	struct rchan_buf *buf = in->private_data;
 	struct ltt_channel_buf_struct *ltt_buf = buf->chan_private;
 	unsigned int poff, subbuf_pages, nr_pages;
-	struct page *pages[PIPE_BUFFERS];
-	struct partial_page partial[PIPE_BUFFERS];
+	struct page *pages[PIPE_DEF_BUFFERS];
+	struct partial_page partial[PIPE_DEF_BUFFERS];
 	struct splice_pipe_desc spd = {
 		.pages = pages,
 		.nr_pages = 0,
@@ -690,7 +690,7 @@ static int subbuf_splice_actor(struct file *in,
 	WARN_ON(bytes_avail > buf->chan->alloc_size);
 	len = min_t(size_t, len, bytes_avail);
 	subbuf_pages = bytes_avail >> PAGE_SHIFT;
-	nr_pages = min_t(unsigned int, subbuf_pages, PIPE_BUFFERS);
+	nr_pages = min_t(unsigned int, subbuf_pages, PIPE_DEF_BUFFERS);
 	roffset = consumed_old & PAGE_MASK;
 	poff = consumed_old & ~PAGE_MASK;
 	printk_dbg(KERN_DEBUG "SPLICE actor len %zu pos %zd write_pos %ld\n",
@@ -140,6 +140,16 @@ void probe_remove_from_page_cache(struct address_space *mapping)
 		mapping->host->i_ino, mapping->host->i_sb->s_dev);
 }
 
+void probe_readahead(struct address_space *mapping, pgoff_t offset,
+		unsigned long nr_pages, int pattern)
+{
+	trace_mark_tp(mm, readahead, readahead,
+		probe_readahead,
+		"inode %lu sdev %u offset %lu nr_pages %lu pattern %d",
+		mapping->host->i_ino, mapping->host->i_sb->s_dev,
+		offset, nr_pages, pattern);
+}
+
 MODULE_LICENSE("GPL and additional rights");
 MODULE_AUTHOR("Mathieu Desnoyers");
 MODULE_DESCRIPTION("MM Tracepoint Probes");
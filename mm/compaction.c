@@ -14,6 +14,9 @@
 #include <linux/backing-dev.h>
 #include <linux/sysctl.h>
 #include <linux/sysfs.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
+#include <linux/ktime.h>
 #include "internal.h"
 
 /*
@@ -38,6 +41,7 @@ struct compact_control {
 	unsigned int order;		/* order a direct compactor needs */
 	int migratetype;		/* MOVABLE, RECLAIMABLE etc */
 	struct zone *zone;
+	unsigned long deadline;		/* jiffies to give up, 0 for none */
 };
 
 static unsigned long release_freepages(struct list_head *freelist)
@@ -349,6 +353,10 @@ static int compact_finished(struct zone *zone,
 	if (fatal_signal_pending(current))
 		return COMPACT_PARTIAL;
 
+	/* Background compaction ran out of its time budget */
+	if (cc->deadline && time_after(jiffies, cc->deadline))
+		return COMPACT_PARTIAL;
+
 	/* Compaction run completes if the migrate and free scanner meet */
 	if (cc->free_pfn <= cc->migrate_pfn)
 		return COMPACT_COMPLETE;
@@ -505,6 +513,7 @@ unsigned long try_to_compact_pages(struct zonelist *zonelist,
 	struct zoneref *z;
 	struct zone *zone;
 	int rc = COMPACT_SKIPPED;
+	ktime_t start;
 
 	/*
 	 * Check whether it is worth even starting compaction. The order check is
@@ -515,6 +524,7 @@ unsigned long try_to_compact_pages(struct zonelist *zonelist,
 		return rc;
 
 	count_vm_event(COMPACTSTALL);
+	start = ktime_get();
 
 	/* Compact each zone in the list */
 	for_each_zone_zonelist_nodemask(zone, z, zonelist, high_zoneidx,
@@ -528,6 +538,8 @@ unsigned long try_to_compact_pages(struct zonelist *zonelist,
 		if (zone_watermark_ok(zone, order, low_wmark_pages(zone), 0, 0))
 			break;
 	}
+	count_vm_events(COMPACTSTALL_USECS,
+			ktime_us_delta(ktime_get(), start));
 
 	return rc;
 }
@@ -602,6 +614,187 @@ int sysctl_extfrag_handler(struct ctl_table *table, int write,
 	return 0;
 }
 
+/*
+ * kcompactd compacts a node in the background once kswapd has finished
+ * reclaiming for a high-order allocation, so that the next allocations
+ * of that order find free pages instead of stalling.  A run is limited
+ * to KCOMPACTD_BUDGET per zone and uses the same deferral as direct
+ * compaction after a failure.
+ */
+#define KCOMPACTD_BUDGET	(HZ / 10)
+
+static bool kcompactd_node_suitable(pg_data_t *pgdat, int order)
+{
+	int zoneid;
+
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+
+		if (!populated_zone(zone))
+			continue;
+		if (compaction_suitable(zone, order) == COMPACT_CONTINUE)
+			return true;
+	}
+
+	return false;
+}
+
+static void kcompactd_do_work(pg_data_t *pgdat)
+{
+	int order = pgdat->kcompactd_max_order;
+	int zoneid;
+	ktime_t start;
+
+	count_vm_event(KCOMPACTD_WAKE);
+	start = ktime_get();
+
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+		struct compact_control cc = {
+			.nr_freepages = 0,
+			.nr_migratepages = 0,
+			.order = order,
+			.migratetype = MIGRATE_UNMOVABLE,
+			.zone = zone,
+		};
+		int fragindex;
+		int status;
+
+		if (!populated_zone(zone))
+			continue;
+
+		/* Sampled so the fragmentation can be followed over time */
+		fragindex = fragmentation_index(zone, order);
+		count_vm_events(KCOMPACTD_FRAGINDEX, max(fragindex, 0));
+		count_vm_event(KCOMPACTD_FRAGINDEX_SAMPLES);
+
+		if (compaction_deferred(zone))
+			continue;
+		if (compaction_suitable(zone, order) != COMPACT_CONTINUE)
+			continue;
+
+		INIT_LIST_HEAD(&cc.freepages);
+		INIT_LIST_HEAD(&cc.migratepages);
+		cc.deadline = jiffies + KCOMPACTD_BUDGET;
+
+		status = compact_zone(zone, &cc);
+
+		/* Page migration frees to the PCP lists but we want merging */
+		drain_local_pages(NULL);
+
+		if (zone_watermark_ok(zone, order, low_wmark_pages(zone), 0, 0)) {
+			zone->compact_considered = 0;
+			zone->compact_defer_shift = 0;
+			count_vm_event(KCOMPACTD_SUCCESS);
+		} else {
+			/* Do not retry a zone that was compacted in vain */
+			if (status == COMPACT_COMPLETE)
+				defer_compaction(zone);
+			count_vm_event(KCOMPACTD_FAIL);
+		}
+
+		VM_BUG_ON(!list_empty(&cc.freepages));
+		VM_BUG_ON(!list_empty(&cc.migratepages));
+
+		if (kthread_should_stop())
+			break;
+	}
+
+	count_vm_events(KCOMPACTD_USECS, ktime_us_delta(ktime_get(), start));
+
+	/* Keep a larger order requested while we were busy */
+	if (pgdat->kcompactd_max_order <= order)
+		pgdat->kcompactd_max_order = 0;
+}
+
+/*
+ * Called by kswapd before it goes back to sleep after balancing @pgdat
+ * for an allocation of @order.
+ */
+void wakeup_kcompactd(pg_data_t *pgdat, int order)
+{
+	if (!order)
+		return;
+
+	if (pgdat->kcompactd_max_order < order)
+		pgdat->kcompactd_max_order = order;
+
+	if (!waitqueue_active(&pgdat->kcompactd_wait))
+		return;
+
+	/* Only fragmentation, not a lack of free memory, is worth waking for */
+	if (!kcompactd_node_suitable(pgdat, order))
+		return;
+
+	wake_up_interruptible(&pgdat->kcompactd_wait);
+}
+
+static int kcompactd(void *p)
+{
+	pg_data_t *pgdat = (pg_data_t *)p;
+	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
+
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(current, cpumask);
+	set_freezable();
+
+	while (!kthread_should_stop()) {
+		wait_event_freezable(pgdat->kcompactd_wait,
+				     pgdat->kcompactd_max_order ||
+				     kthread_should_stop());
+		if (kthread_should_stop())
+			break;
+		if (pgdat->kcompactd_max_order)
+			kcompactd_do_work(pgdat);
+	}
+
+	return 0;
+}
+
+/*
+ * This kcompactd start function will be called by init and node-hot-add.
+ */
+int kcompactd_run(int nid)
+{
+	pg_data_t *pgdat = NODE_DATA(nid);
+	int ret = 0;
+
+	if (pgdat->kcompactd)
+		return 0;
+
+	pgdat->kcompactd = kthread_run(kcompactd, pgdat, "kcompactd%d", nid);
+	if (IS_ERR(pgdat->kcompactd)) {
+		printk(KERN_ERR "Failed to start kcompactd on node %d\n", nid);
+		pgdat->kcompactd = NULL;
+		ret = -1;
+	}
+	return ret;
+}
+
+/*
+ * Called by memory hotplug when all memory in a node is offlined.
+ */
+void kcompactd_stop(int nid)
+{
+	struct task_struct *kcompactd = NODE_DATA(nid)->kcompactd;
+
+	if (kcompactd) {
+		kthread_stop(kcompactd);
+		NODE_DATA(nid)->kcompactd = NULL;
+	}
+}
+
+static int __init kcompactd_init(void)
+{
+	int nid;
+
+	for_each_node_state(nid, N_HIGH_MEMORY)
+		kcompactd_run(nid);
+	return 0;
+}
+
+module_init(kcompactd_init)
+
 #if defined(CONFIG_SYSFS) && defined(CONFIG_NUMA)
 ssize_t sysfs_compact_node(struct sys_device *dev,
 			struct sysdev_attribute *attr,
@@ -117,12 +117,36 @@ DEFINE_TRACE(remove_from_page_cache);
  *    ->i_mmap_lock
  */
 
+static void page_cache_tree_delete(struct address_space *mapping,
+				   struct page *page, void *shadow)
+{
+	void **slot;
+	int tag;
+
+	if (!shadow) {
+		radix_tree_delete(&mapping->page_tree, page->index);
+		return;
+	}
+
+	slot = radix_tree_lookup_slot(&mapping->page_tree, page->index);
+	VM_BUG_ON(!slot || *slot != page);
+
+	/* Shadow entries are never tagged */
+	for (tag = 0; tag < RADIX_TREE_MAX_TAGS; tag++)
+		radix_tree_tag_clear(&mapping->page_tree, page->index, tag);
+	radix_tree_replace_slot(slot, shadow);
+	workingset_shadow_add(mapping, shadow);
+}
+
 /*
  * Remove a page from the page cache and free it. Caller has to make
  * sure the page is locked and that nobody else uses it - or that usage
  * is safe.  The caller must hold the mapping's tree_lock.
+ *
+ * If @shadow is not NULL, it is left in the page's slot, see
+ * mm/workingset.c.
  */
-void __remove_from_page_cache(struct page *page)
+void __remove_from_page_cache(struct page *page, void *shadow)
 {
 	struct address_space *mapping = page->mapping;
 
@@ -136,7 +160,7 @@ void __remove_from_page_cache(struct page *page)
 	else
 		cleancache_invalidate_page(mapping, page);
 
-	radix_tree_delete(&mapping->page_tree, page->index);
+	page_cache_tree_delete(mapping, page, shadow);
 	page->mapping = NULL;
 	mapping->nrpages--;
 	__dec_zone_page_state(page, NR_FILE_PAGES);
@@ -167,13 +191,14 @@ void remove_from_page_cache(struct page *page)
 
 	freepage = mapping->a_ops->freepage;
 	spin_lock_irq(&mapping->tree_lock);
-	__remove_from_page_cache(page);
+	__remove_from_page_cache(page, NULL);
 	spin_unlock_irq(&mapping->tree_lock);
 	mem_cgroup_uncharge_cache_page(page);
 
 	if (freepage)
 		freepage(page);
 }
+EXPORT_SYMBOL(remove_from_page_cache);
 
 static int sync_page(void *word)
 {
@@ -428,17 +453,40 @@ int filemap_write_and_wait_range(struct address_space *mapping,
 EXPORT_SYMBOL(filemap_write_and_wait_range);
 
 /**
- * add_to_page_cache_locked - add a locked page to the pagecache
- * @page:	page to add
- * @mapping:	the page's address_space
- * @offset:	page index
- * @gfp_mask:	page allocation mode
+ * page_cache_tree_insert - insert a page into the page cache radix tree
+ * @mapping: the page's address_space
+ * @page: page to insert at page->index
+ * @shadowp: returns the shadow entry that was replaced, may be NULL
  *
- * This function is used to add a page to the pagecache. It must be locked.
- * This function does not add the page to the LRU.  The caller must do that.
+ * Insert @page at its index, replacing a shadow entry left there by an
+ * earlier eviction.  The caller must hold the mapping's tree_lock and
+ * does all the accounting for the page itself.
  */
-int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
-		pgoff_t offset, gfp_t gfp_mask)
+int page_cache_tree_insert(struct address_space *mapping,
+			   struct page *page, void **shadowp)
+{
+	void **slot;
+
+	slot = radix_tree_lookup_slot(&mapping->page_tree, page->index);
+	if (slot) {
+		void *p = *slot;
+
+		if (!radix_tree_exceptional_entry(p))
+			return -EEXIST;
+		radix_tree_replace_slot(slot, page);
+		workingset_shadow_del(mapping, p);
+		if (shadowp)
+			*shadowp = p;
+		return 0;
+	}
+	return radix_tree_insert(&mapping->page_tree, page->index, page);
+}
+EXPORT_SYMBOL_GPL(page_cache_tree_insert);
+
+static int __add_to_page_cache_locked(struct page *page,
+				      struct address_space *mapping,
+				      pgoff_t offset, gfp_t gfp_mask,
+				      void **shadowp)
 {
 	int error;
 
@@ -456,7 +504,7 @@ int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
 		page->index = offset;
 
 		spin_lock_irq(&mapping->tree_lock);
-		error = radix_tree_insert(&mapping->page_tree, offset, page);
+		error = page_cache_tree_insert(mapping, page, shadowp);
 		if (likely(!error)) {
 			mapping->nrpages++;
 			__inc_zone_page_state(page, NR_FILE_PAGES);
@@ -476,11 +524,29 @@ int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
 out:
 	return error;
 }
+
+/**
+ * add_to_page_cache_locked - add a locked page to the pagecache
+ * @page:	page to add
+ * @mapping:	the page's address_space
+ * @offset:	page index
+ * @gfp_mask:	page allocation mode
+ *
+ * This function is used to add a page to the pagecache. It must be locked.
+ * This function does not add the page to the LRU.  The caller must do that.
+ */
+int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
+		pgoff_t offset, gfp_t gfp_mask)
+{
+	return __add_to_page_cache_locked(page, mapping, offset,
+					  gfp_mask, NULL);
+}
 EXPORT_SYMBOL(add_to_page_cache_locked);
 
 int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 				pgoff_t offset, gfp_t gfp_mask)
 {
+	void *shadow = NULL;
 	int ret;
 
 	/*
@@ -492,17 +558,147 @@ int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 	if (mapping_cap_swap_backed(mapping))
 		SetPageSwapBacked(page);
 
-	ret = add_to_page_cache(page, mapping, offset, gfp_mask);
-	if (ret == 0) {
-		if (page_is_file_cache(page))
-			lru_cache_add_file(page);
-		else
-			lru_cache_add_active_anon(page);
+	__set_page_locked(page);
+	ret = __add_to_page_cache_locked(page, mapping, offset,
+					 gfp_mask, &shadow);
+	if (unlikely(ret)) {
+		__clear_page_locked(page);
+		return ret;
 	}
+
+	if (!page_is_file_cache(page))
+		lru_cache_add_active_anon(page);
+	else if (shadow && workingset_refault(shadow)) {
+		/* a recently evicted part of the working set */
+		lru_cache_add_active_file(page);
+		workingset_activation(page);
+	} else
+		lru_cache_add_file(page);
 	return ret;
 }
 EXPORT_SYMBOL_GPL(add_to_page_cache_lru);
 
+/**
+ * add_to_page_cache_lru_batch - add a batch of new pages to the pagecache
+ * @mapping:	the pages' address_space
+ * @pvec:	newly allocated pages, with ->index already set
+ * @gfp_mask:	page allocation mode
+ *
+ * Batched add_to_page_cache_lru() for readahead: all pages are inserted
+ * into the radix tree under a single hold of the mapping's tree_lock and
+ * those destined for the inactive file list are put on the LRU with one
+ * pagevec.
+ *
+ * Pages that could not be added (typically because somebody else got
+ * there first) have the caller's reference dropped and are removed from
+ * @pvec.  What is left in @pvec is locked and in the pagecache, and the
+ * caller still owns a reference to each page.  Returns the number of
+ * pages added.
+ */
+int add_to_page_cache_lru_batch(struct address_space *mapping,
+				struct pagevec *pvec, gfp_t gfp_mask)
+{
+	void *shadows[PAGEVEC_SIZE];
+	int errors[PAGEVEC_SIZE];
+	unsigned long charged = 0;
+	struct pagevec lru_pvec;
+	int nr = pagevec_count(pvec);
+	int i, j, error;
+
+	for (i = 0; i < nr; i++) {
+		struct page *page = pvec->pages[i];
+
+		if (mapping_cap_swap_backed(mapping))
+			SetPageSwapBacked(page);
+		__set_page_locked(page);
+		shadows[i] = NULL;
+		errors[i] = mem_cgroup_cache_charge(page, current->mm,
+					gfp_mask & GFP_RECLAIM_MASK);
+		if (!errors[i])
+			__set_bit(i, &charged);
+	}
+
+	i = 0;
+preload:
+	error = radix_tree_preload(gfp_mask & ~__GFP_HIGHMEM);
+	if (error) {
+		for (; i < nr; i++)
+			if (!errors[i])
+				errors[i] = error;
+		goto out;
+	}
+
+	spin_lock_irq(&mapping->tree_lock);
+	for (; i < nr; i++) {
+		struct page *page = pvec->pages[i];
+
+		if (errors[i])
+			continue;
+
+		page_cache_get(page);
+		page->mapping = mapping;
+		error = page_cache_tree_insert(mapping, page, &shadows[i]);
+		if (likely(!error)) {
+			mapping->nrpages++;
+			__inc_zone_page_state(page, NR_FILE_PAGES);
+			trace_add_to_page_cache(mapping, page->index);
+			if (PageSwapBacked(page))
+				__inc_zone_page_state(page, NR_SHMEM);
+			continue;
+		}
+
+		/* the caller's reference keeps the page alive */
+		page->mapping = NULL;
+		page_cache_release(page);
+		if (error == -ENOMEM) {
+			/*
+			 * The preload only guarantees a single insertion;
+			 * refill it and carry on from this page.
+			 */
+			spin_unlock_irq(&mapping->tree_lock);
+			radix_tree_preload_end();
+			goto preload;
+		}
+		errors[i] = error;
+	}
+	spin_unlock_irq(&mapping->tree_lock);
+	radix_tree_preload_end();
+
+out:
+	pagevec_init(&lru_pvec, pvec->cold);
+	for (i = 0, j = 0; i < nr; i++) {
+		struct page *page = pvec->pages[i];
+
+		if (unlikely(errors[i])) {
+			if (test_bit(i, &charged))
+				mem_cgroup_uncharge_cache_page(page);
+			__clear_page_locked(page);
+			page_cache_release(page);
+			continue;
+		}
+
+		if (!page_is_file_cache(page))
+			lru_cache_add_active_anon(page);
+		else if (shadows[i] && workingset_refault(shadows[i])) {
+			/* a recently evicted part of the working set */
+			lru_cache_add_active_file(page);
+			workingset_activation(page);
+		} else {
+			/* ____pagevec_lru_add() drops this reference */
+			page_cache_get(page);
+			if (!pagevec_add(&lru_pvec, page))
+				____pagevec_lru_add(&lru_pvec,
+						    LRU_INACTIVE_FILE);
+		}
+		pvec->pages[j++] = page;
+	}
+	if (pagevec_count(&lru_pvec))
+		____pagevec_lru_add(&lru_pvec, LRU_INACTIVE_FILE);
+	pvec->nr = j;
+	return j;
+}
+EXPORT_SYMBOL_GPL(add_to_page_cache_lru_batch);
+
 #ifdef CONFIG_NUMA
 struct page *__page_cache_alloc(gfp_t gfp)
 {
@@ -652,6 +848,80 @@ void __lock_page_nosync(struct page *page)
 							TASK_UNINTERRUPTIBLE);
 }
 
+/**
+ * page_cache_next_hole - find the next hole (not-present entry)
+ * @mapping: mapping
+ * @index: index
+ * @max_scan: maximum range to search
+ *
+ * Search the set [index, min(index+max_scan-1, MAX_INDEX)] for the
+ * lowest indexed hole.  Shadow entries of evicted pages count as holes.
+ *
+ * Returns: the index of the hole if found, otherwise returns an index
+ * outside of the set specified (in which case 'return - index >=
+ * max_scan' will be true). In rare cases of index wrap-around, 0 will
+ * be returned.
+ *
+ * Like radix_tree_next_hole(), this may be called under rcu_read_lock
+ * and does not search a snapshot of the tree at a single point in time.
+ */
+pgoff_t page_cache_next_hole(struct address_space *mapping,
+			     pgoff_t index, unsigned long max_scan)
+{
+	unsigned long i;
+
+	for (i = 0; i < max_scan; i++) {
+		struct page *page;
+
+		page = radix_tree_lookup(&mapping->page_tree, index);
+		if (!page || radix_tree_exceptional_entry(page))
+			break;
+		index++;
+		if (index == 0)
+			break;
+	}
+
+	return index;
+}
+EXPORT_SYMBOL(page_cache_next_hole);
+
+/**
+ * page_cache_prev_hole - find the prev hole (not-present entry)
+ * @mapping: mapping
+ * @index: index
+ * @max_scan: maximum range to search
+ *
+ * Search backwards in the range [max(index-max_scan+1, 0), index] for
+ * the first hole.  Shadow entries of evicted pages count as holes.
+ *
+ * Returns: the index of the hole if found, otherwise returns an index
+ * outside of the set specified (in which case 'index - return >=
+ * max_scan' will be true). In rare cases of wrap-around, ULONG_MAX will
+ * be returned.
+ *
+ * Like radix_tree_prev_hole(), this may be called under rcu_read_lock
+ * and does not search a snapshot of the tree at a single point in time.
+ */
+pgoff_t page_cache_prev_hole(struct address_space *mapping,
+			     pgoff_t index, unsigned long max_scan)
+{
+	unsigned long i;
+
+	for (i = 0; i < max_scan; i++) {
+		struct page *page;
+
+		page = radix_tree_lookup(&mapping->page_tree, index);
+		if (!page || radix_tree_exceptional_entry(page))
+			break;
+		index--;
+		if (index == ULONG_MAX)
+			break;
+	}
+
+	return index;
+}
+EXPORT_SYMBOL(page_cache_prev_hole);
+
 /**
  * find_get_page - find and get a page reference
  * @mapping: the address_space to search
@@ -673,8 +943,13 @@ repeat:
 		page = radix_tree_deref_slot(pagep);
 		if (unlikely(!page))
 			goto out;
-		if (radix_tree_deref_retry(page))
-			goto repeat;
+		if (radix_tree_exception(page)) {
+			if (radix_tree_deref_retry(page))
+				goto repeat;
+			/* a shadow entry of an evicted page */
+			page = NULL;
+			goto out;
+		}
 
 		if (!page_cache_get_speculative(page))
 			goto repeat;
@@ -799,7 +1074,7 @@ unsigned find_get_pages(struct address_space *mapping, pgoff_t start,
 	rcu_read_lock();
 restart:
 	nr_found = radix_tree_gang_lookup_slot(&mapping->page_tree,
-				(void ***)pages, start, nr_pages);
+				(void ***)pages, NULL, start, nr_pages);
 	ret = 0;
 	for (i = 0; i < nr_found; i++) {
 		struct page *page;
@@ -807,10 +1082,14 @@ repeat:
 		page = radix_tree_deref_slot((void **)pages[i]);
 		if (unlikely(!page))
 			continue;
-		if (radix_tree_deref_retry(page)) {
-			if (ret)
-				start = pages[ret-1]->index;
-			goto restart;
+		if (radix_tree_exception(page)) {
+			if (radix_tree_deref_retry(page)) {
+				if (ret)
+					start = pages[ret-1]->index;
+				goto restart;
+			}
+			/* Skip over shadow entries of evicted pages */
+			continue;
 		}
 
 		if (!page_cache_get_speculative(page))
@@ -851,7 +1130,7 @@ unsigned find_get_pages_contig(struct address_space *mapping, pgoff_t index,
 	rcu_read_lock();
 restart:
 	nr_found = radix_tree_gang_lookup_slot(&mapping->page_tree,
-				(void ***)pages, index, nr_pages);
+				(void ***)pages, NULL, index, nr_pages);
 	ret = 0;
 	for (i = 0; i < nr_found; i++) {
 		struct page *page;
@@ -859,8 +1138,12 @@ repeat:
 		page = radix_tree_deref_slot((void **)pages[i]);
 		if (unlikely(!page))
 			continue;
-		if (radix_tree_deref_retry(page))
-			goto restart;
+		if (radix_tree_exception(page)) {
+			if (radix_tree_deref_retry(page))
+				goto restart;
+			/* A shadow entry is a hole, stop looking */
+			break;
+		}
 
 		if (!page_cache_get_speculative(page))
 			goto repeat;
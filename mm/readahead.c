@@ -16,16 +16,30 @@
 #include <linux/task_io_accounting_ops.h>
 #include <linux/pagevec.h>
 #include <linux/pagemap.h>
+#include <trace/filemap.h>
+
+DEFINE_TRACE(readahead);
+
+/* misses a pattern must repeat for before it is trusted */
+#define RA_PATTERN_CONFIRM	2
+/* strided chunks to read ahead of the current one */
+#define RA_STRIDE_CHUNKS	8
 
 /*
  * Initialise a struct file's readahead state.  Assumes that the caller has
  * memset *ra to zero.
+ *
+ * A stride learnt by earlier opens of the same inode is picked up here, so
+ * that a reopened database or archive is read ahead from its first miss.
  */
 void
 file_ra_state_init(struct file_ra_state *ra, struct address_space *mapping)
 {
 	ra->ra_pages = mapping->backing_dev_info->ra_pages;
 	ra->prev_pos = -1;
+	ra->prev_miss = -1;
+	ra->stride = ACCESS_ONCE(mapping->ra_hint_stride);
+	ra->stride_hits = 0;
 }
 EXPORT_SYMBOL_GPL(file_ra_state_init);
 
@@ -108,8 +122,9 @@ EXPORT_SYMBOL(read_cache_pages);
 static int read_pages(struct address_space *mapping, struct file *filp,
 		struct list_head *pages, unsigned nr_pages)
 {
+	struct pagevec pvec;
 	unsigned page_idx;
-	int ret;
+	int i, ret;
 
 	if (mapping->a_ops->readpages) {
 		ret = mapping->a_ops->readpages(filp, mapping, pages, nr_pages);
@@ -118,14 +133,17 @@ static int read_pages(struct address_space *mapping, struct file *filp,
 		goto out;
 	}
 
+	pagevec_init(&pvec, 1);
 	for (page_idx = 0; page_idx < nr_pages; page_idx++) {
 		struct page *page = list_to_page(pages);
 		list_del(&page->lru);
-		if (!add_to_page_cache_lru(page, mapping,
-					page->index, GFP_KERNEL)) {
-			mapping->a_ops->readpage(filp, page);
-		}
-		page_cache_release(page);
+		if (pagevec_add(&pvec, page) && page_idx + 1 < nr_pages)
+			continue;
+
+		add_to_page_cache_lru_batch(mapping, &pvec, GFP_KERNEL);
+		for (i = 0; i < pagevec_count(&pvec); i++)
+			mapping->a_ops->readpage(filp, pvec.pages[i]);
+		pagevec_release(&pvec);
 	}
 	ret = 0;
 out:
@@ -170,7 +188,7 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 		rcu_read_lock();
 		page = radix_tree_lookup(&mapping->page_tree, page_offset);
 		rcu_read_unlock();
-		if (page)
+		if (page && !radix_tree_exceptional_entry(page))
 			continue;
 
 		page = page_cache_alloc_cold(mapping);
@@ -344,7 +362,7 @@ static pgoff_t count_history_pages(struct address_space *mapping,
 	pgoff_t head;
 
 	rcu_read_lock();
-	head = radix_tree_prev_hole(&mapping->page_tree, offset - 1, max);
+	head = page_cache_prev_hole(mapping, offset - 1, max);
 	rcu_read_unlock();
 
 	return offset - 1 - head;
@@ -385,7 +403,116 @@ static int try_context_readahead(struct address_space *mapping,
 }
 
 /*
- * A minimal readahead algorithm for trivial sequential/random reads.
+ * Remember the access pattern of this stream in the inode, for the benefit
+ * of the next open.  The hints are racy by nature; they only seed the
+ * initial state of a new struct file_ra_state.
+ */
+static void ra_update_hint(struct address_space *mapping,
+			   unsigned int size, long stride)
+{
+	if (ACCESS_ONCE(mapping->ra_hint_size) != size)
+		mapping->ra_hint_size = size;
+	if (ACCESS_ONCE(mapping->ra_hint_stride) != stride)
+		mapping->ra_hint_stride = stride;
+}
+
+/*
+ * Strided and backward read-ahead
+ *
+ * Look at the distance between this miss and the previous non-sequential
+ * one.  When it repeats RA_PATTERN_CONFIRM times, the reader is jumping
+ * through the file at a fixed stride (e.g. walking a B-tree or a zip
+ * central directory), and the next RA_STRIDE_CHUNKS requests are read
+ * ahead in one go.  A request that ends where the previous miss started
+ * is a contiguous backward scan, recorded as a stride of -1 page whatever
+ * the request size; it gets a readahead window that extends downwards and
+ * ramps up like the forward one.
+ *
+ * Returns the number of pages submitted.  0 means either that no pattern
+ * was found or that everything was cached already; either way the caller
+ * falls back to reading just the requested pages.
+ */
+static unsigned long try_pattern_readahead(struct address_space *mapping,
+					   struct file_ra_state *ra,
+					   struct file *filp, pgoff_t offset,
+					   unsigned long req_size,
+					   unsigned long max)
+{
+	unsigned long nr = 0;
+	long delta;
+	int i;
+
+	if (ra->prev_miss == (pgoff_t)-1) {
+		/* first miss of this open: trust what earlier opens learnt */
+		if (ra->stride)
+			ra->stride_hits = RA_PATTERN_CONFIRM;
+		goto detected;
+	}
+
+	if (offset < ra->prev_miss && offset + req_size >= ra->prev_miss)
+		delta = -1;
+	else
+		delta = (long)(offset - ra->prev_miss);
+
+	if (delta && delta == ra->stride) {
+		ra->stride_hits++;
+	} else {
+		ra->stride = delta;
+		ra->stride_hits = 0;
+	}
+
+detected:
+	ra->prev_miss = offset;
+	if (ra->stride_hits < RA_PATTERN_CONFIRM)
+		return 0;
+
+	if (ra->stride == -1) {
+		pgoff_t end = offset + req_size;
+
+		/* ramp up if the previous window was ours as well */
+		if (ra->async_size == 0 && offset < ra->start &&
+		    offset + req_size >= ra->start)
+			nr = get_next_ra_size(ra, max);
+		else
+			nr = get_init_ra_size(req_size, max);
+		nr = max(nr, req_size);
+
+		ra->start = end > nr ? end - nr : 0;
+		ra->size = end - ra->start;
+		ra->async_size = 0;
+		ra->prev_miss = ra->start;
+
+		count_vm_event(READAHEAD_BACKWARD);
+		trace_readahead(mapping, ra->start, ra->size,
+				RA_PATTERN_BACKWARD);
+		ra_update_hint(mapping, ra->size, ra->stride);
+		return __do_page_cache_readahead(mapping, filp, ra->start,
+						 ra->size, 0);
+	}
+
+	/* forward steps within the request are sequential, not strided */
+	if (ra->stride > 0 && ra->stride <= req_size)
+		return 0;
+
+	for (i = 0; i <= RA_STRIDE_CHUNKS; i++) {
+		long pos = (long)offset + i * ra->stride;
+
+		if (pos < 0 || (i && (i + 1) * req_size > max))
+			break;
+		nr += __do_page_cache_readahead(mapping, filp, pos,
+						req_size, 0);
+		ra->prev_miss = pos;
+	}
+
+	count_vm_event(READAHEAD_STRIDE);
+	trace_readahead(mapping, offset, nr, RA_PATTERN_STRIDE);
+	ra_update_hint(mapping, req_size, ra->stride);
+	return nr;
+}
+
+/*
+ * A minimal readahead algorithm for trivial sequential/random reads,
+ * extended with detection of strided and backward access patterns.
  */
 static unsigned long
 ondemand_readahead(struct address_space *mapping,
@@ -394,6 +521,8 @@ ondemand_readahead(struct address_space *mapping,
 		   unsigned long req_size)
 {
 	unsigned long max = max_sane_readahead(ra->ra_pages);
+	int pattern = RA_PATTERN_INITIAL;
+	unsigned long nr;
 
 	/*
 	 * start of file
@@ -410,6 +539,7 @@ ondemand_readahead(struct address_space *mapping,
 		ra->start += ra->size;
 		ra->size = get_next_ra_size(ra, max);
 		ra->async_size = ra->size;
+		pattern = RA_PATTERN_SEQUENTIAL;
 		goto readit;
 	}
 
@@ -423,7 +553,7 @@ ondemand_readahead(struct address_space *mapping,
 		pgoff_t start;
 
 		rcu_read_lock();
-		start = radix_tree_next_hole(&mapping->page_tree, offset+1,max);
+		start = page_cache_next_hole(mapping, offset + 1, max);
 		rcu_read_unlock();
 
 		if (!start || start - offset > max)
@@ -434,6 +564,7 @@ ondemand_readahead(struct address_space *mapping,
 		ra->size += req_size;
 		ra->size = get_next_ra_size(ra, max);
 		ra->async_size = ra->size;
+		pattern = RA_PATTERN_CONTEXT;
 		goto readit;
 	}
 
@@ -453,18 +584,33 @@ ondemand_readahead(struct address_space *mapping,
 	 * Query the page cache and look for the traces(cached history pages)
 	 * that a sequential stream would leave behind.
 	 */
-	if (try_context_readahead(mapping, ra, offset, req_size, max))
+	if (try_context_readahead(mapping, ra, offset, req_size, max)) {
+		pattern = RA_PATTERN_CONTEXT;
 		goto readit;
+	}
+
+	/*
+	 * Strided or backward scan?
+	 */
+	nr = try_pattern_readahead(mapping, ra, filp, offset, req_size, max);
+	if (nr)
+		return nr;
 
 	/*
 	 * standalone, small random read
 	 * Read as is, and do not pollute the readahead state.
 	 */
+	trace_readahead(mapping, offset, req_size, RA_PATTERN_RANDOM);
 	return __do_page_cache_readahead(mapping, filp, offset, req_size, 0);
 
 initial_readahead:
 	ra->start = offset;
 	ra->size = get_init_ra_size(req_size, max);
+	/* first read of this open: start from the window seen last time */
+	if (ra->prev_pos == -1)
+		ra->size = max_t(unsigned long, ra->size,
+				 min_t(unsigned long,
+				       ACCESS_ONCE(mapping->ra_hint_size), max));
 	ra->async_size = ra->size > req_size ? ra->size - req_size : ra->size;
 
 readit:
@@ -478,6 +624,8 @@ readit:
 		ra->size += ra->async_size;
 	}
 
+	ra_update_hint(mapping, ra->size, 0);
+	trace_readahead(mapping, ra->start, ra->size, pattern);
 	return ra_submit(ra, mapping, filp);
 }
 
@@ -510,6 +658,7 @@ void page_cache_sync_readahead(struct address_space *mapping,
 	}
 
 	/* do read-ahead */
+	count_vm_event(READAHEAD_MISS);
 	ondemand_readahead(mapping, ra, filp, false, offset, req_size);
 }
 EXPORT_SYMBOL_GPL(page_cache_sync_readahead);
@@ -554,6 +703,7 @@ page_cache_async_readahead(struct address_space *mapping,
 		return;
 
 	/* do read-ahead */
+	count_vm_event(READAHEAD_HIT);
 	ondemand_readahead(mapping, ra, filp, true, offset, req_size);
 }
 EXPORT_SYMBOL_GPL(page_cache_async_readahead);
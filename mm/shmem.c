@@ -2430,13 +2430,19 @@ static struct inode *shmem_alloc_inode(struct super_block *sb)
 	return &p->vfs_inode;
 }
 
+static void shmem_i_callback(struct rcu_head *head)
+{
+	struct inode *inode = container_of(head, struct inode, i_rcu);
+	kmem_cache_free(shmem_inode_cachep, SHMEM_I(inode));
+}
+
 static void shmem_destroy_inode(struct inode *inode)
 {
 	if ((inode->i_mode & S_IFMT) == S_IFREG) {
 		/* only struct inode is valid if it's an inline symlink */
 		mpol_free_shared_policy(&SHMEM_I(inode)->policy);
 	}
-	kmem_cache_free(shmem_inode_cachep, SHMEM_I(inode));
+	call_rcu(&inode->i_rcu, shmem_i_callback);
 }
 
 static void init_once(void *foo)
@@ -2456,6 +2462,8 @@ static int init_inodecache(void)
 
 static void destroy_inodecache(void)
 {
+	/* Wait for inodes still waiting to be freed by shmem_i_callback */
+	rcu_barrier();
 	kmem_cache_destroy(shmem_inode_cachep);
 }
 
@@ -2565,6 +2573,7 @@ static struct file_system_type tmpfs_fs_type = {
 	.name		= "tmpfs",
 	.get_sb		= shmem_get_sb,
 	.kill_sb	= kill_litter_super,
+	.fs_flags	= FS_RCU_INODES,
 };
 
 int __init init_tmpfs(void)
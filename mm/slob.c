@@ -657,6 +657,47 @@ void kmem_cache_free(struct kmem_cache *c, void *b)
 }
 EXPORT_SYMBOL(kmem_cache_free);
 
+/**
+ * kmem_cache_alloc_bulk - allocate several objects of a cache
+ * @c: the cache to allocate from
+ * @flags: GFP flags
+ * @size: number of objects to allocate
+ * @p: array receiving the objects
+ *
+ * Returns @size on success, or 0 if not all objects could be allocated;
+ * nothing is left allocated in that case.
+ */
+int kmem_cache_alloc_bulk(struct kmem_cache *c, gfp_t flags,
+			  size_t size, void **p)
+{
+	size_t i;
+
+	for (i = 0; i < size; i++) {
+		p[i] = kmem_cache_alloc(c, flags);
+		if (unlikely(!p[i])) {
+			kmem_cache_free_bulk(c, i, p);
+			return 0;
+		}
+	}
+	return size;
+}
+EXPORT_SYMBOL(kmem_cache_alloc_bulk);
+
+/**
+ * kmem_cache_free_bulk - free several objects of a cache
+ * @c: the cache the objects were allocated from
+ * @size: number of objects in @p
+ * @p: the objects
+ */
+void kmem_cache_free_bulk(struct kmem_cache *c, size_t size, void **p)
+{
+	size_t i;
+
+	for (i = 0; i < size; i++)
+		kmem_cache_free(c, p[i]);
+}
+EXPORT_SYMBOL(kmem_cache_free_bulk);
+
 unsigned int kmem_cache_size(struct kmem_cache *c)
 {
 	return c->size;
@@ -1903,6 +1903,196 @@ void kmem_cache_free(struct kmem_cache *s, void *x)
 }
 EXPORT_SYMBOL(kmem_cache_free);
 
+/*
+ * Free a detached list of @cnt objects, from @head to @tail, that all
+ * belong to @page.  Like __slab_free, but the slab lock is taken only
+ * once for the whole list.
+ */
+static void __slab_free_list(struct kmem_cache *s, struct page *page,
+			void *head, void *tail, int cnt, unsigned int offset)
+{
+	void *prior;
+	struct kmem_cache_cpu *c;
+
+	c = get_cpu_slab(s, raw_smp_processor_id());
+	stat(c, FREE_SLOWPATH);
+	if (cnt > 1)
+		stat(c, FREE_BULK_SLAB);
+	slab_lock(page);
+
+	prior = ((void **)tail)[offset] = page->freelist;
+	page->freelist = head;
+	page->inuse -= cnt;
+
+	if (unlikely(PageSlubFrozen(page))) {
+		stat(c, FREE_FROZEN);
+		goto out_unlock;
+	}
+
+	if (unlikely(!page->inuse))
+		goto slab_empty;
+
+	if (unlikely(!prior)) {
+		add_partial(get_node(s, page_to_nid(page)), page, 1);
+		stat(c, FREE_ADD_PARTIAL);
+	}
+
+out_unlock:
+	slab_unlock(page);
+	return;
+
+slab_empty:
+	if (prior) {
+		remove_partial(s, page);
+		stat(c, FREE_REMOVE_PARTIAL);
+	}
+	slab_unlock(page);
+	stat(c, FREE_SLAB);
+	discard_slab(s, page);
+}
+
+/* Objects of one slab are looked for this far ahead in a bulk free */
+#define BULK_FREE_LOOKAHEAD	8
+
+/**
+ * kmem_cache_free_bulk - free several objects of a cache
+ * @s: the cache the objects were allocated from
+ * @size: number of objects in @p
+ * @p: the objects
+ *
+ * Objects of the current cpu slab are freed on the fast path.  Objects of
+ * other slabs are gathered by slab and returned with a single slab lock
+ * round trip each.  The contents of @p are clobbered.
+ */
+void kmem_cache_free_bulk(struct kmem_cache *s, size_t size, void **p)
+{
+	struct kmem_cache_cpu *c;
+	unsigned long flags;
+	size_t i;
+
+	for (i = 0; i < size; i++) {
+		kmemleak_free_recursive(p[i], s->flags);
+		kmemcheck_slab_free(s, p[i], s->objsize);
+		debug_check_no_locks_freed(p[i], s->objsize);
+		if (!(s->flags & SLAB_DEBUG_OBJECTS))
+			debug_check_no_obj_freed(p[i], s->objsize);
+		trace_kmem_cache_free(_RET_IP_, p[i]);
+	}
+
+	local_irq_save(flags);
+	c = get_cpu_slab(s, smp_processor_id());
+	while (size) {
+		void **object = p[--size];
+		void *head, *tail;
+		struct page *page;
+		int cnt, misses;
+
+		if (!object)
+			continue;	/* freed with an earlier object */
+		stat(c, FREE_BULK);
+
+		page = virt_to_head_page(object);
+		if (likely(page == c->page && c->node >= 0)) {
+			object[c->offset] = c->freelist;
+			c->freelist = object;
+			stat(c, FREE_FASTPATH);
+			continue;
+		}
+		if (unlikely(SLABDEBUG && PageSlubDebug(page))) {
+			__slab_free(s, page, object, _RET_IP_, c->offset);
+			continue;
+		}
+
+		/* Chain up the other objects of this slab close by */
+		head = tail = object;
+		cnt = 1;
+		misses = 0;
+		for (i = size; i-- > 0 && misses < BULK_FREE_LOOKAHEAD; ) {
+			void **next = p[i];
+
+			if (!next)
+				continue;
+			if (virt_to_head_page(next) != page) {
+				misses++;
+				continue;
+			}
+			next[c->offset] = head;
+			head = next;
+			p[i] = NULL;
+			stat(c, FREE_BULK);
+			cnt++;
+		}
+		__slab_free_list(s, page, head, tail, cnt, c->offset);
+	}
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL(kmem_cache_free_bulk);
+
+/**
+ * kmem_cache_alloc_bulk - allocate several objects of a cache
+ * @s: the cache to allocate from
+ * @flags: GFP flags
+ * @size: number of objects to allocate
+ * @p: array receiving the objects
+ *
+ * Interrupts are disabled only once for the whole batch, and the cpu
+ * slab is refilled in the middle of it as needed.  Returns @size on
+ * success, or 0 if not all objects could be allocated; nothing is left
+ * allocated in that case.
+ */
+int kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t size,
+			  void **p)
+{
+	struct kmem_cache_cpu *c;
+	unsigned long irqflags;
+	size_t i, nr;
+
+	flags &= gfp_allowed_mask;
+
+	lockdep_trace_alloc(flags);
+	might_sleep_if(flags & __GFP_WAIT);
+
+	if (should_failslab(s->objsize, flags, s->flags))
+		return 0;
+
+	local_irq_save(irqflags);
+	c = get_cpu_slab(s, smp_processor_id());
+	for (i = 0; i < size; i++) {
+		void **object = c->freelist;
+
+		if (unlikely(!object)) {
+			object = __slab_alloc(s, flags, -1, _RET_IP_, c);
+			if (unlikely(!object))
+				break;
+			/* The slow path may have enabled interrupts */
+			c = get_cpu_slab(s, smp_processor_id());
+		} else {
+			c->freelist = object[c->offset];
+			stat(c, ALLOC_FASTPATH);
+		}
+		stat(c, ALLOC_BULK);
+		p[i] = object;
+	}
+	local_irq_restore(irqflags);
+	nr = i;
+
+	for (i = 0; i < nr; i++) {
+		if (unlikely(flags & __GFP_ZERO))
+			memset(p[i], 0, s->objsize);
+		kmemcheck_slab_alloc(s, flags, p[i], s->objsize);
+		kmemleak_alloc_recursive(p[i], s->objsize, 1, s->flags, flags);
+		trace_kmem_cache_alloc(_RET_IP_, p[i], s->objsize, s->size,
+				       flags);
+	}
+
+	if (unlikely(nr < size)) {
+		kmem_cache_free_bulk(s, nr, p);
+		return 0;
+	}
+	return size;
+}
+EXPORT_SYMBOL(kmem_cache_alloc_bulk);
+
 /* Figure out on which slab page the object resides */
 static struct page *get_object_page(const void *x)
 {
@@ -4436,6 +4626,9 @@ STAT_ATTR(DEACTIVATE_TO_HEAD, deactivate_to_head);
 STAT_ATTR(DEACTIVATE_TO_TAIL, deactivate_to_tail);
 STAT_ATTR(DEACTIVATE_REMOTE_FREES, deactivate_remote_frees);
 STAT_ATTR(ORDER_FALLBACK, order_fallback);
+STAT_ATTR(ALLOC_BULK, alloc_bulk);
+STAT_ATTR(FREE_BULK, free_bulk);
+STAT_ATTR(FREE_BULK_SLAB, free_bulk_slab);
 #endif
 
 static struct attribute *slab_attrs[] = {
@@ -4490,6 +4683,9 @@ static struct attribute *slab_attrs[] = {
 	&deactivate_to_tail_attr.attr,
 	&deactivate_remote_frees_attr.attr,
 	&order_fallback_attr.attr,
+	&alloc_bulk_attr.attr,
+	&free_bulk_attr.attr,
+	&free_bulk_slab_attr.attr,
 #endif
 #ifdef CONFIG_FAILSLAB
 	&failslab_attr.attr,
@@ -183,6 +183,52 @@ int invalidate_inode_page(struct page *page)
 	return invalidate_complete_page(mapping, page);
 }
 
+/*
+ * Drop the shadow entries of evicted pages between @start and @end, so
+ * they do not pin radix tree nodes once the file is gone.
+ */
+static void truncate_shadow_entries(struct address_space *mapping,
+				    pgoff_t start, pgoff_t end)
+{
+	void **slots[PAGEVEC_SIZE];
+	unsigned long indices[PAGEVEC_SIZE];
+	void *shadows[PAGEVEC_SIZE];
+	pgoff_t next = start;
+	unsigned int i, nr, nr_shadows;
+	int done;
+
+	spin_lock_irq(&mapping->tree_lock);
+	while (mapping->nrshadows && next <= end) {
+		nr = radix_tree_gang_lookup_slot(&mapping->page_tree, slots,
+						 indices, next, PAGEVEC_SIZE);
+		if (!nr)
+			break;
+
+		/* Deleting may move entries around, so collect first */
+		nr_shadows = 0;
+		for (i = 0; i < nr && indices[i] <= end; i++) {
+			if (radix_tree_exceptional_entry(*slots[i])) {
+				shadows[nr_shadows] = *slots[i];
+				indices[nr_shadows++] = indices[i];
+			}
+			next = indices[i] + 1;
+		}
+		done = (i < nr || next == 0);	/* beyond @end or wrapped */
+
+		for (i = 0; i < nr_shadows; i++) {
+			radix_tree_delete(&mapping->page_tree, indices[i]);
+			workingset_shadow_del(mapping, shadows[i]);
+		}
+		if (done)
+			break;
+
+		spin_unlock_irq(&mapping->tree_lock);
+		cond_resched();
+		spin_lock_irq(&mapping->tree_lock);
+	}
+	spin_unlock_irq(&mapping->tree_lock);
+}
+
 /**
  * truncate_inode_pages - truncate range of pages specified by start & end byte offsets
  * @mapping: mapping to truncate
@@ -217,7 +263,7 @@ void truncate_inode_pages_range(struct address_space *mapping,
 	int i;
 
 	cleancache_invalidate_inode(mapping);
-	if (mapping->nrpages == 0)
+	if (mapping->nrpages == 0 && mapping->nrshadows == 0)
 		return;
 
 	BUG_ON((lend & (PAGE_CACHE_SIZE - 1)) != (PAGE_CACHE_SIZE - 1));
@@ -292,6 +338,8 @@ void truncate_inode_pages_range(struct address_space *mapping,
 		pagevec_release(&pvec);
 		mem_cgroup_uncharge_end();
 	}
+	if (mapping->nrshadows)
+		truncate_shadow_entries(mapping, start, end);
 	cleancache_invalidate_inode(mapping);
 }
 EXPORT_SYMBOL(truncate_inode_pages_range);
@@ -390,7 +438,7 @@ invalidate_complete_page2(struct address_space *mapping, struct page *page)
 
 	clear_page_mlock(page);
 	BUG_ON(page_has_private(page));
-	__remove_from_page_cache(page);
+	__remove_from_page_cache(page, NULL);
 	spin_unlock_irq(&mapping->tree_lock);
 	mem_cgroup_uncharge_cache_page(page);
 
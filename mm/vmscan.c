@@ -41,6 +41,8 @@
 #include <linux/memcontrol.h>
 #include <linux/delayacct.h>
 #include <linux/sysctl.h>
+#include <linux/ktime.h>
+#include <linux/hugetlb.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
@@ -158,6 +160,12 @@ static DECLARE_RWSEM(shrinker_rwsem);
 #define scanning_global_lru(sc)	(1)
 #endif
 
+/* Is global reclaim of @zone done from the multi-gen LRU lists? */
+static inline int lru_gen_scanning(struct zone *zone, struct scan_control *sc)
+{
+	return scanning_global_lru(sc) && lru_gen_enabled(zone);
+}
+
 static struct zone_reclaim_stat *get_reclaim_stat(struct zone *zone,
 						  struct scan_control *sc)
 {
@@ -469,9 +477,11 @@ static pageout_t pageout(struct page *page, struct address_space *mapping,
 
 /*
  * Same as remove_mapping, but if the page is removed from the mapping, it
- * gets returned with a refcount of 0.
+ * gets returned with a refcount of 0.  Pages evicted by reclaim leave a
+ * shadow entry behind for refault detection.
  */
-static int __remove_mapping(struct address_space *mapping, struct page *page)
+static int __remove_mapping(struct address_space *mapping, struct page *page,
+			    bool reclaimed)
 {
 	BUG_ON(!PageLocked(page));
 	BUG_ON(mapping != page_mapping(page));
@@ -517,10 +527,18 @@ static int __remove_mapping(struct address_space *mapping, struct page *page)
 		swapcache_free(swap, page);
 	} else {
 		void (*freepage)(struct page *);
+		void *shadow = NULL;
 
 		freepage = mapping->a_ops->freepage;
 
-		__remove_from_page_cache(page);
+		/*
+		 * Only inode data mappings are torn down through
+		 * clear_inode(), which drops their shadows.
+		 */
+		if (reclaimed && page_is_file_cache(page) &&
+		    mapping->host && mapping == &mapping->host->i_data)
+			shadow = workingset_eviction(mapping, page);
+		__remove_from_page_cache(page, shadow);
 		spin_unlock_irq(&mapping->tree_lock);
 		mem_cgroup_uncharge_cache_page(page);
 
@@ -543,7 +561,7 @@ cannot_free:
  */
 int remove_mapping(struct address_space *mapping, struct page *page)
 {
-	if (__remove_mapping(mapping, page)) {
+	if (__remove_mapping(mapping, page, false)) {
 		/*
 		 * Unfreezing the refcount with 1 rather than 2 effectively
 		 * drops the pagecache ref for us without requiring another
@@ -640,6 +658,17 @@ static enum page_references page_check_references(struct page *page,
 	int referenced_ptes, referenced_page;
 	unsigned long vm_flags;
 
+	/*
+	 * The multi-gen LRU harvests the accessed bits in its aging walk,
+	 * so skip the rmap walk here.  try_to_unmap() still refuses pages
+	 * that were referenced through a pte since.
+	 */
+	if (lru_gen_scanning(page_zone(page), sc)) {
+		if (TestClearPageReferenced(page))
+			return PAGEREF_RECLAIM_CLEAN;
+		return PAGEREF_RECLAIM;
+	}
+
 	referenced_ptes = page_referenced(page, 1, sc->mem_cgroup, &vm_flags);
 	referenced_page = TestClearPageReferenced(page);
 
@@ -892,7 +921,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			}
 		}
 
-		if (!mapping || !__remove_mapping(mapping, page))
+		if (!mapping || !__remove_mapping(mapping, page, true))
 			goto keep_locked;
 
 		/*
@@ -1556,7 +1585,7 @@ static void move_active_pages_to_lru(struct zone *zone,
 		VM_BUG_ON(PageLRU(page));
 		SetPageLRU(page);
 
-		list_move(&page->lru, &zone->lru[lru].list);
+		list_move(&page->lru, zone_lru_list(zone, lru));
 		mem_cgroup_add_lru_list(page, lru);
 		pgmoved++;
 
@@ -1758,11 +1787,481 @@ static int inactive_list_is_low(struct zone *zone, struct scan_control *sc,
 		return inactive_anon_is_low(zone, sc);
 }
 
+#ifdef CONFIG_LRU_GEN
+/*
+ * Multi-generational LRU
+ *
+ * With vm.lru_gen_enabled set, the evictable pages of each zone are kept
+ * on per-generation lists (see struct lru_gen) instead of the active and
+ * inactive lists.  Global reclaim evicts from the oldest generation of
+ * each type.  Once only MIN_NR_GENS generations are left and the oldest
+ * is empty, a new generation is started and the page tables of all mms
+ * are walked: pages whose accessed bit is set are moved to the new
+ * youngest generation, everything else ages by one generation.  Only
+ * pages in the zone being aged are looked at, other zones keep their
+ * accessed bits for their own aging.
+ *
+ * Memory cgroup reclaim keeps using the classic scanning code; it does
+ * not care which zone list a page is linked on.
+ */
+int sysctl_lru_gen_enabled;
+static DEFINE_MUTEX(lru_gen_state_mutex);
+
+/* Serialises the page table walks */
+static DEFINE_MUTEX(lru_gen_walk_mutex);
+
+/* All user mms, walked by the aging code */
+static DEFINE_SPINLOCK(lru_gen_mm_lock);
+static LIST_HEAD(lru_gen_mm_list);
+
+struct lru_gen_walk {
+	struct zone *zone;		/* the zone being aged */
+	struct vm_area_struct *vma;
+	unsigned long nr_young;		/* accessed bits cleared in this mm */
+	unsigned long nr_promoted;
+};
+
+void lru_gen_add_mm(struct mm_struct *mm)
+{
+	spin_lock(&lru_gen_mm_lock);
+	list_add_tail(&mm->lru_gen_list, &lru_gen_mm_list);
+	spin_unlock(&lru_gen_mm_lock);
+}
+
+void lru_gen_del_mm(struct mm_struct *mm)
+{
+	spin_lock(&lru_gen_mm_lock);
+	list_del(&mm->lru_gen_list);
+	spin_unlock(&lru_gen_mm_lock);
+}
+
+void lru_gen_init_zone(struct zone *zone)
+{
+	struct lru_gen *lrugen = &zone->lru_gen;
+	int gen, file;
+
+	lrugen->enabled = 0;
+	lrugen->max_seq = MIN_NR_GENS - 1;
+	lrugen->min_seq[0] = lrugen->min_seq[1] = 0;
+	for (gen = 0; gen < MAX_NR_GENS; gen++)
+		for (file = 0; file < 2; file++)
+			INIT_LIST_HEAD(&lrugen->lists[gen][file]);
+}
+
+static struct list_head *lru_gen_oldest(struct lru_gen *lrugen, int file)
+{
+	return &lrugen->lists[lru_gen_from_seq(lrugen->min_seq[file])][file];
+}
+
+static struct list_head *lru_gen_youngest(struct lru_gen *lrugen, int file)
+{
+	return &lrugen->lists[lru_gen_from_seq(lrugen->max_seq)][file];
+}
+
+/*
+ * Retire empty oldest generations of one type, keeping at least
+ * MIN_NR_GENS.  Returns 1 if there are pages left to evict in the oldest
+ * generation.  Called with zone->lru_lock held.
+ */
+static int lru_gen_try_advance(struct lru_gen *lrugen, int file)
+{
+	while (list_empty(lru_gen_oldest(lrugen, file))) {
+		if (lrugen->max_seq - lrugen->min_seq[file] + 1 <= MIN_NR_GENS)
+			return 0;
+		lrugen->min_seq[file]++;
+	}
+	return 1;
+}
+
+/*
+ * Start a new, empty youngest generation.  If a type already uses all
+ * MAX_NR_GENS generations, its oldest one is folded into the next.
+ * Called with zone->lru_lock held.
+ */
+static void lru_gen_inc_max_seq(struct lru_gen *lrugen)
+{
+	int file;
+
+	for (file = 0; file < 2; file++) {
+		unsigned long seq = lrugen->min_seq[file];
+
+		if (lrugen->max_seq - seq + 1 < MAX_NR_GENS)
+			continue;
+		list_splice_tail_init(&lrugen->lists[lru_gen_from_seq(seq)][file],
+				&lrugen->lists[lru_gen_from_seq(seq + 1)][file]);
+		lrugen->min_seq[file]++;
+	}
+	lrugen->max_seq++;
+}
+
+static int lru_gen_walk_pmd(pmd_t *pmd, unsigned long addr,
+			    unsigned long end, struct mm_walk *walk)
+{
+	struct lru_gen_walk *args = walk->private;
+	struct vm_area_struct *vma = args->vma;
+	struct zone *zone = args->zone;
+	int locked = 0;
+	spinlock_t *ptl;
+	pte_t *pte;
+
+	pte = pte_offset_map_lock(walk->mm, pmd, addr, &ptl);
+	do {
+		struct page *page;
+		int file;
+
+		if (!pte_present(*pte) || !pte_young(*pte))
+			continue;
+		page = vm_normal_page(vma, addr, *pte);
+		if (!page || page_zone(page) != zone)
+			continue;
+		if (!ptep_test_and_clear_young(vma, addr, pte))
+			continue;
+		args->nr_young++;
+
+		/* zone->lru_lock nests inside the pte lock */
+		if (!locked) {
+			spin_lock_irq(&zone->lru_lock);
+			locked = 1;
+		}
+		if (!lru_gen_enabled(zone) || !PageLRU(page) ||
+		    PageUnevictable(page))
+			continue;
+
+		file = page_is_file_cache(page);
+		list_move(&page->lru, lru_gen_youngest(&zone->lru_gen, file));
+		zone->reclaim_stat.recent_rotated[file]++;
+		args->nr_promoted++;
+	} while (pte++, addr += PAGE_SIZE, addr != end);
+	if (locked)
+		spin_unlock_irq(&zone->lru_lock);
+	pte_unmap_unlock(pte - 1, ptl);
+	cond_resched();
+
+	return 0;
+}
+
+static void lru_gen_walk_mm(struct mm_struct *mm, struct lru_gen_walk *args)
+{
+	struct vm_area_struct *vma;
+	struct mm_walk walk = {
+		.pmd_entry	= lru_gen_walk_pmd,
+		.mm		= mm,
+		.private	= args,
+	};
+
+	/* Reclaim may run with this or another mmap_sem held */
+	if (!down_read_trylock(&mm->mmap_sem))
+		return;
+
+	args->nr_young = 0;
+	for (vma = mm->mmap; vma; vma = vma->vm_next) {
+		if (vma->vm_flags & (VM_LOCKED | VM_IO | VM_PFNMAP))
+			continue;
+		if (is_vm_hugetlb_page(vma))
+			continue;
+		args->vma = vma;
+		walk_page_range(vma->vm_start, vma->vm_end, &walk);
+	}
+	/* Make sure further accesses set the accessed bits again */
+	if (args->nr_young)
+		flush_tlb_mm(mm);
+
+	up_read(&mm->mmap_sem);
+}
+
+/*
+ * Walk every mm on lru_gen_mm_list.  An mm stays on the list while we
+ * hold a reference to it, so the list can be followed across the walk.
+ * The references are dropped with mmput_async(): should one be the last,
+ * exit_mmap() and exit_aio() must not run from reclaim, with the walk
+ * mutex held.
+ */
+static void lru_gen_walk_mms(struct lru_gen_walk *args)
+{
+	struct mm_struct *mm, *prev_mm = NULL;
+	struct list_head *p = &lru_gen_mm_list;
+
+	spin_lock(&lru_gen_mm_lock);
+	while ((p = p->next) != &lru_gen_mm_list) {
+		mm = list_entry(p, struct mm_struct, lru_gen_list);
+		if (!atomic_inc_not_zero(&mm->mm_users))
+			continue;
+		spin_unlock(&lru_gen_mm_lock);
+
+		if (prev_mm)
+			mmput_async(prev_mm);
+		prev_mm = mm;
+		lru_gen_walk_mm(mm, args);
+
+		spin_lock(&lru_gen_mm_lock);
+	}
+	spin_unlock(&lru_gen_mm_lock);
+	if (prev_mm)
+		mmput_async(prev_mm);
+}
+
+static void lru_gen_age(struct zone *zone)
+{
+	struct lru_gen_walk args = { .zone = zone };
+	ktime_t start;
+
+	spin_lock_irq(&zone->lru_lock);
+	lru_gen_inc_max_seq(&zone->lru_gen);
+	spin_unlock_irq(&zone->lru_lock);
+	count_vm_event(LRU_GEN_AGING);
+
+	/* Without a walk, pages simply age by one generation */
+	if (!mutex_trylock(&lru_gen_walk_mutex))
+		return;
+
+	start = ktime_get();
+	lru_gen_walk_mms(&args);
+	mutex_unlock(&lru_gen_walk_mutex);
+
+	count_vm_events(LRU_GEN_PROMOTED, args.nr_promoted);
+	count_vm_events(LRU_GEN_WALK_USECS,
+			ktime_us_delta(ktime_get(), start));
+}
+
+/*
+ * Take up to @nr_to_scan pages off the oldest generation of one type.
+ * Active pages that were referenced again since they got there are moved
+ * to the youngest generation instead.  Called with zone->lru_lock held.
+ */
+static unsigned long lru_gen_isolate_pages(unsigned long nr_to_scan,
+		struct zone *zone, struct list_head *dst,
+		unsigned long *scanned, int file)
+{
+	struct lru_gen *lrugen = &zone->lru_gen;
+	unsigned long nr_taken = 0;
+	unsigned long nr_referenced = 0;
+	unsigned long scan;
+
+	for (scan = 0; scan < nr_to_scan; scan++) {
+		struct list_head *src;
+		struct page *page;
+
+		if (!lru_gen_try_advance(lrugen, file))
+			break;
+
+		src = lru_gen_oldest(lrugen, file);
+		page = lru_to_page(src);
+		prefetchw_prev_lru_page(page, src, flags);
+
+		VM_BUG_ON(!PageLRU(page));
+
+		if (PageActive(page) && PageReferenced(page)) {
+			ClearPageReferenced(page);
+			list_move(&page->lru, lru_gen_youngest(lrugen, file));
+			nr_referenced++;
+			continue;
+		}
+
+		switch (__isolate_lru_page(page, ISOLATE_BOTH, file)) {
+		case 0:
+			list_move(&page->lru, dst);
+			mem_cgroup_del_lru(page);
+			nr_taken++;
+			break;
+
+		case -EBUSY:
+			/* else it is being freed elsewhere */
+			list_move(&page->lru, src);
+			mem_cgroup_rotate_lru_list(page, page_lru(page));
+			continue;
+
+		default:
+			BUG();
+		}
+	}
+
+	*scanned = scan;
+	zone->reclaim_stat.recent_rotated[file] += nr_referenced;
+	__count_vm_events(LRU_GEN_REFERENCED, nr_referenced);
+	return nr_taken;
+}
+
+/*
+ * lru_gen_shrink_list() replaces shrink_inactive_list() for global reclaim
+ * when the multi-gen LRU is enabled.  It returns the number of reclaimed
+ * pages.
+ */
+static noinline_for_stack unsigned long
+lru_gen_shrink_list(unsigned long nr_to_scan, struct zone *zone,
+			struct scan_control *sc, int priority, int file)
+{
+	struct lru_gen *lrugen = &zone->lru_gen;
+	LIST_HEAD(page_list);
+	unsigned long nr_scanned;
+	unsigned long nr_reclaimed = 0;
+	unsigned long nr_taken;
+	unsigned long nr_anon;
+	unsigned long nr_file;
+	ktime_t start;
+	int aged = 0;
+
+	while (unlikely(too_many_isolated(zone, file, sc))) {
+		congestion_wait(BLK_RW_ASYNC, HZ/10);
+
+		/* We are about to die and free our memory. Return now. */
+		if (fatal_signal_pending(current))
+			return SWAP_CLUSTER_MAX;
+	}
+
+	start = ktime_get();
+	set_reclaim_mode(priority, sc, false);
+	lru_add_drain();
+again:
+	spin_lock_irq(&zone->lru_lock);
+	if (unlikely(!lru_gen_enabled(zone))) {
+		/* switched off under us, the lists are being drained */
+		spin_unlock_irq(&zone->lru_lock);
+		return shrink_inactive_list(nr_to_scan, zone, sc,
+					    priority, file);
+	}
+
+	if (!lru_gen_try_advance(lrugen, file) && !aged &&
+	    !list_empty(lru_gen_youngest(lrugen, file))) {
+		spin_unlock_irq(&zone->lru_lock);
+		lru_gen_age(zone);
+		aged = 1;
+		goto again;
+	}
+
+	nr_taken = lru_gen_isolate_pages(nr_to_scan, zone, &page_list,
+					 &nr_scanned, file);
+	zone->pages_scanned += nr_scanned;
+	if (current_is_kswapd())
+		__count_zone_vm_events(PGSCAN_KSWAPD, zone, nr_scanned);
+	else
+		__count_zone_vm_events(PGSCAN_DIRECT, zone, nr_scanned);
+
+	if (nr_taken == 0) {
+		spin_unlock_irq(&zone->lru_lock);
+		goto out;
+	}
+
+	update_isolated_counts(zone, sc, &nr_anon, &nr_file, &page_list);
+
+	spin_unlock_irq(&zone->lru_lock);
+
+	nr_reclaimed = shrink_page_list(&page_list, zone, sc);
+
+	/* Check if we should syncronously wait for writeback */
+	if (should_reclaim_stall(nr_taken, nr_reclaimed, priority, sc)) {
+		set_reclaim_mode(priority, sc, true);
+		nr_reclaimed += shrink_page_list(&page_list, zone, sc);
+	}
+
+	local_irq_disable();
+	if (current_is_kswapd())
+		__count_vm_events(KSWAPD_STEAL, nr_reclaimed);
+	__count_zone_vm_events(PGSTEAL, zone, nr_reclaimed);
+	__count_vm_events(LRU_GEN_EVICTED, nr_reclaimed);
+
+	putback_lru_pages(zone, sc, nr_anon, nr_file, &page_list);
+out:
+	count_vm_events(LRU_GEN_EVICT_USECS,
+			ktime_us_delta(ktime_get(), start));
+	return nr_reclaimed;
+}
+
+/*
+ * Move the evictable pages of every zone between the classic and the
+ * generation lists.  Pages keep their flags and statistics; only the
+ * list they are linked on changes.
+ */
+static void lru_gen_change_state(int enable)
+{
+	struct zone *zone;
+
+	for_each_populated_zone(zone) {
+		struct lru_gen *lrugen = &zone->lru_gen;
+		unsigned long seq;
+		int file, nr_moved = 0;
+
+		spin_lock_irq(&zone->lru_lock);
+		if (!enable == !lrugen->enabled) {
+			spin_unlock_irq(&zone->lru_lock);
+			continue;
+		}
+
+		if (enable) {
+			for (file = 0; file < 2; file++) {
+				enum lru_list l = LRU_BASE + file * LRU_FILE;
+
+				list_splice_init(&zone->lru[l].list,
+						 lru_gen_oldest(lrugen, file));
+				list_splice_init(&zone->lru[l + LRU_ACTIVE].list,
+						 lru_gen_youngest(lrugen, file));
+			}
+			lrugen->enabled = 1;
+			spin_unlock_irq(&zone->lru_lock);
+			continue;
+		}
+
+		/*
+		 * Nothing adds to the generation lists once disabled, so
+		 * the lock can be dropped while draining them, oldest first.
+		 */
+		lrugen->enabled = 0;
+		for (file = 0; file < 2; file++) {
+			for (seq = lrugen->min_seq[file];
+			     seq <= lrugen->max_seq; seq++) {
+				struct list_head *list;
+
+				list = &lrugen->lists[lru_gen_from_seq(seq)][file];
+				while (!list_empty(list)) {
+					struct page *page = lru_to_page(list);
+
+					list_move(&page->lru,
+						  &zone->lru[page_lru(page)].list);
+					if (++nr_moved % SWAP_CLUSTER_MAX)
+						continue;
+					spin_unlock_irq(&zone->lru_lock);
+					cond_resched();
+					spin_lock_irq(&zone->lru_lock);
+				}
+			}
+		}
+		spin_unlock_irq(&zone->lru_lock);
+	}
+}
+
+/*
+ * lru_gen_enabled [vm] sysctl handler.  Switches global reclaim between
+ * the active/inactive lists and the multi-gen LRU.
+ */
+int lru_gen_sysctl_handler(struct ctl_table *table, int write,
+			   void __user *buffer, size_t *length, loff_t *ppos)
+{
+	int ret;
+
+	mutex_lock(&lru_gen_state_mutex);
+	ret = proc_dointvec_minmax(table, write, buffer, length, ppos);
+	if (!ret && write)
+		lru_gen_change_state(sysctl_lru_gen_enabled);
+	mutex_unlock(&lru_gen_state_mutex);
+
+	return ret;
+}
+#else
+static inline unsigned long
+lru_gen_shrink_list(unsigned long nr_to_scan, struct zone *zone,
+			struct scan_control *sc, int priority, int file)
+{
+	return 0;
+}
+#endif /* CONFIG_LRU_GEN */
+
 static unsigned long shrink_list(enum lru_list lru, unsigned long nr_to_scan,
 	struct zone *zone, struct scan_control *sc, int priority)
 {
 	int file = is_file_lru(lru);
 
+	if (lru_gen_scanning(zone, sc))
+		return lru_gen_shrink_list(nr_to_scan, zone, sc, priority, file);
+
 	if (is_active_lru(lru)) {
 		if (inactive_list_is_low(zone, sc, file))
 		    shrink_active_list(nr_to_scan, zone, sc, priority, file);
@@ -1975,6 +2474,12 @@ restart:
 	nr_reclaimed = 0;
 	nr_scanned = sc->nr_scanned;
 	get_scan_count(zone, sc, nr, priority);
+	if (lru_gen_scanning(zone, sc)) {
+		/* The generations span both lists, all is evicted oldest first */
+		nr[LRU_INACTIVE_ANON] += nr[LRU_ACTIVE_ANON];
+		nr[LRU_INACTIVE_FILE] += nr[LRU_ACTIVE_FILE];
+		nr[LRU_ACTIVE_ANON] = nr[LRU_ACTIVE_FILE] = 0;
+	}
 
 	while (nr[LRU_INACTIVE_ANON] || nr[LRU_ACTIVE_FILE] ||
 					nr[LRU_INACTIVE_FILE]) {
@@ -2005,7 +2510,7 @@ restart:
 	 * Even if we did not try to evict anon pages at all, we want to
 	 * rebalance the anon lru active/inactive ratio.
 	 */
-	if (inactive_anon_is_low(zone, sc))
+	if (!lru_gen_scanning(zone, sc) && inactive_anon_is_low(zone, sc))
 		shrink_active_list(SWAP_CLUSTER_MAX, zone, sc, priority, 0);
 
 	/* reclaim/compaction might need reclaim to continue */
@@ -2370,7 +2875,8 @@ loop_again:
 			 * Do some background aging of the anon list, to give
 			 * pages a chance to be referenced before reclaiming.
 			 */
-			if (inactive_anon_is_low(zone, &sc))
+			if (!lru_gen_scanning(zone, &sc) &&
+			    inactive_anon_is_low(zone, &sc))
 				shrink_active_list(SWAP_CLUSTER_MAX, zone,
 							&sc, priority, 0);
 
@@ -2556,6 +3062,13 @@ static void kswapd_try_to_sleep(pg_data_t *pgdat, int order)
 		 * them before going back to sleep.
 		 */
 		set_pgdat_percpu_threshold(pgdat, calculate_normal_threshold);
+
+		/*
+		 * Reclaim for a high-order allocation is done, let kcompactd
+		 * turn the freed pages into blocks of that order.
+		 */
+		wakeup_kcompactd(pgdat, order);
+
 		schedule();
 		set_pgdat_percpu_threshold(pgdat, calculate_pressure_threshold);
 	} else {
@@ -3075,7 +3588,7 @@ retry:
 		enum lru_list l = page_lru_base_type(page);
 
 		__dec_zone_state(zone, NR_UNEVICTABLE);
-		list_move(&page->lru, &zone->lru[l].list);
+		list_move(&page->lru, zone_lru_list(zone, l));
 		mem_cgroup_move_lists(page, LRU_UNEVICTABLE, l);
 		__inc_zone_state(zone, NR_INACTIVE_ANON + l);
 		__count_vm_event(UNEVICTABLE_PGRESCUED);
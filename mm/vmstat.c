@@ -761,6 +761,9 @@ static const struct file_operations pagetypeinfo_file_ops = {
 #define TEXTS_FOR_ZONES(xx) TEXT_FOR_DMA(xx) TEXT_FOR_DMA32(xx) xx "_normal", \
 					TEXT_FOR_HIGHMEM(xx) xx "_movable",
 
+#define TEXTS_FOR_PCP_ORDERS(xx) xx "_order0", xx "_order1", \
+					xx "_order2", xx "_order3",
+
 static const char * const vmstat_text[] = {
 	/* Zoned VM counters */
 	"nr_free_pages",
@@ -786,6 +789,9 @@ static const char * const vmstat_text[] = {
 	"nr_isolated_anon",
 	"nr_isolated_file",
 	"nr_shmem",
+	"workingset_refault",
+	"workingset_activate",
+	"workingset_shadows",
 #ifdef CONFIG_NUMA
 	"numa_hit",
 	"numa_miss",
@@ -807,6 +813,9 @@ static const char * const vmstat_text[] = {
 	"pgactivate",
 	"pgdeactivate",
 
+	TEXTS_FOR_PCP_ORDERS("pcp_hit")
+	TEXTS_FOR_PCP_ORDERS("pcp_miss")
+
 	"pgfault",
 	"pgmajfault",
 
@@ -829,6 +838,10 @@ static const char * const vmstat_text[] = {
 	"allocstall",
 
 	"pgrotated",
+	"readahead_hit",
+	"readahead_miss",
+	"readahead_stride",
+	"readahead_backward",
 
 #ifdef CONFIG_COMPACTION
 	"compact_blocks_moved",
@@ -837,6 +850,21 @@ static const char * const vmstat_text[] = {
 	"compact_stall",
 	"compact_fail",
 	"compact_success",
+	"compact_stall_usecs",
+	"kcompactd_wake",
+	"kcompactd_success",
+	"kcompactd_fail",
+	"kcompactd_usecs",
+	"kcompactd_fragindex",
+	"kcompactd_fragindex_samples",
+#endif
+#ifdef CONFIG_LRU_GEN
+	"lru_gen_aging",
+	"lru_gen_promoted",
+	"lru_gen_referenced",
+	"lru_gen_evicted",
+	"lru_gen_walk_usecs",
+	"lru_gen_evict_usecs",
 #endif
 
 #ifdef CONFIG_HUGETLB_PAGE
@@ -0,0 +1,272 @@
+/*
+ * linux/mm/workingset.c
+ *
+ * Workingset detection
+ *
+ * When a file page is reclaimed, a shadow entry is left in its page cache
+ * slot.  It records the zone the page lived in and a snapshot of that
+ * zone's inactive_age, a counter that ticks on every eviction and every
+ * activation, i.e. every time a page leaves the inactive file list.
+ *
+ * When the page is faulted back in, the difference between the current
+ * counter and the snapshot is the number of pages that left the inactive
+ * list in the meantime: the refault distance.  Had the inactive list been
+ * that much bigger, the page would have been found in memory.  The only
+ * place to take that space from is the active list, so if the refault
+ * distance is not bigger than the active file list, the page is part of
+ * the working set and is activated right away instead of having to prove
+ * itself on the inactive list a second time.
+ *
+ * Shadow entries are removed again when a page is faulted back into their
+ * slot and when the mapping is truncated.  Mappings of files that stay
+ * cached would otherwise collect them without bound, so the radix tree
+ * nodes they pin are given back under memory pressure by a shrinker.
+ * It walks the mappings that hold shadow entries round-robin and drops
+ * their shadows, counted in the workingset_shadows zone counter.
+ */
+#include <linux/mm.h>
+#include <linux/swap.h>
+#include <linux/fs.h>
+#include <linux/init.h>
+#include <linux/pagevec.h>
+#include <linux/radix-tree.h>
+#include <linux/vmstat.h>
+
+/*
+ * Mappings with shadow entries, for the shrinker.  A mapping is on the
+ * list while its nrshadows is non-zero.  Nests inside the tree_lock.
+ */
+static LIST_HEAD(shadow_mappings);
+static DEFINE_SPINLOCK(shadow_mappings_lock);
+
+#define EVICTION_SHIFT	(RADIX_TREE_EXCEPTIONAL_SHIFT + \
+			 ZONES_SHIFT + NODES_SHIFT)
+#define EVICTION_MASK	(~0UL >> EVICTION_SHIFT)
+
+static void *pack_shadow(unsigned long eviction, struct zone *zone)
+{
+	eviction = (eviction << NODES_SHIFT) | zone_to_nid(zone);
+	eviction = (eviction << ZONES_SHIFT) | zone_idx(zone);
+	eviction = (eviction << RADIX_TREE_EXCEPTIONAL_SHIFT);
+
+	return (void *)(eviction | RADIX_TREE_EXCEPTIONAL_ENTRY);
+}
+
+static void unpack_shadow(void *shadow, struct zone **zone,
+			  unsigned long *evictionp)
+{
+	unsigned long entry = (unsigned long)shadow;
+	int zid, nid;
+
+	entry >>= RADIX_TREE_EXCEPTIONAL_SHIFT;
+	zid = entry & ((1UL << ZONES_SHIFT) - 1);
+	entry >>= ZONES_SHIFT;
+	nid = entry & ((1UL << NODES_SHIFT) - 1);
+	entry >>= NODES_SHIFT;
+
+	*zone = NODE_DATA(nid)->node_zones + zid;
+	*evictionp = entry;
+}
+
+/**
+ * workingset_eviction - note the eviction of a page from memory
+ * @mapping: address space the page was backing
+ * @page: the page being evicted
+ *
+ * Returns a shadow entry to be stored in @page->mapping->page_tree in
+ * place of the evicted @page so that a later refault can be detected.
+ */
+void *workingset_eviction(struct address_space *mapping, struct page *page)
+{
+	struct zone *zone = page_zone(page);
+	unsigned long eviction;
+
+	eviction = atomic_long_inc_return(&zone->inactive_age);
+	return pack_shadow(eviction, zone);
+}
+
+/**
+ * workingset_refault - evaluate the refault of a previously evicted page
+ * @shadow: shadow entry of the evicted page
+ *
+ * Calculates the refault distance of the page and returns 1 if it should
+ * be activated immediately, 0 if it should start on the inactive list.
+ */
+int workingset_refault(void *shadow)
+{
+	unsigned long refault_distance;
+	unsigned long eviction;
+	struct zone *zone;
+
+	unpack_shadow(shadow, &zone, &eviction);
+
+	refault_distance = (atomic_long_read(&zone->inactive_age) - eviction) &
+			   EVICTION_MASK;
+	inc_zone_state(zone, WORKINGSET_REFAULT);
+
+	if (refault_distance <= zone_page_state(zone, NR_ACTIVE_FILE)) {
+		inc_zone_state(zone, WORKINGSET_ACTIVATE);
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * workingset_activation - note a page activation
+ * @page: page that is being activated
+ */
+void workingset_activation(struct page *page)
+{
+	atomic_long_inc(&page_zone(page)->inactive_age);
+}
+
+/**
+ * workingset_shadow_add - account a shadow entry stored in a mapping
+ * @mapping: address space the shadow was stored in
+ * @shadow: the shadow entry
+ *
+ * The caller must hold the mapping's tree_lock.
+ */
+void workingset_shadow_add(struct address_space *mapping, void *shadow)
+{
+	unsigned long eviction;
+	struct zone *zone;
+
+	if (!mapping->nrshadows++) {
+		mapping->shadow_index = 0;
+		spin_lock(&shadow_mappings_lock);
+		list_add_tail(&mapping->shadow_list, &shadow_mappings);
+		spin_unlock(&shadow_mappings_lock);
+	}
+	unpack_shadow(shadow, &zone, &eviction);
+	__inc_zone_state(zone, WORKINGSET_SHADOWS);
+}
+
+/**
+ * workingset_shadow_del - account a shadow entry removed from a mapping
+ * @mapping: address space the shadow was removed from
+ * @shadow: the shadow entry
+ *
+ * The caller must hold the mapping's tree_lock.
+ */
+void workingset_shadow_del(struct address_space *mapping, void *shadow)
+{
+	unsigned long eviction;
+	struct zone *zone;
+
+	if (!--mapping->nrshadows) {
+		spin_lock(&shadow_mappings_lock);
+		list_del_init(&mapping->shadow_list);
+		spin_unlock(&shadow_mappings_lock);
+	}
+	unpack_shadow(shadow, &zone, &eviction);
+	__dec_zone_state(zone, WORKINGSET_SHADOWS);
+}
+
+/*
+ * Page slots shrink_mapping_shadows() may step over in one visit before
+ * it gives the tree_lock back, so that a big, mostly cached file cannot
+ * hold it for long.  The next visit picks up where this one stopped.
+ */
+#define SHADOW_SCAN_PAGES	1024
+
+/*
+ * Drop up to @nr_to_scan shadow entries of @mapping, starting where the
+ * last visit left off and wrapping around once at the end of the file.
+ * Called with the tree_lock held, returns the number of shadow entries
+ * dropped.
+ */
+static int shrink_mapping_shadows(struct address_space *mapping,
+				  int nr_to_scan)
+{
+	void **slots[PAGEVEC_SIZE];
+	unsigned long indices[PAGEVEC_SIZE];
+	void *shadows[PAGEVEC_SIZE];
+	unsigned int i, nr, nr_shadows;
+	pgoff_t next = mapping->shadow_index;
+	int scanned = 0, pages = 0, wrapped = !next;
+
+	while (mapping->nrshadows && scanned < nr_to_scan &&
+	       pages < SHADOW_SCAN_PAGES) {
+		nr = radix_tree_gang_lookup_slot(&mapping->page_tree, slots,
+				indices, next, PAGEVEC_SIZE);
+		if (!nr) {
+			if (wrapped)
+				break;
+			wrapped = 1;
+			next = 0;
+			continue;
+		}
+
+		/* Deleting may move entries around, so collect first */
+		nr_shadows = 0;
+		for (i = 0; i < nr && scanned + nr_shadows < nr_to_scan; i++) {
+			if (radix_tree_exceptional_entry(*slots[i])) {
+				shadows[nr_shadows] = *slots[i];
+				indices[nr_shadows++] = indices[i];
+			} else
+				pages++;
+			next = indices[i] + 1;
+		}
+		for (i = 0; i < nr_shadows; i++) {
+			radix_tree_delete(&mapping->page_tree, indices[i]);
+			workingset_shadow_del(mapping, shadows[i]);
+		}
+		scanned += nr_shadows;
+		if (!next) {
+			if (wrapped)
+				break;
+			wrapped = 1;
+		}
+	}
+	mapping->shadow_index = next;
+	return scanned;
+}
+
+/*
+ * The shadows of a mapping that is being torn down are dropped under
+ * its tree_lock, and clear_inode() waits for that lock before the
+ * mapping goes away.  So a mapping taken off the list with its tree_lock
+ * held stays valid until it is unlocked again.
+ */
+static int shrink_shadows(int nr_to_scan, gfp_t gfp_mask)
+{
+	struct address_space *mapping;
+
+	while (nr_to_scan > 0) {
+		spin_lock_irq(&shadow_mappings_lock);
+		if (list_empty(&shadow_mappings)) {
+			spin_unlock_irq(&shadow_mappings_lock);
+			break;
+		}
+		mapping = list_first_entry(&shadow_mappings,
+					   struct address_space, shadow_list);
+		list_move_tail(&mapping->shadow_list, &shadow_mappings);
+		/* tree_lock nests outside shadow_mappings_lock */
+		if (!spin_trylock(&mapping->tree_lock)) {
+			spin_unlock_irq(&shadow_mappings_lock);
+			nr_to_scan--;
+			continue;
+		}
+		spin_unlock(&shadow_mappings_lock);
+		/* a visit that only stepped over pages still costs one */
+		nr_to_scan -= max(shrink_mapping_shadows(mapping, nr_to_scan),
+				  1);
+		spin_unlock_irq(&mapping->tree_lock);
+		cond_resched();
+	}
+	return (global_page_state(WORKINGSET_SHADOWS) / 100) *
+		sysctl_vfs_cache_pressure;
+}
+
+static struct shrinker shadow_shrinker = {
+	.shrink = shrink_shadows,
+	.seeks = DEFAULT_SEEKS,
+};
+
+static int __init workingset_init(void)
+{
+	register_shrinker(&shadow_shrinker);
+	return 0;
+}
+module_init(workingset_init);
@@ -437,6 +437,41 @@ void __kfree_skb(struct sk_buff *skb)
 }
 EXPORT_SYMBOL(__kfree_skb);
 
+/* sk_buff heads returned to the slab at once by __kfree_skb_list */
+#define SKB_FREE_BULK	16
+
+/**
+ *	__kfree_skb_list - private function
+ *	@segs: first buffer of a list linked through ->next
+ *
+ *	Like __kfree_skb for every buffer on the list, but the heads are
+ *	returned to the slab cache in batches.
+ */
+void __kfree_skb_list(struct sk_buff *segs)
+{
+	void *heads[SKB_FREE_BULK];
+	size_t n = 0;
+
+	while (segs) {
+		struct sk_buff *next = segs->next;
+
+		skb_release_all(segs);
+		if (segs->fclone == SKB_FCLONE_UNAVAILABLE) {
+			heads[n++] = segs;
+			if (n == SKB_FREE_BULK) {
+				kmem_cache_free_bulk(skbuff_head_cache, n,
+						     heads);
+				n = 0;
+			}
+		} else
+			kfree_skbmem(segs);
+		segs = next;
+	}
+	if (n)
+		kmem_cache_free_bulk(skbuff_head_cache, n, heads);
+}
+EXPORT_SYMBOL(__kfree_skb_list);
+
 /**
  *	kfree_skb - free an sk_buff
  *	@skb: buffer to free
@@ -1419,7 +1454,7 @@ static inline int spd_fill_page(struct splice_pipe_desc *spd, struct page *page,
 				struct sk_buff *skb, int linear,
 				struct sock *sk)
 {
-	if (unlikely(spd->nr_pages == PIPE_BUFFERS))
+	if (unlikely(spd->nr_pages == PIPE_DEF_BUFFERS))
 		return 1;
 
 	if (linear) {
@@ -1532,8 +1567,8 @@ int skb_splice_bits(struct sk_buff *skb, unsigned int offset,
 		    struct pipe_inode_info *pipe, unsigned int tlen,
 		    unsigned int flags)
 {
-	struct partial_page partial[PIPE_BUFFERS];
-	struct page *pages[PIPE_BUFFERS];
+	struct partial_page partial[PIPE_DEF_BUFFERS];
+	struct page *pages[PIPE_DEF_BUFFERS];
 	struct splice_pipe_desc spd = {
 		.pages = pages,
 		.partial = partial,